@@ -0,0 +1,244 @@
+#include "activity.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+const int ActivityCounters::kWindowSeconds;
+const int ActivityCounters::kWindowPrecision;
+const int ActivityCounters::kDailyPrecision;
+const int ActivityCounters::kBuckets;
+const int ActivityCounters::kAhead;
+
+ActivityCounters::ActivityCounters(std::time_t now)
+    : usersToday_(kDailyPrecision),
+      systemsToday_(kDailyPrecision),
+      day_(dayOf(now)),
+      lastTick_(now),
+      recorded_(0),
+      windowUsers_(kWindowPrecision),
+      windowSystems_(kWindowPrecision) {
+  for (int i = 0; i < kBuckets; i++) buckets_.push_back(std::unique_ptr<Bucket>(new Bucket()));
+  // The window so far counted nothing here, but peers may still merge into it
+  for (std::time_t second = now - kWindowSeconds + 1; second <= now; second++) {
+    buckets_[second % kBuckets]->second.store(second, std::memory_order_relaxed);
+  }
+  prepareAhead(now);
+}
+
+void ActivityCounters::prepareAhead(std::time_t now) {
+  for (int i = 1; i <= kAhead; i++) {
+    std::time_t second = now + i;
+    Bucket& bucket = *buckets_[second % kBuckets];
+    if (bucket.second.load(std::memory_order_relaxed) == second) continue;
+    bucket.users.clear();
+    bucket.systems.clear();
+    bucket.second.store(second, std::memory_order_relaxed);
+  }
+}
+
+int ActivityCounters::dayOf(std::time_t now) {
+  struct tm local;
+  localtime_r(&now, &local);
+  return local.tm_year * 366 + local.tm_yday;
+}
+
+bool ActivityCounters::record(std::uint64_t user, std::uint64_t system, std::time_t now) {
+  std::uint64_t userHash = mixId(user);
+  std::uint64_t systemHash = mixId(system);
+  recorded_.fetch_add(1, std::memory_order_relaxed);
+  Bucket& bucket = *buckets_[now % kBuckets];
+  // No short circuit: every sketch has to see the heartbeat
+  bool changed = bucket.users.add(userHash);
+  changed |= bucket.systems.add(systemHash);
+  changed |= usersToday_.add(userHash);
+  changed |= systemsToday_.add(systemHash);
+  return changed;
+}
+
+void ActivityCounters::replay(std::uint64_t user, std::uint64_t system, std::time_t second) {
+  std::uint64_t userHash = mixId(user);
+  std::uint64_t systemHash = mixId(system);
+
+  int day = dayOf(second);
+  if (day > day_) {
+    usersToday_.clear();
+    systemsToday_.clear();
+    day_ = day;
+  }
+  if (day == day_) {
+    usersToday_.add(userHash);
+    systemsToday_.add(systemHash);
+  }
+
+  Bucket& bucket = *buckets_[second % kBuckets];
+  std::int64_t owner = bucket.second.load(std::memory_order_relaxed);
+  if (owner < second) {
+    bucket.users.clear();
+    bucket.systems.clear();
+    bucket.second.store(second, std::memory_order_relaxed);
+  } else if (owner > second) {
+    return; // The bucket has moved on to a later second
+  }
+  bucket.users.add(userHash);
+  bucket.systems.add(systemHash);
+  if (second > lastTick_) lastTick_ = second;
+}
+
+void ActivityCounters::resume(std::time_t now) {
+  std::time_t from = lastTick_ + 1;
+  if (from < now - kBuckets + kAhead + 1) from = now - kBuckets + kAhead + 1;
+  for (std::time_t second = from; second <= now + kAhead; second++) {
+    Bucket& bucket = *buckets_[second % kBuckets];
+    if (bucket.second.load(std::memory_order_relaxed) == second) continue;
+    bucket.users.clear();
+    bucket.systems.clear();
+    bucket.second.store(second, std::memory_order_relaxed);
+  }
+  if (lastTick_ < now) lastTick_ = now;
+}
+
+namespace {
+
+// Fixed part of the saved state, followed by the bucket seconds and then
+// every register, daily sketches first
+struct StateHeader {
+  std::int32_t day;
+  std::int32_t buckets;
+  std::int64_t lastTick;
+  std::uint64_t recorded;
+};
+
+// The sketch's estimate as a count, saturating rather than overflowing
+int countOf(const HyperLogLog& hll) {
+  double e = std::min(hll.estimate(), static_cast<double>(std::numeric_limits<int>::max()));
+  return static_cast<int>(std::lround(e));
+}
+
+void saveSketch(const HyperLogLog& hll, unsigned char*& out) {
+  for (std::size_t i = 0; i < hll.size(); i++) *out++ = hll.get(i);
+}
+
+void loadSketch(HyperLogLog& hll, const unsigned char*& in) {
+  hll.clear();
+  for (std::size_t i = 0; i < hll.size(); i++) hll.raise(i, *in++);
+}
+
+} // namespace
+
+std::size_t ActivityCounters::stateSize() const {
+  return sizeof(StateHeader) + kBuckets * sizeof(std::int64_t) + usersToday_.size() * 2 +
+         kBuckets * buckets_[0]->users.size() * 2;
+}
+
+void ActivityCounters::saveState(unsigned char* out) const {
+  StateHeader header = {day(), kBuckets, static_cast<std::int64_t>(lastTick_), recorded()};
+  std::memcpy(out, &header, sizeof(header));
+  out += sizeof(header);
+  for (int i = 0; i < kBuckets; i++) {
+    std::int64_t second = buckets_[i]->second.load(std::memory_order_relaxed);
+    std::memcpy(out, &second, sizeof(second));
+    out += sizeof(second);
+  }
+  saveSketch(usersToday_, out);
+  saveSketch(systemsToday_, out);
+  for (int i = 0; i < kBuckets; i++) {
+    saveSketch(buckets_[i]->users, out);
+    saveSketch(buckets_[i]->systems, out);
+  }
+}
+
+bool ActivityCounters::loadState(const unsigned char* in, std::size_t size) {
+  StateHeader header;
+  if (size != stateSize()) return false;
+  std::memcpy(&header, in, sizeof(header));
+  if (header.buckets != kBuckets) return false;
+  in += sizeof(header);
+
+  day_ = header.day;
+  lastTick_ = header.lastTick;
+  recorded_ = header.recorded;
+  for (int i = 0; i < kBuckets; i++) {
+    std::int64_t second;
+    std::memcpy(&second, in, sizeof(second));
+    in += sizeof(second);
+    buckets_[i]->second.store(second, std::memory_order_relaxed);
+  }
+  loadSketch(usersToday_, in);
+  loadSketch(systemsToday_, in);
+  for (int i = 0; i < kBuckets; i++) {
+    loadSketch(buckets_[i]->users, in);
+    loadSketch(buckets_[i]->systems, in);
+  }
+  return true;
+}
+
+ActivityCounts ActivityCounters::tick(std::time_t now) {
+  int day = dayOf(now);
+  if (day != day_) {
+    usersToday_.clear();
+    systemsToday_.clear();
+    day_ = day;
+  }
+
+  // Normally every second since the last tick was prepared in advance. If
+  // ticks were held up for longer, the seconds that were missed already
+  // hold heartbeats, so they are only claimed, not emptied.
+  std::time_t from = lastTick_ + 1;
+  if (from < now - kWindowSeconds + 1) from = now - kWindowSeconds + 1;
+  for (std::time_t second = from; second <= now; second++) {
+    buckets_[second % kBuckets]->second.store(second, std::memory_order_relaxed);
+  }
+  lastTick_ = now;
+  prepareAhead(now);
+
+  windowUsers_.clear();
+  windowSystems_.clear();
+  for (int i = 0; i < kWindowSeconds; i++) {
+    std::time_t second = now - i;
+    const Bucket& bucket = *buckets_[second % kBuckets];
+    if (bucket.second.load(std::memory_order_relaxed) != second) continue; // Nothing that second
+    windowUsers_.merge(bucket.users);
+    windowSystems_.merge(bucket.systems);
+  }
+
+  ActivityCounts counts;
+  counts.users = countOf(windowUsers_);
+  counts.systems = countOf(windowSystems_);
+  counts.usersToday = countOf(usersToday_);
+  counts.systemsToday = countOf(systemsToday_);
+  return counts;
+}
+
+void ActivityCounters::raiseRecorded(std::uint64_t count) {
+  std::uint64_t current = recorded_.load(std::memory_order_relaxed);
+  while (current < count && !recorded_.compare_exchange_weak(current, count,
+                                                              std::memory_order_relaxed)) {
+  }
+}
+
+std::int64_t ActivityCounters::bucketSecond(int i) const {
+  return buckets_[i]->second.load(std::memory_order_relaxed);
+}
+
+const HyperLogLog& ActivityCounters::bucket(int i, bool systems) const {
+  return systems ? buckets_[i]->systems : buckets_[i]->users;
+}
+
+void ActivityCounters::mergeToday(int day, bool systems, std::size_t index, std::uint8_t value) {
+  if (day != day_.load(std::memory_order_relaxed)) return;
+  HyperLogLog& hll = systems ? systemsToday_ : usersToday_;
+  hll.raise(index, std::min(value, hll.maxRank()));
+}
+
+void ActivityCounters::mergeBucket(std::int64_t second, bool systems, std::size_t index,
+                                   std::uint8_t value, std::time_t now) {
+  // Once the counters are shared only tick() claims buckets; one it hasn't
+  // claimed yet could be cleared under the registers merged into it
+  if (second > now || second <= now - kWindowSeconds) return;
+  Bucket& bucket = *buckets_[second % kBuckets];
+  if (bucket.second.load(std::memory_order_relaxed) != second) return;
+  HyperLogLog& hll = systems ? bucket.systems : bucket.users;
+  hll.raise(index, std::min(value, hll.maxRank()));
+}
@@ -0,0 +1,108 @@
+#ifndef SCOREBOARD_ACTIVITY_H
+#define SCOREBOARD_ACTIVITY_H
+
+#include <atomic>
+#include <cstdint>
+#include <ctime>
+#include <memory>
+#include <vector>
+
+#include "hyperloglog.h"
+
+// Distinct users and systems seen, as the dashboard shows them
+struct ActivityCounts {
+  int users = 0;         // acu: last 60 seconds
+  int systems = 0;       // acs
+  int usersToday = 0;    // dacu: since 00:00 local time
+  int systemsToday = 0;  // dacs
+};
+
+// Counts active users and systems from heartbeats, in fixed memory.
+//
+// The 60 second window is a ring of one second buckets, each a small
+// HyperLogLog per kind; the window's count is the estimate of their merge.
+// The day has one larger sketch per kind, cleared at midnight. record() is
+// lock-free and may be called from every worker at once; tick() belongs to
+// one thread and is called once a second.
+class ActivityCounters {
+ public:
+  static const int kWindowSeconds = 60;
+  static const int kWindowPrecision = 10; // ~3% error, 1 KiB a sketch
+  static const int kDailyPrecision = 14;  // ~0.8% error, 16 KiB a sketch
+  static const int kBuckets = 64;
+
+  explicit ActivityCounters(std::time_t now);
+
+  // Returns true if the heartbeat changed any sketch. One that didn't adds
+  // nothing if it is replayed later, so it need not be journaled.
+  bool record(std::uint64_t user, std::uint64_t system, std::time_t now);
+
+  // record() for a journaled heartbeat from `second`, which may be long gone.
+  // Moves the window and the day forward as the ticks at the time did, but
+  // never writes into a bucket that now belongs to another second. Only for
+  // use before the counters are shared.
+  void replay(std::uint64_t user, std::uint64_t system, std::time_t second);
+
+  // Empties the buckets of every second since the last tick or replayed
+  // heartbeat, up to just ahead of `now`: nothing was counted while the
+  // server was down. Call after restoring, before the counters are shared.
+  void resume(std::time_t now);
+
+  // Raw state for snapshots: the sketches, bucket seconds and day. Only
+  // consistent when taken on the tick() thread.
+  std::size_t stateSize() const;
+  void saveState(unsigned char* out) const;
+  // Before the counters are shared. False (and nothing changed) if `size`
+  // does not match, e.g. after the precision was changed.
+  bool loadState(const unsigned char* in, std::size_t size);
+
+  // Readies the next few buckets, rolls the day over at midnight and
+  // returns the current counts
+  ActivityCounts tick(std::time_t now);
+
+  // Heartbeats recorded by this server, ever. This server's entry in the
+  // cluster's G-counter (see cluster.h); raiseRecorded() takes back a
+  // larger count the journal or the peers remember from before a restart.
+  std::uint64_t recorded() const { return recorded_.load(std::memory_order_relaxed); }
+  void raiseRecorded(std::uint64_t count);
+
+  // The sketches behind the counts, for sending to peers. Any thread.
+  int day() const { return day_.load(std::memory_order_relaxed); }
+  const HyperLogLog& today(bool systems) const { return systems ? systemsToday_ : usersToday_; }
+  std::int64_t bucketSecond(int i) const;
+  const HyperLogLog& bucket(int i, bool systems) const;
+  // Merge a peer's register into ours, no higher than add() could have set
+  // it. Dropped if it is for another day, or for a second outside the window
+  // or one tick() hasn't reached. Any thread, but only one at a time may
+  // merge into buckets.
+  void mergeToday(int day, bool systems, std::size_t index, std::uint8_t value);
+  void mergeBucket(std::int64_t second, bool systems, std::size_t index, std::uint8_t value,
+                   std::time_t now);
+
+ private:
+  // Buckets prepared beyond the current second, so they are cleared well
+  // before any writer gets there
+  static const int kAhead = 3;
+
+  struct Bucket {
+    Bucket() : second(-1), users(kWindowPrecision), systems(kWindowPrecision) {}
+    std::atomic<std::int64_t> second; // The second this bucket is counting
+    HyperLogLog users;
+    HyperLogLog systems;
+  };
+
+  static int dayOf(std::time_t now);
+  // Empties the buckets for the next kAhead seconds
+  void prepareAhead(std::time_t now);
+
+  std::vector<std::unique_ptr<Bucket>> buckets_;
+  HyperLogLog usersToday_;
+  HyperLogLog systemsToday_;
+  std::atomic<int> day_;
+  std::time_t lastTick_;
+  std::atomic<std::uint64_t> recorded_;
+  HyperLogLog windowUsers_; // Scratch space for tick()
+  HyperLogLog windowSystems_;
+};
+
+#endif // SCOREBOARD_ACTIVITY_H
@@ -0,0 +1,574 @@
+// Plays a wall of scoreboards against the dashboard server (port 9999) and
+// reports throughput and latency percentiles. Every simulated device sends
+// exactly the request scoreboard.cpp's fetchRequest() does, and by default
+// opens and closes a connection per request as the ESP8266 does.
+//
+// Closed loop (the default), each device asks again as soon as it has its
+// answer. With --rate or --burst, requests are due at fixed times whether
+// or not the server has kept up, and latency counts from when a request was
+// due, so a stalled server shows up in the percentiles instead of hiding in
+// a lower request rate.
+//
+// With --conditional each device sends the ETag of its last answer back in
+// If-None-Match, as the sketch built with CONDITIONAL_POLLS does, so the
+// server's 304 path is what gets measured.
+#include <sys/epoll.h>    // For epoll functions
+#include <sys/resource.h> // For getrlimit, setrlimit
+#include <sys/socket.h>   // For socket functions
+#include <netinet/in.h>   // For sockaddr_in
+#include <arpa/inet.h>    // For inet_pton
+#include <cerrno>         // For errno
+#include <chrono>
+#include <cmath>          // For log
+#include <cstdint>
+#include <cstdio>         // For printf
+#include <cstdlib>        // For exit(), atoi(), atof() and EXIT_FAILURE
+#include <cstring>        // For strcmp, strstr
+#include <deque>
+#include <iostream>       // For cout
+#include <string>
+#include <strings.h>      // For strncasecmp
+#include <utility>        // For pair
+#include <unistd.h>       // For close, read, write
+#include <vector>
+
+#include "dashboard_wire.h"
+#include "histogram.h"
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+const std::chrono::milliseconds kRetryDelay(10);
+
+// As in scoreboard.cpp
+const char kBinaryRequest[] = "GET /gp/dbd.php HTTP/1.1\r\nHost: 192.168.1.112\r\nAccept: "
+                              DBW_CONTENT_TYPE "\r\nConnection: close\r\n\r\n";
+const char kTextRequest[] = "GET /gp/dbd.php HTTP/1.1\r\nHost: 192.168.1.112\r\n"
+                            "Connection: close\r\n\r\n";
+// The same without "Connection: close", which HTTP/1.1 keeps alive
+const char kBinaryKeepAlive[] = "GET /gp/dbd.php HTTP/1.1\r\nHost: 192.168.1.112\r\nAccept: "
+                                DBW_CONTENT_TYPE "\r\n\r\n";
+const char kTextKeepAlive[] = "GET /gp/dbd.php HTTP/1.1\r\nHost: 192.168.1.112\r\n\r\n";
+
+struct BenchOptions {
+  const char* host = "127.0.0.1";
+  int port = 9999;
+  int devices = 100;
+  bool keepAlive = false;
+  bool text = false;     // Ask for text/plain like a sketch built without BINARY_STATS
+  bool conditional = false; // Send the last ETag back, like CONDITIONAL_POLLS
+  double seconds = 10;   // How long to send for; bursts ignore it
+  double rate = 0;       // Requests a second over all devices; 0 is closed loop
+  int bursts = 0;        // Times every device asks at once; 0 is no bursts
+  double interval = 60;  // Seconds between bursts, aligned to the wall clock
+  double spread = 0;     // Milliseconds a burst's requests are spread over
+  double timeout = 5;    // Seconds to wait for answers once sending stops
+};
+
+void usage(const char* argv0) {
+  std::cout << "Usage: " << argv0 << " [--host IP] [--port N] [--devices N] [--keep-alive]\n"
+            << "                [--text] [--conditional] [--seconds S] [--rate N]\n"
+            << "                [--bursts N [--interval S] [--spread MS]] [--timeout S]\n"
+            << "  --host IP       Server address (default 127.0.0.1)\n"
+            << "  --port N        Server --port (default 9999)\n"
+            << "  --devices N     Scoreboards, i.e. most requests in flight (default 100)\n"
+            << "  --keep-alive    Reuse each device's connection instead of one per request\n"
+            << "  --text          Ask for the text dashboard instead of the binary one\n"
+            << "  --conditional   Send each device's last ETag in If-None-Match, so unchanged\n"
+            << "                  stats come back as 304s\n"
+            << "  --seconds S     How long to send requests for (default 10)\n"
+            << "  --rate N        Open loop: requests a second, spaced as a Poisson process;\n"
+            << "                  0 is closed loop, each device asking again once answered\n"
+            << "                  (default 0)\n"
+            << "  --bursts N      Instead, every device asks at once, N times: at the top of\n"
+            << "                  each --interval on the wall clock, like the real scoreboards\n"
+            << "  --interval S    Seconds between bursts (default 60)\n"
+            << "  --spread MS     Milliseconds each burst is spread over (default 0)\n"
+            << "  --timeout S     Seconds to wait for answers after sending stops (default 5)"
+            << std::endl;
+}
+
+bool parseOptions(int argc, char** argv, BenchOptions& opts) {
+  for (int i = 1; i < argc; i++) {
+    if (std::strcmp(argv[i], "--keep-alive") == 0) {
+      opts.keepAlive = true;
+    } else if (std::strcmp(argv[i], "--text") == 0) {
+      opts.text = true;
+    } else if (std::strcmp(argv[i], "--conditional") == 0) {
+      opts.conditional = true;
+    } else if (i + 1 < argc && std::strcmp(argv[i], "--host") == 0) {
+      opts.host = argv[++i];
+    } else if (i + 1 < argc && std::strcmp(argv[i], "--port") == 0) {
+      opts.port = std::atoi(argv[++i]);
+    } else if (i + 1 < argc && std::strcmp(argv[i], "--devices") == 0) {
+      opts.devices = std::atoi(argv[++i]);
+    } else if (i + 1 < argc && std::strcmp(argv[i], "--seconds") == 0) {
+      opts.seconds = std::atof(argv[++i]);
+    } else if (i + 1 < argc && std::strcmp(argv[i], "--rate") == 0) {
+      opts.rate = std::atof(argv[++i]);
+    } else if (i + 1 < argc && std::strcmp(argv[i], "--bursts") == 0) {
+      opts.bursts = std::atoi(argv[++i]);
+    } else if (i + 1 < argc && std::strcmp(argv[i], "--interval") == 0) {
+      opts.interval = std::atof(argv[++i]);
+    } else if (i + 1 < argc && std::strcmp(argv[i], "--spread") == 0) {
+      opts.spread = std::atof(argv[++i]);
+    } else if (i + 1 < argc && std::strcmp(argv[i], "--timeout") == 0) {
+      opts.timeout = std::atof(argv[++i]);
+    } else {
+      return false;
+    }
+  }
+  return opts.port > 0 && opts.port < 65536 && opts.devices > 0 && opts.seconds > 0 &&
+         opts.rate >= 0 && opts.bursts >= 0 && opts.interval > 0 && opts.spread >= 0 &&
+         opts.timeout >= 0 && !(opts.rate > 0 && opts.bursts > 0);
+}
+
+std::uint64_t nextRandom(std::uint64_t& state) {
+  state ^= state << 13; // xorshift64
+  state ^= state >> 7;
+  state ^= state << 17;
+  return state;
+}
+
+Clock::duration seconds(double s) {
+  return std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(s));
+}
+
+// A request that is due, and which burst it belongs to (-1 for none)
+struct Arrival {
+  Clock::time_point due;
+  int burst;
+};
+
+enum Phase { kIdle, kConnecting, kSending, kReceiving };
+
+struct Device {
+  int fd = -1;
+  Phase phase = kIdle;
+  Arrival arrival;
+  std::size_t sent = 0;
+  std::string in;
+  std::string etag;    // Quoted, as the last answer had it; empty before one came
+  std::string request; // What start() built, with If-None-Match if there is an ETag
+};
+
+class Bench {
+ public:
+  Bench(const BenchOptions& opts, const sockaddr_in& addr)
+      : opts_(opts), addr_(addr), devices_(opts.devices), state_(0x2545f4914f6cdd1dull) {
+    request_ = opts.keepAlive ? (opts.text ? kTextKeepAlive : kBinaryKeepAlive)
+                              : (opts.text ? kTextRequest : kBinaryRequest);
+    requestSize_ = std::strlen(request_);
+    // If-None-Match goes where the sketch puts it, before "Connection: close"
+    const char* closing = std::strstr(request_, "Connection: close");
+    conditionAt_ = closing ? closing - request_ : requestSize_ - 2;
+    burstOk_.assign(opts.bursts, 0);
+    burstSlowest_.assign(opts.bursts, 0);
+  }
+
+  bool run();
+  void report() const;
+
+ private:
+  bool nextArrival(Arrival& arrival);
+  void start(int i, const Arrival& arrival);
+  void handle(int i, std::uint32_t events);
+  void send(int i);
+  void receive(int i);
+  void finish(int i, bool ok);
+  void closeDevice(int i);
+  void watch(int i, std::uint32_t events, bool add);
+
+  const BenchOptions& opts_;
+  sockaddr_in addr_;
+  const char* request_;
+  std::size_t requestSize_;
+  std::size_t conditionAt_;
+  int epollFd_ = -1;
+  std::vector<Device> devices_;
+  std::vector<int> idle_;
+  std::deque<Arrival> waiting_; // Due, but every device was busy
+  std::deque<std::pair<Clock::time_point, int> > retries_;
+  int busy_ = 0;
+
+  Clock::time_point start_;
+  Clock::time_point stopSending_;
+  Clock::time_point firstBurst_;
+  Clock::time_point finished_;
+  std::uint64_t state_;
+  Clock::time_point nextDue_;
+  int nextBurst_ = 0;
+  int nextInBurst_ = 0;
+
+  LogLinearHistogram latency_; // Microseconds
+  std::uint64_t ok_ = 0;
+  std::uint64_t notModified_ = 0; // Of ok_
+  std::uint64_t failed_ = 0;
+  std::uint64_t timedOut_ = 0;
+  std::uint64_t queued_ = 0;
+  std::uint64_t connects_ = 0;
+  std::uint64_t bytes_ = 0;
+  std::vector<std::uint64_t> burstOk_;
+  std::vector<std::uint64_t> burstSlowest_; // Microseconds from the top of the burst
+};
+
+// The next request due in open loop or burst mode; false once there are no more
+bool Bench::nextArrival(Arrival& arrival) {
+  if (opts_.bursts > 0) {
+    if (nextBurst_ >= opts_.bursts) return false;
+    Clock::time_point top = firstBurst_ + seconds(opts_.interval * nextBurst_);
+    arrival.due = top + seconds(opts_.spread / 1000 * nextInBurst_ / opts_.devices);
+    arrival.burst = nextBurst_;
+    if (++nextInBurst_ == opts_.devices) {
+      nextInBurst_ = 0;
+      nextBurst_++;
+    }
+    return true;
+  }
+  if (nextDue_ >= stopSending_) return false;
+  arrival.due = nextDue_;
+  arrival.burst = -1;
+  // Exponential gaps make arrivals a Poisson process at the given rate
+  double uniform = (nextRandom(state_) >> 11) * (1.0 / 9007199254740992.0);
+  nextDue_ += seconds(-std::log(1 - uniform) / opts_.rate);
+  return true;
+}
+
+void Bench::watch(int i, std::uint32_t events, bool add) {
+  epoll_event ev = {};
+  ev.events = events;
+  ev.data.u32 = i;
+  epoll_ctl(epollFd_, add ? EPOLL_CTL_ADD : EPOLL_CTL_MOD, devices_[i].fd, &ev);
+}
+
+void Bench::start(int i, const Arrival& arrival) {
+  Device& d = devices_[i];
+  d.arrival = arrival;
+  d.sent = 0;
+  d.in.clear();
+  if (opts_.conditional && !d.etag.empty()) {
+    d.request.assign(request_, conditionAt_);
+    d.request += "If-None-Match: " + d.etag + "\r\n";
+    d.request.append(request_ + conditionAt_, requestSize_ - conditionAt_);
+  } else {
+    d.request.assign(request_, requestSize_);
+  }
+  busy_++;
+  if (d.fd >= 0) {
+    d.phase = kSending;
+    send(i);
+    return;
+  }
+
+  d.fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+  if (d.fd < 0) {
+    finish(i, false);
+    return;
+  }
+  connects_++;
+  if (connect(d.fd, (struct sockaddr*)&addr_, sizeof(addr_)) < 0 && errno != EINPROGRESS) {
+    finish(i, false);
+    return;
+  }
+  d.phase = kConnecting;
+  watch(i, EPOLLOUT, true);
+}
+
+void Bench::handle(int i, std::uint32_t events) {
+  Device& d = devices_[i];
+  switch (d.phase) {
+    case kIdle:
+      // The server closed a kept alive connection between requests
+      closeDevice(i);
+      break;
+    case kConnecting: {
+      int error = 0;
+      socklen_t len = sizeof(error);
+      getsockopt(d.fd, SOL_SOCKET, SO_ERROR, &error, &len);
+      if (error != 0 || (events & EPOLLERR)) {
+        finish(i, false);
+        return;
+      }
+      d.phase = kSending;
+      send(i);
+      break;
+    }
+    case kSending:
+      send(i);
+      break;
+    case kReceiving:
+      receive(i);
+      break;
+  }
+}
+
+void Bench::send(int i) {
+  Device& d = devices_[i];
+  while (d.sent < d.request.size()) {
+    ssize_t n = write(d.fd, d.request.data() + d.sent, d.request.size() - d.sent);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        watch(i, EPOLLOUT, false);
+        return;
+      }
+      finish(i, false);
+      return;
+    }
+    d.sent += n;
+  }
+  d.phase = kReceiving;
+  watch(i, EPOLLIN | EPOLLRDHUP, false);
+}
+
+void Bench::receive(int i) {
+  Device& d = devices_[i];
+  bool eof = false;
+  char buffer[4096];
+  for (;;) {
+    ssize_t n = read(d.fd, buffer, sizeof(buffer));
+    if (n > 0) {
+      d.in.append(buffer, n);
+      bytes_ += n;
+      continue;
+    }
+    if (n == 0) {
+      eof = true;
+    } else if (errno == EINTR) {
+      continue;
+    } else if (errno != EAGAIN && errno != EWOULDBLOCK) {
+      finish(i, false);
+      return;
+    }
+    break;
+  }
+
+  // Complete once the head and Content-Length bytes of body are in
+  std::size_t headEnd = d.in.find("\r\n\r\n");
+  if (headEnd != std::string::npos) {
+    std::size_t length = 0;
+    bool closes = false;
+    std::string etag;
+    std::size_t line = d.in.find("\r\n") + 2;
+    while (line < headEnd) {
+      std::size_t next = d.in.find("\r\n", line);
+      const char* field = d.in.data() + line;
+      if (strncasecmp(field, "Content-Length:", 15) == 0) {
+        length = std::strtoul(field + 15, NULL, 10);
+      } else if (strncasecmp(field, "Connection: close", 17) == 0) {
+        closes = true;
+      } else if (strncasecmp(field, "ETag:", 5) == 0) {
+        std::size_t value = line + 5;
+        while (value < next && d.in[value] == ' ') value++;
+        etag = d.in.substr(value, next - value);
+      }
+      line = next + 2;
+    }
+    if (d.in.size() >= headEnd + 4 + length) {
+      bool ok = d.in.compare(0, 12, "HTTP/1.1 200") == 0;
+      if (opts_.conditional && d.in.compare(0, 12, "HTTP/1.1 304") == 0) {
+        ok = true;
+        notModified_++;
+      }
+      if (!etag.empty()) d.etag = etag;
+      if (closes) eof = true;
+      finish(i, ok);
+      if (eof && devices_[i].fd >= 0) closeDevice(i);
+      return;
+    }
+  }
+  if (eof) finish(i, false);
+}
+
+void Bench::closeDevice(int i) {
+  Device& d = devices_[i];
+  if (d.fd >= 0) close(d.fd); // Also takes it out of the epoll set
+  d.fd = -1;
+  d.phase = kIdle;
+}
+
+// Records how request `i` went and frees the device
+void Bench::finish(int i, bool ok) {
+  Device& d = devices_[i];
+  Clock::time_point now = Clock::now();
+  busy_--;
+  if (ok) {
+    ok_++;
+    std::uint64_t micros =
+        std::chrono::duration_cast<std::chrono::microseconds>(now - d.arrival.due).count();
+    latency_.record(micros);
+    if (d.arrival.burst >= 0) {
+      Clock::time_point top = firstBurst_ + seconds(opts_.interval * d.arrival.burst);
+      std::uint64_t sinceTop =
+          std::chrono::duration_cast<std::chrono::microseconds>(now - top).count();
+      burstOk_[d.arrival.burst]++;
+      if (sinceTop > burstSlowest_[d.arrival.burst]) burstSlowest_[d.arrival.burst] = sinceTop;
+    }
+  } else {
+    failed_++;
+  }
+  if (!ok || !opts_.keepAlive) {
+    closeDevice(i);
+  } else {
+    d.phase = kIdle;
+    watch(i, EPOLLIN | EPOLLRDHUP, false);
+  }
+  finished_ = now;
+
+  // run() gives it the next request; a closed loop device that failed
+  // waits a little first, so a server that is down isn't hammered
+  if (!ok && opts_.rate == 0 && opts_.bursts == 0) {
+    retries_.push_back(std::make_pair(now + kRetryDelay, i));
+  } else {
+    idle_.push_back(i);
+  }
+}
+
+bool Bench::run() {
+  epollFd_ = epoll_create1(0);
+  if (epollFd_ < 0) {
+    std::cout << "Failed to create epoll. errno: " << errno << std::endl;
+    return false;
+  }
+
+  start_ = Clock::now();
+  stopSending_ = start_ + seconds(opts_.seconds);
+  nextDue_ = start_;
+  if (opts_.bursts > 0) {
+    // The first top of an interval on the wall clock
+    double now = std::chrono::duration<double>(
+                     std::chrono::system_clock::now().time_since_epoch()).count();
+    double wait = opts_.interval - std::fmod(now, opts_.interval);
+    firstBurst_ = start_ + seconds(wait);
+    stopSending_ = firstBurst_ + seconds(opts_.interval * (opts_.bursts - 1) + opts_.spread / 1000);
+    std::printf("First burst in %.1f s\n", wait);
+  }
+
+  // Open loop and bursts take `arrival`s from nextArrival() while `more`
+  Arrival arrival;
+  bool more = (opts_.rate > 0 || opts_.bursts > 0) && nextArrival(arrival);
+  for (int i = opts_.devices - 1; i >= 0; i--) idle_.push_back(i);
+
+  std::vector<epoll_event> events(1024);
+  for (;;) {
+    Clock::time_point now = Clock::now();
+    while (!retries_.empty() && retries_.front().first <= now) {
+      idle_.push_back(retries_.front().second);
+      retries_.pop_front();
+    }
+    if (opts_.rate == 0 && opts_.bursts == 0) {
+      while (!idle_.empty() && now < stopSending_) {
+        int i = idle_.back();
+        idle_.pop_back();
+        start(i, Arrival{now, -1});
+      }
+    }
+    while (!idle_.empty() && !waiting_.empty()) {
+      int i = idle_.back();
+      idle_.pop_back();
+      start(i, waiting_.front());
+      waiting_.pop_front();
+    }
+    while (more && arrival.due <= now) {
+      if (idle_.empty()) {
+        queued_++;
+        waiting_.push_back(arrival);
+      } else {
+        int i = idle_.back();
+        idle_.pop_back();
+        start(i, arrival);
+      }
+      more = nextArrival(arrival);
+    }
+
+    bool sending = more || (opts_.rate == 0 && opts_.bursts == 0 && now < stopSending_);
+    if (!sending && busy_ == 0 && waiting_.empty()) break;
+    if (now >= stopSending_ + seconds(opts_.timeout)) {
+      timedOut_ = busy_ + waiting_.size();
+      break;
+    }
+
+    int timeoutMs = retries_.empty() ? 100 : 10;
+    if (more) {
+      auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(arrival.due - now);
+      timeoutMs = wait.count() < timeoutMs ? static_cast<int>(wait.count()) : timeoutMs;
+    }
+    int n = epoll_wait(epollFd_, &events[0], events.size(), timeoutMs);
+    if (n < 0 && errno != EINTR) {
+      std::cout << "Failed to wait for events. errno: " << errno << std::endl;
+      return false;
+    }
+    for (int e = 0; e < n; e++) handle(events[e].data.u32, events[e].events);
+  }
+
+  for (int i = 0; i < opts_.devices; i++) closeDevice(i);
+  close(epollFd_);
+  return true;
+}
+
+void Bench::report() const {
+  double elapsed = std::chrono::duration<double>(finished_ - start_).count();
+  if (opts_.bursts > 0) {
+    // Only the time spent answering counts, not the quiet between bursts
+    elapsed = 0;
+    for (int b = 0; b < opts_.bursts; b++) elapsed += burstSlowest_[b] / 1e6;
+  }
+  if (elapsed <= 0) elapsed = 1e-9;
+
+  const char* mode = opts_.bursts > 0 ? "bursts" : opts_.rate > 0 ? "open loop" : "closed loop";
+  std::printf("%d devices, %s, %s, %s dashboard%s\n", opts_.devices, mode,
+              opts_.keepAlive ? "keep-alive" : "connection per request",
+              opts_.text ? "text" : "binary", opts_.conditional ? ", conditional" : "");
+  std::printf("Requests: %llu ok, %llu failed, %llu timed out, %llu waited for a device\n",
+              (unsigned long long)ok_, (unsigned long long)failed_,
+              (unsigned long long)timedOut_, (unsigned long long)queued_);
+  if (opts_.conditional) {
+    std::printf("Conditional: %llu of the ok answers were 304 Not Modified\n",
+                (unsigned long long)notModified_);
+  }
+  std::printf("Throughput: %.0f requests/s, %.2f MB/s received, %llu connects in %.2f s\n",
+              ok_ / elapsed, bytes_ / elapsed / 1e6, (unsigned long long)connects_, elapsed);
+  std::printf("Latency (us): p50 %llu  p90 %llu  p99 %llu  p99.9 %llu  max %llu\n",
+              (unsigned long long)latency_.percentile(50),
+              (unsigned long long)latency_.percentile(90),
+              (unsigned long long)latency_.percentile(99),
+              (unsigned long long)latency_.percentile(99.9), (unsigned long long)latency_.max());
+  for (int b = 0; b < opts_.bursts; b++) {
+    std::printf("Burst %d: %llu ok, last answer %.2f ms after the top\n", b + 1,
+                (unsigned long long)burstOk_[b], burstSlowest_[b] / 1000.0);
+  }
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  BenchOptions opts;
+  if (!parseOptions(argc, argv, opts)) {
+    usage(argv[0]);
+    exit(EXIT_FAILURE);
+  }
+
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(opts.port);
+  if (inet_pton(AF_INET, opts.host, &addr.sin_addr) != 1) {
+    std::cout << "Not an IPv4 address: " << opts.host << std::endl;
+    exit(EXIT_FAILURE);
+  }
+
+  // One socket per device, plus a few
+  rlimit files;
+  if (getrlimit(RLIMIT_NOFILE, &files) == 0 && files.rlim_cur < rlim_t(opts.devices) + 16) {
+    files.rlim_cur = files.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &files);
+    if (files.rlim_cur < rlim_t(opts.devices) + 16) {
+      std::cout << "Too many devices for the open file limit of " << files.rlim_cur << std::endl;
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  Bench bench(opts, addr);
+  if (!bench.run()) exit(EXIT_FAILURE);
+  bench.report();
+}
@@ -1,10 +1,212 @@
 #include <cpr/cpr.h>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
 #include <json.hpp>
+#include <mutex>
+#include <vector>
 
+#include "fetcher.h"
+#include "game_feed.h"
+#include "game_store.h"
+#include "http_stream.h"
+#include "json_sax.h"
+#include "standings.h"
+
+static const char* kGamesUrl = "https://api.collegefootballdata.com/games?year=2018&seasonType=regular";
+static const char* kApiBase = "https://api.collegefootballdata.com";
+static const char* kCacheDir = "games-cache";
+static const int kRegularWeeks = 15;
+static const std::size_t kLeaderboardSize = 25;
+
+// Parses the feed as it downloads and prints one line per game. Only the
+// fields in GameRecord are ever held in memory, however big the feed is.
+static int streamGames(const std::string& url) {
+    GameFeedHandler handler([](const GameRecord& game) {
+        std::cout << game.season << " week " << game.week << ": "
+                  << game.awayTeam << " " << game.awayPoints << " @ "
+                  << game.homeTeam << " " << game.homePoints << std::endl;
+    });
+    JsonStreamParser parser(handler);
+
+    std::string error;
+    long status = streamGet(url, [&parser](const char* data, std::size_t size) {
+        return parser.feed(data, size);
+    }, error);
+
+    if (!parser.error().empty()) {
+        std::cerr << "Bad JSON in feed: " << parser.error() << std::endl;
+        return 1;
+    }
+    if (status < 0) {
+        std::cerr << "Request failed: " << error << std::endl;
+        return 1;
+    }
+    if (status != 200 || !parser.finish()) {
+        std::cerr << "Unexpected response (HTTP " << status << "): " << parser.error() << std::endl;
+        return 1;
+    }
+    std::cerr << handler.games() << " games" << std::endl;
+    return 0;
+}
+
+struct BackfillOptions {
+    int first = 0;
+    int last = 0;
+    std::string base = kApiBase;
+    int parallel = FetcherOptions().parallelism;
+    std::string cacheDir = kCacheDir;
+    std::string team; // Print this team's games once loaded
+    int standings = 0; // Print this season's leaderboard once loaded
+};
+
+// Parses one week's feed into a private buffer. The games only reach the
+// store once the whole response has parsed, so a retried request never
+// leaves half a week behind.
+class WeekSink : public FetchSink {
+public:
+    WeekSink(GameStore& store, std::mutex& storeLock)
+        : store_(store), storeLock_(storeLock),
+          handler_([this](const GameRecord& game) { games_.push_back(game); }) {}
+
+    void begin() override {
+        games_.clear();
+        handler_ = GameFeedHandler([this](const GameRecord& game) { games_.push_back(game); });
+        parser_.reset(new JsonStreamParser(handler_));
+    }
+
+    bool data(const char* data, std::size_t size) override {
+        return parser_->feed(data, size);
+    }
+
+    bool end(long status) override {
+        if (status != 200) return true; // Nothing to retry; the result says why
+        if (!parser_->finish()) return false;
+        std::lock_guard<std::mutex> lock(storeLock_);
+        std::size_t dropped = 0;
+        for (const GameRecord& game : games_) {
+            if (store_.add(game) == GameStore::kNoRow) dropped++;
+        }
+        if (dropped > 0) {
+            std::cerr << "Dropped " << dropped << " games: out of ids for team and venue names"
+                      << std::endl;
+        }
+        return true;
+    }
+
+private:
+    GameStore& store_;
+    std::mutex& storeLock_;
+    std::vector<GameRecord> games_;
+    GameFeedHandler handler_;
+    std::unique_ptr<JsonStreamParser> parser_;
+};
+
+// Fetches every regular season week and the postseason of each year in
+// [first, last], several requests at a time over reused connections. Weeks
+// already in the cache are only revalidated, so finished seasons cost a 304.
+static int backfill(const BackfillOptions& opts) {
+    std::vector<std::string> urls;
+    for (int year = opts.first; year <= opts.last; year++) {
+        std::string prefix = opts.base + "/games?year=" + std::to_string(year);
+        for (int week = 1; week <= kRegularWeeks; week++) {
+            urls.push_back(prefix + "&seasonType=regular&week=" + std::to_string(week));
+        }
+        urls.push_back(prefix + "&seasonType=postseason");
+    }
+
+    FetcherOptions options;
+    options.parallelism = opts.parallel;
+    ResponseCache cache(opts.cacheDir);
+    options.cache = &cache;
+    Fetcher fetcher(options);
+
+    GameStore store;
+    std::mutex storeLock;
+    auto start = std::chrono::steady_clock::now();
+    std::vector<FetchResult> results = fetcher.fetchAll(urls, [&](const std::string&) {
+        return std::unique_ptr<FetchSink>(new WeekSink(store, storeLock));
+    });
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - start);
+
+    int failed = 0;
+    int retries = 0;
+    int cached = 0;
+    for (const FetchResult& result : results) {
+        retries += result.attempts - 1;
+        if (result.fromCache) cached++;
+        if (!result.ok) {
+            failed++;
+            std::cerr << result.url << ": " << result.error << std::endl;
+        }
+    }
+    std::cerr << store.size() << " games from " << urls.size() << " requests ("
+              << failed << " failed, " << retries << " retries, " << cached
+              << " unchanged) in "
+              << elapsed.count() << " ms, " << store.bytes() / 1024 << " KiB in memory" << std::endl;
+
+    if (!opts.team.empty()) {
+        std::vector<std::uint32_t> rows;
+        store.gamesForTeam(store.teamId(opts.team), rows);
+        const StringPool& names = store.names();
+        for (std::uint32_t i : rows) {
+            GameRow game = store.row(i);
+            if (game.postseason) {
+                std::cout << game.season << " postseason: ";
+            } else {
+                std::cout << game.season << " week " << int(game.week) << ": ";
+            }
+            std::cout << names.name(game.awayTeam) << " " << game.awayPoints << " @ "
+                      << names.name(game.homeTeam) << " " << game.homePoints << std::endl;
+        }
+    }
+
+    if (opts.standings > 0) {
+        Standings standings;
+        for (std::size_t i = 0; i < store.size(); i++) {
+            if (store.row(i).season == opts.standings) standings.update(store, i);
+        }
+        std::vector<std::uint16_t> top;
+        standings.top(kLeaderboardSize, top);
+        const StringPool& names = store.names();
+        for (std::size_t i = 0; i < top.size(); i++) {
+            const TeamRecord& record = standings.record(top[i]);
+            std::cout << i + 1 << ". " << names.name(top[i]) << " " << record.wins << "-"
+                      << record.losses << " (" << record.pointsFor << "-" << record.pointsAgainst
+                      << "), #" << standings.conferenceRank(top[i]) << " in "
+                      << names.name(standings.conference(top[i])) << std::endl;
+        }
+    }
+    return failed == 0 ? 0 : 1;
+}
 
 int main(int argc, char** argv) {
-    auto response = cpr::Get(cpr::Url{"https://api.collegefootballdata.com/games?year=2018&seasonType=regular"});
+    if (argc > 1 && std::strcmp(argv[1], "--stream") == 0) {
+        return streamGames(argc > 2 ? argv[2] : kGamesUrl);
+    }
+    if (argc > 3 && std::strcmp(argv[1], "--backfill") == 0) {
+        BackfillOptions opts;
+        opts.first = std::atoi(argv[2]);
+        opts.last = std::atoi(argv[3]);
+        for (int i = 4; i + 1 < argc; i += 2) {
+            if (std::strcmp(argv[i], "--base") == 0) {
+                opts.base = argv[i + 1];
+            } else if (std::strcmp(argv[i], "--parallel") == 0) {
+                opts.parallel = std::atoi(argv[i + 1]);
+            } else if (std::strcmp(argv[i], "--cache") == 0) {
+                opts.cacheDir = argv[i + 1];
+            } else if (std::strcmp(argv[i], "--team") == 0) {
+                opts.team = argv[i + 1];
+            } else if (std::strcmp(argv[i], "--standings") == 0) {
+                opts.standings = std::atoi(argv[i + 1]);
+            }
+        }
+        return backfill(opts);
+    }
+
+    auto response = cpr::Get(cpr::Url{kGamesUrl});
     auto json = nlohmann::json::parse(response.text);
     std::cout << json.dump(4) << std::endl;
-}
\ No newline at end of file
+}
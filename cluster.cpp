@@ -0,0 +1,452 @@
+#include "cluster.h"
+
+#include <endian.h>
+#include <netdb.h>       // For getaddrinfo
+#include <netinet/tcp.h> // For TCP_NODELAY
+#include <poll.h>        // For poll
+#include <sys/socket.h>  // For socket functions
+#include <algorithm>     // For fill
+#include <cerrno>        // For errno
+#include <chrono>
+#include <cstring>       // For memcpy
+#include <fcntl.h>       // For fcntl
+#include <iostream>      // For cout
+#include <unistd.h>      // For close
+
+#include "listener.h"
+
+// A delta frame, all integers little endian:
+//
+//   u32 length of what follows
+//   u32 magic "SYN1", u32 sending node
+//   4 x (i32 value, i64 stamp, u32 node)      s1, s2, cj, nightMode
+//   u32 n, n x (u32 node, u64 heartbeats)     G-counter
+//   i32 day, 2 x sparse registers             users and systems today
+//   u32 n, n x (i64 second, 2 x sparse registers)
+//
+// where sparse registers are u32 n, n x (u16 index, u8 value).
+
+namespace {
+
+const std::uint32_t kSyncMagic = 0x314e5953; // "SYN1"
+const std::size_t kLengthPrefix = 4;
+const int kSendTimeoutSeconds = 2;
+const int kConnectTimeoutMs = 1000;
+
+void put8(std::string& out, std::uint8_t v) { out.push_back(static_cast<char>(v)); }
+void put16(std::string& out, std::uint16_t v) {
+  v = htole16(v);
+  out.append(reinterpret_cast<const char*>(&v), sizeof(v));
+}
+void put32(std::string& out, std::uint32_t v) {
+  v = htole32(v);
+  out.append(reinterpret_cast<const char*>(&v), sizeof(v));
+}
+void put64(std::string& out, std::uint64_t v) {
+  v = htole64(v);
+  out.append(reinterpret_cast<const char*>(&v), sizeof(v));
+}
+
+// Bounds checked reads; once one runs past the end every later one fails too
+struct Reader {
+  const unsigned char* p;
+  const unsigned char* end;
+  bool ok = true;
+
+  Reader(const unsigned char* data, std::size_t size) : p(data), end(data + size) {}
+
+  bool take(void* out, std::size_t n) {
+    if (!ok || static_cast<std::size_t>(end - p) < n) return ok = false;
+    std::memcpy(out, p, n);
+    p += n;
+    return true;
+  }
+  std::uint8_t u8() {
+    std::uint8_t v = 0;
+    take(&v, sizeof(v));
+    return v;
+  }
+  std::uint16_t u16() {
+    std::uint16_t v = 0;
+    take(&v, sizeof(v));
+    return le16toh(v);
+  }
+  std::uint32_t u32() {
+    std::uint32_t v = 0;
+    take(&v, sizeof(v));
+    return le32toh(v);
+  }
+  std::uint64_t u64() {
+    std::uint64_t v = 0;
+    take(&v, sizeof(v));
+    return le64toh(v);
+  }
+};
+
+// Appends the registers of `hll` that went above `sent`, and raises `sent`.
+// Returns how many there were.
+std::uint32_t putSparse(std::string& out, const HyperLogLog& hll,
+                        std::vector<std::uint8_t>& sent, std::size_t offset) {
+  std::size_t countAt = out.size();
+  put32(out, 0);
+  std::uint32_t n = 0;
+  for (std::size_t i = 0; i < hll.size(); i++) {
+    std::uint8_t value = hll.get(i);
+    if (value <= sent[offset + i]) continue;
+    sent[offset + i] = value;
+    put16(out, static_cast<std::uint16_t>(i));
+    put8(out, value);
+    n++;
+  }
+  std::uint32_t count = htole32(n);
+  std::memcpy(&out[countAt], &count, sizeof(count));
+  return n;
+}
+
+} // namespace
+
+ClusterState::ClusterState(std::uint32_t node, ActivityCounters& activity)
+    : node_(node), activity_(activity) {
+  status_[kNightMode].value = 0;
+}
+
+void ClusterState::setStatus(const DashboardStats& stats, std::int64_t stampMs) {
+  int values[kRegisters] = {stats.s1, stats.s2, stats.cj, stats.nightMode};
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (int i = 0; i < kRegisters; i++) {
+    LwwRegister write;
+    write.value = values[i];
+    write.stamp = stampMs;
+    write.node = node_;
+    status_[i].merge(write);
+  }
+}
+
+void ClusterState::status(DashboardStats& stats) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  stats.s1 = status_[kS1].value;
+  stats.s2 = status_[kS2].value;
+  stats.cj = status_[kCj].value;
+  stats.nightMode = status_[kNightMode].value;
+}
+
+std::string ClusterState::describe() const {
+  std::map<std::uint32_t, std::uint64_t> counts;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    counts = heartbeats_;
+  }
+  counts[node_] = activity_.recorded();
+  std::uint64_t total = 0;
+  std::string lines;
+  for (std::map<std::uint32_t, std::uint64_t>::const_iterator it = counts.begin();
+       it != counts.end(); ++it) {
+    total += it->second;
+    lines += "heartbeats/" + std::to_string(it->first) + " " + std::to_string(it->second) + "\n";
+  }
+  return "node " + std::to_string(node_) + "\nheartbeats " + std::to_string(total) + "\n" + lines;
+}
+
+void ClusterState::PeerShadow::reset() {
+  day = -1;
+  for (int k = 0; k < 2; k++) {
+    today[k].assign(std::size_t(1) << ActivityCounters::kDailyPrecision, 0);
+    buckets[k].assign(ActivityCounters::kBuckets << ActivityCounters::kWindowPrecision, 0);
+  }
+  seconds.assign(ActivityCounters::kBuckets, -1);
+}
+
+void ClusterState::encodeDelta(PeerShadow& peer, std::time_t now, std::string& out) const {
+  if (peer.seconds.empty()) peer.reset();
+  std::size_t start = out.size();
+  put32(out, 0); // Length, filled in at the end
+  put32(out, kSyncMagic);
+  put32(out, node_);
+
+  // The registers and counts are a few dozen bytes, so they always go
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (int i = 0; i < kRegisters; i++) {
+      put32(out, static_cast<std::uint32_t>(status_[i].value));
+      put64(out, static_cast<std::uint64_t>(status_[i].stamp));
+      put32(out, status_[i].node);
+    }
+    put32(out, static_cast<std::uint32_t>(heartbeats_.size() + 1));
+    put32(out, node_);
+    put64(out, activity_.recorded());
+    for (std::map<std::uint32_t, std::uint64_t>::const_iterator it = heartbeats_.begin();
+         it != heartbeats_.end(); ++it) {
+      put32(out, it->first);
+      put64(out, it->second);
+    }
+  }
+
+  int day = activity_.day();
+  if (day != peer.day) {
+    peer.today[0].assign(peer.today[0].size(), 0);
+    peer.today[1].assign(peer.today[1].size(), 0);
+    peer.day = day;
+  }
+  put32(out, static_cast<std::uint32_t>(day));
+  putSparse(out, activity_.today(false), peer.today[0], 0);
+  putSparse(out, activity_.today(true), peer.today[1], 0);
+
+  // Only the buckets still in the window, and only those with news, matter
+  // to the peer
+  std::size_t countAt = out.size();
+  put32(out, 0);
+  std::uint32_t n = 0;
+  for (int i = 0; i < ActivityCounters::kBuckets; i++) {
+    std::int64_t second = activity_.bucketSecond(i);
+    if (second > now || second <= now - ActivityCounters::kWindowSeconds) continue;
+    std::size_t offset = static_cast<std::size_t>(i) << ActivityCounters::kWindowPrecision;
+    if (peer.seconds[i] != second) {
+      for (int k = 0; k < 2; k++) {
+        std::fill(peer.buckets[k].begin() + offset,
+                  peer.buckets[k].begin() + offset + activity_.bucket(i, false).size(), 0);
+      }
+      peer.seconds[i] = second;
+    }
+    std::size_t bucketAt = out.size();
+    put64(out, static_cast<std::uint64_t>(second));
+    if (putSparse(out, activity_.bucket(i, false), peer.buckets[0], offset) +
+            putSparse(out, activity_.bucket(i, true), peer.buckets[1], offset) ==
+        0) {
+      out.resize(bucketAt);
+      continue;
+    }
+    n++;
+  }
+  n = htole32(n);
+  std::memcpy(&out[countAt], &n, sizeof(n));
+
+  std::uint32_t length = htole32(static_cast<std::uint32_t>(out.size() - start - kLengthPrefix));
+  std::memcpy(&out[start], &length, sizeof(length));
+}
+
+bool ClusterState::applyDelta(const unsigned char* data, std::size_t size, std::time_t now) {
+  Reader in(data, size);
+  if (in.u32() != kSyncMagic) return false;
+  in.u32(); // Sender; everything it says is about itself or was gossiped to it
+
+  LwwRegister registers[kRegisters];
+  for (int i = 0; i < kRegisters; i++) {
+    registers[i].value = static_cast<std::int32_t>(in.u32());
+    registers[i].stamp = static_cast<std::int64_t>(in.u64());
+    registers[i].node = in.u32();
+  }
+  std::map<std::uint32_t, std::uint64_t> counts;
+  std::uint32_t nodes = in.u32();
+  for (std::uint32_t i = 0; i < nodes && in.ok; i++) {
+    std::uint32_t node = in.u32();
+    counts[node] = in.u64();
+  }
+  if (!in.ok) return false;
+
+  {
+    std::int64_t latest = static_cast<std::int64_t>(now) * 1000 + kMaxSkewMs;
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (int i = 0; i < kRegisters; i++) {
+      if (registers[i].stamp <= latest) status_[i].merge(registers[i]);
+    }
+    for (std::map<std::uint32_t, std::uint64_t>::const_iterator it = counts.begin();
+         it != counts.end(); ++it) {
+      if (it->first == node_) continue;
+      std::uint64_t& count = heartbeats_[it->first];
+      if (it->second > count) count = it->second;
+    }
+  }
+  // A peer may remember more of our own count than we do, after a restart
+  // that lost the journal's tail
+  std::map<std::uint32_t, std::uint64_t>::const_iterator own = counts.find(node_);
+  if (own != counts.end()) activity_.raiseRecorded(own->second);
+
+  // Registers are merged as they are read; a frame cut short has still only
+  // raised registers to values a peer really had
+  int day = static_cast<std::int32_t>(in.u32());
+  const std::size_t dailySize = activity_.today(false).size();
+  for (int k = 0; k < 2 && in.ok; k++) {
+    std::uint32_t n = in.u32();
+    for (std::uint32_t j = 0; j < n && in.ok; j++) {
+      std::uint16_t index = in.u16();
+      std::uint8_t value = in.u8();
+      if (in.ok && index < dailySize) activity_.mergeToday(day, k == 1, index, value);
+    }
+  }
+
+  const std::size_t bucketSize = activity_.bucket(0, false).size();
+  std::uint32_t buckets = in.u32();
+  for (std::uint32_t b = 0; b < buckets && in.ok; b++) {
+    std::int64_t second = static_cast<std::int64_t>(in.u64());
+    for (int k = 0; k < 2 && in.ok; k++) {
+      std::uint32_t n = in.u32();
+      for (std::uint32_t j = 0; j < n && in.ok; j++) {
+        std::uint16_t index = in.u16();
+        std::uint8_t value = in.u8();
+        if (in.ok && index < bucketSize) activity_.mergeBucket(second, k == 1, index, value, now);
+      }
+    }
+  }
+  return in.ok && in.p == in.end;
+}
+
+const std::int64_t ClusterState::kMaxSkewMs;
+const std::size_t ClusterSync::kMaxFrame;
+
+ClusterSync::ClusterSync(ClusterState& state)
+    : state_(state), listenFd_(-1), running_(false) {}
+
+ClusterSync::~ClusterSync() {
+  running_ = false;
+  if (sender_.joinable()) sender_.join();
+  loop_.reset();
+  if (listenFd_ >= 0) close(listenFd_);
+  for (std::size_t i = 0; i < peers_.size(); i++) {
+    if (peers_[i]->fd >= 0) close(peers_[i]->fd);
+  }
+}
+
+bool ClusterSync::open(int port, int backlog, const char* address) {
+  listenFd_ = openListener(port, backlog, false, address);
+  return listenFd_ >= 0;
+}
+
+bool ClusterSync::addPeer(const std::string& hostPort) {
+  std::size_t colon = hostPort.rfind(':');
+  if (colon == std::string::npos || colon == 0) {
+    std::cout << "Peer " << hostPort << " is not host:port" << std::endl;
+    return false;
+  }
+  std::string host = hostPort.substr(0, colon);
+  std::string port = hostPort.substr(colon + 1);
+
+  addrinfo hints = {};
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_STREAM;
+  addrinfo* found = nullptr;
+  int rc = getaddrinfo(host.c_str(), port.c_str(), &hints, &found);
+  if (rc != 0 || !found) {
+    std::cout << "Failed to resolve peer " << hostPort << ": " << gai_strerror(rc) << std::endl;
+    return false;
+  }
+  std::unique_ptr<Peer> peer(new Peer());
+  peer->name = hostPort;
+  std::memcpy(&peer->addr, found->ai_addr, sizeof(peer->addr));
+  freeaddrinfo(found);
+  peers_.push_back(std::move(peer));
+  return true;
+}
+
+int ClusterSync::run() {
+  running_ = true;
+  sender_ = std::thread(&ClusterSync::send, this);
+  if (listenFd_ < 0) {
+    // Send-only node: nothing to receive
+    sender_.join();
+    return 0;
+  }
+
+  // Peers hold their connection open and send about once a second
+  LoopLimits limits;
+  limits.maxInput = kMaxFrame + kLengthPrefix;
+  limits.idleSeconds = 60;
+  loop_.reset(new EventLoop(listenFd_, [this](Connection& conn) { return onFrames(conn); },
+                            limits));
+  int rc = loop_->run();
+  running_ = false;
+  sender_.join();
+  return rc;
+}
+
+bool ClusterSync::onFrames(Connection& conn) {
+  const unsigned char* in = reinterpret_cast<const unsigned char*>(conn.in.data());
+  std::size_t size = conn.in.size();
+  std::size_t offset = 0;
+  std::time_t now = std::time(nullptr);
+
+  while (size - offset >= kLengthPrefix) {
+    std::uint32_t length;
+    std::memcpy(&length, in + offset, sizeof(length));
+    length = le32toh(length);
+    if (length > kMaxFrame) return false;
+    if (size - offset - kLengthPrefix < length) break; // Rest of the frame is on its way
+    if (!state_.applyDelta(in + offset + kLengthPrefix, length, now)) {
+      std::cout << "Dropping a sync connection that sent a malformed delta" << std::endl;
+      return false;
+    }
+    offset += kLengthPrefix + length;
+  }
+
+  conn.in.erase(0, offset);
+  return true;
+}
+
+bool ClusterSync::connectPeer(Peer& peer) {
+  int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (fd < 0) return false;
+
+  // Connect without blocking for longer than a round of sends
+  int rc = connect(fd, (struct sockaddr*)&peer.addr, sizeof(peer.addr));
+  if (rc < 0 && errno == EINPROGRESS) {
+    pollfd pfd = {fd, POLLOUT, 0};
+    int error = 0;
+    socklen_t len = sizeof(error);
+    if (poll(&pfd, 1, kConnectTimeoutMs) == 1 &&
+        getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &len) == 0 && error == 0) {
+      rc = 0;
+    }
+  }
+  if (rc < 0) {
+    close(fd);
+    return false;
+  }
+
+  // From here on plain blocking sends, but never stuck on a dead peer
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+  timeval timeout = {kSendTimeoutSeconds, 0};
+  setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+  int enable = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+
+  peer.fd = fd;
+  peer.shadow.reset(); // A new connection may be to a restarted peer
+  std::cout << "Syncing with peer " << peer.name << std::endl;
+  return true;
+}
+
+void ClusterSync::send() {
+  std::string frame;
+  while (running_) {
+    std::time_t now = std::time(nullptr);
+    for (std::size_t i = 0; i < peers_.size(); i++) {
+      Peer& peer = *peers_[i];
+      if (peer.fd < 0 && !connectPeer(peer)) continue;
+
+      frame.clear();
+      state_.encodeDelta(peer.shadow, now, frame);
+      const char* p = frame.data();
+      std::size_t left = frame.size();
+      while (left > 0) {
+        ssize_t n = ::send(peer.fd, p, left, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        p += n;
+        left -= n;
+      }
+      if (left > 0) {
+        // What the shadow says was sent may not have arrived; the next
+        // connection starts over from the full state
+        std::cout << "Lost peer " << peer.name << ". errno: " << errno << std::endl;
+        close(peer.fd);
+        peer.fd = -1;
+      }
+    }
+
+    // Sleep to just past the next second, when the window has moved on
+    std::chrono::system_clock::time_point next =
+        std::chrono::system_clock::from_time_t(now + 1) + std::chrono::milliseconds(50);
+    while (running_ && std::chrono::system_clock::now() < next) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+  }
+}
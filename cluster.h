@@ -0,0 +1,130 @@
+#ifndef SCOREBOARD_CLUSTER_H
+#define SCOREBOARD_CLUSTER_H
+
+#include <netinet/in.h> // For sockaddr_in
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "activity.h"
+#include "dashboard.h"
+#include "event_loop.h"
+
+// A value where the latest write wins. Writes are ordered by their wall
+// clock stamp, then by node id, so every node settles on the same one.
+struct LwwRegister {
+  int value = -1;
+  std::int64_t stamp = 0; // Milliseconds since the epoch
+  std::uint32_t node = 0;
+
+  // Returns true if `other` was the later write
+  bool merge(const LwwRegister& other) {
+    if (other.stamp < stamp || (other.stamp == stamp && other.node <= node)) return false;
+    *this = other;
+    return true;
+  }
+};
+
+// The state several servers share: everything in it merges by taking
+// maxima, so deltas can arrive late, twice or in any order.
+//
+//  - The activity sketches (HyperLogLog registers) of every node.
+//  - A G-counter of the heartbeats each node has recorded.
+//  - Last-writer-wins registers for the status fields pushed to /gp/stats.
+//
+// Every node counts the heartbeats sent to it and the union is what every
+// node shows, so scoreboards can be pointed at any of them.
+class ClusterState {
+ public:
+  static const std::int64_t kMaxSkewMs = 5000;
+
+  ClusterState(std::uint32_t node, ActivityCounters& activity);
+
+  std::uint32_t node() const { return node_; }
+
+  // Takes the status fields of `stats` as written now by this node
+  void setStatus(const DashboardStats& stats, std::int64_t stampMs);
+  // Fills in the status fields of `stats`
+  void status(DashboardStats& stats) const;
+  // "node N", the total heartbeats, and one "heartbeats/N count" line a node
+  std::string describe() const;
+
+  // What has been sent to one peer, so the next delta only carries the
+  // registers that went up since
+  struct PeerShadow {
+    int day = -1;
+    std::vector<std::uint8_t> today[2];
+    std::vector<std::int64_t> seconds;
+    std::vector<std::uint8_t> buckets[2];
+
+    void reset();
+  };
+
+  // Appends a delta frame for `peer` to `out`
+  void encodeDelta(PeerShadow& peer, std::time_t now, std::string& out) const;
+  // Merges one frame (without its length prefix). False if it is malformed.
+  // Status writes stamped more than kMaxSkewMs ahead of `now` are ignored:
+  // they would win over every later /gp/stats. One thread at a time.
+  bool applyDelta(const unsigned char* data, std::size_t size, std::time_t now);
+
+ private:
+  enum { kS1, kS2, kCj, kNightMode, kRegisters };
+
+  std::uint32_t node_;
+  ActivityCounters& activity_;
+  mutable std::mutex mutex_; // Guards the registers and the other nodes' counts
+  LwwRegister status_[kRegisters];
+  std::map<std::uint32_t, std::uint64_t> heartbeats_; // Other nodes' G-counter entries
+};
+
+// Exchanges ClusterState deltas with other servers over TCP.
+//
+// Once a second every peer is sent what went up since the last delta it
+// got; a new connection starts from the full state. Incoming deltas arrive
+// on the sync port. Peers are trusted, so the sync port listens on loopback
+// unless told otherwise and should only be reachable by the other nodes.
+class ClusterSync {
+ public:
+  static const std::size_t kMaxFrame = 4 * 1024 * 1024;
+
+  explicit ClusterSync(ClusterState& state);
+  ~ClusterSync();
+
+  // Opens the sync port on `address` (any if null). Returns false on failure.
+  bool open(int port, int backlog, const char* address);
+  // Adds a peer to send to, as "host:port". Returns false if it can't be
+  // resolved.
+  bool addPeer(const std::string& hostPort);
+  // Runs the receive loop (on the calling thread) and the sender. Returns
+  // -1 if the loop could not be set up.
+  int run();
+
+ private:
+  struct Peer {
+    std::string name;
+    sockaddr_in addr;
+    int fd = -1;
+    ClusterState::PeerShadow shadow;
+  };
+
+  bool onFrames(Connection& conn);
+  void send();
+  bool connectPeer(Peer& peer);
+
+  ClusterState& state_;
+  int listenFd_;
+  std::vector<std::unique_ptr<Peer>> peers_;
+  std::unique_ptr<EventLoop> loop_;
+  std::atomic<bool> running_;
+  std::thread sender_;
+};
+
+#endif // SCOREBOARD_CLUSTER_H
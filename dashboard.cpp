@@ -0,0 +1,46 @@
+#include "dashboard.h"
+
+#include <cstdio> // For snprintf
+#include "dashboard_parser.h"
+#include "dashboard_wire.h"
+
+std::size_t formatDashboard(const DashboardStats& stats, char* buf, std::size_t size) {
+  // Field order matters: the scoreboards assign values by position
+  int n = std::snprintf(buf, size, "|$|%d|%d|%d|%d|%d|%d|%d|%d|", stats.s1, stats.s2, stats.cj,
+                        stats.dacu, stats.dacs, stats.acu, stats.acs, stats.nightMode);
+  if (n < 0) return 0;
+  return static_cast<std::size_t>(n) < size ? n : size - 1;
+}
+
+std::size_t encodeDashboard(const DashboardStats& stats, std::uint8_t* buf) {
+  std::int32_t values[DBW_FIELDS];
+  values[DBW_S1] = stats.s1;
+  values[DBW_S2] = stats.s2;
+  values[DBW_CJ] = stats.cj;
+  values[DBW_DACU] = stats.dacu;
+  values[DBW_DACS] = stats.dacs;
+  values[DBW_ACU] = stats.acu;
+  values[DBW_ACS] = stats.acs;
+  values[DBW_NIGHT] = stats.nightMode;
+  return dbwEncode(values, buf);
+}
+
+bool parseDashboard(const char* data, std::size_t size, DashboardStats& stats) {
+  // Same parser the scoreboards run, so both ends agree on what is valid
+  DashboardParser parser;
+  dbpBegin(&parser);
+  for (std::size_t i = 0; i < size; i++) {
+    if (dbpFeed(&parser, static_cast<std::uint8_t>(data[i])) != DBP_DONE) continue;
+
+    stats.s1 = parser.values[DBW_S1];
+    stats.s2 = parser.values[DBW_S2];
+    stats.cj = parser.values[DBW_CJ];
+    stats.dacu = parser.values[DBW_DACU];
+    stats.dacs = parser.values[DBW_DACS];
+    stats.acu = parser.values[DBW_ACU];
+    stats.acs = parser.values[DBW_ACS];
+    stats.nightMode = parser.values[DBW_NIGHT];
+    return true;
+  }
+  return false;
+}
@@ -0,0 +1,40 @@
+#ifndef SCOREBOARD_DASHBOARD_H
+#define SCOREBOARD_DASHBOARD_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Everything a scoreboard shows. -1 means "no data", which the scoreboards
+// display with blue status lights.
+struct DashboardStats {
+  int s1 = -1;        // Server 1 up (1) or down (0)
+  int s2 = -1;        // Server 2 up (1) or down (0)
+  int cj = -1;        // Failed cron jobs (0 is okay)
+  int dacu = -1;      // Active users since 00:00
+  int dacs = -1;      // Active systems since 00:00
+  int acu = -1;       // Active users in the last 60 seconds
+  int acs = -1;       // Active systems in the last 60 seconds
+  int nightMode = 0;  // 1 dims the scoreboards for the night
+};
+
+inline bool operator==(const DashboardStats& a, const DashboardStats& b) {
+  return a.s1 == b.s1 && a.s2 == b.s2 && a.cj == b.cj && a.dacu == b.dacu && a.dacs == b.dacs &&
+         a.acu == b.acu && a.acs == b.acs && a.nightMode == b.nightMode;
+}
+inline bool operator!=(const DashboardStats& a, const DashboardStats& b) { return !(a == b); }
+
+// Renders stats in the pipe delimited format getPage() in scoreboard.cpp
+// parses, e.g. "|$|1|1|0|51|36|2|2|1|". Returns the length written (not
+// counting the NUL). 128 bytes is always enough.
+std::size_t formatDashboard(const DashboardStats& stats, char* buf, std::size_t size);
+
+// Renders stats as a binary frame (see dashboard_wire.h). `buf` needs room
+// for DBW_MAX_FRAME bytes. Returns the frame length.
+std::size_t encodeDashboard(const DashboardStats& stats, std::uint8_t* buf);
+
+// Reads stats back in either format (e.g. as pushed by the dbd.php script).
+// The data does not need to be NUL terminated. Returns false unless a
+// complete set of fields was found.
+bool parseDashboard(const char* data, std::size_t size, DashboardStats& stats);
+
+#endif // SCOREBOARD_DASHBOARD_H
@@ -0,0 +1,207 @@
+// Streaming parser for dashboard responses.
+//
+// Fed one byte at a time, as the bytes arrive, so neither end has to buffer
+// a whole response. It skips anything that is not stats (HTTP headers, the
+// newline heartbeats of a push stream) and understands both wire formats:
+// the "|$|s1|s2|cj|dacu|dacs|acu|acs|night|" text and dashboard_wire.h
+// binary frames. From the headers it only picks out the server's ETag and
+// whether the reply is a "304 Not Modified". All it keeps is the state below.
+//
+// Plain C so the scoreboards (scoreboard.cpp) and the server share it.
+
+#ifndef SCOREBOARD_DASHBOARD_PARSER_H
+#define SCOREBOARD_DASHBOARD_PARSER_H
+
+#include <stdint.h>
+
+#include "dashboard_wire.h"
+
+// dbpFeed() results
+#define DBP_MORE   0   // Keep feeding
+#define DBP_DONE   1   // `values` holds a complete set of stats
+#define DBP_NOT_MODIFIED 2 // The headers of a 304 ended: the stats we have are current
+#define DBP_ERROR  (-1) // Malformed stats; the parser has gone back to scanning
+
+// Parser states
+#define DBP_SCAN        0 // Looking for "|$|" or DBW_MAGIC
+#define DBP_TEXT_SIGN   1 // Start of a text field
+#define DBP_TEXT_DIGITS 2 // Inside a text field
+#define DBP_BIN_VERSION 3 // Binary frame: version byte next
+#define DBP_BIN_BITMAP  4 // Binary frame: field bitmap next
+#define DBP_BIN_VALUE   5 // Binary frame: inside a varint
+#define DBP_ETAG        6 // Hex digits of a quoted ETag
+
+#define DBP_MAX_DIGITS 9  // Enough for any int32_t we care about
+
+typedef struct
+{
+  uint8_t state;
+  uint8_t match;     // Characters of "|$|" matched so far while scanning
+  uint8_t tagMatch;  // ...of "ETag: \""
+  uint8_t status;    // ...of "HTTP/1.1 304"
+  uint8_t end;       // ...of the "\r\n\r\n" that ends its headers
+  uint8_t notModified;
+  uint8_t field;     // Field being read
+  uint8_t bitmap;    // Fields present in the current binary frame
+  uint8_t digits;    // Digits (text) or bits (binary) read for this field
+  uint8_t negative;
+  uint32_t acc;      // Value being accumulated
+  int32_t values[DBW_FIELDS];
+  uint32_t etag;     // The response's ETag (8 hex digits), 0 if it had none
+} DashboardParser;
+
+static inline void dbpReset(DashboardParser* p)
+{
+  p->state = DBP_SCAN;
+  p->match = 0;
+  p->tagMatch = 0;
+  p->status = 0;
+  p->end = 0;
+  p->notModified = 0;
+}
+
+// Call before feeding each new response, to forget the last one's ETag
+static inline void dbpBegin(DashboardParser* p)
+{
+  dbpReset(p);
+  p->etag = 0;
+}
+
+// Moves `matched` on by `c` through `pattern`, true once all of it has. On a
+// mismatch only a fresh start is kept, which is all these patterns need.
+static inline uint8_t dbpMatch(uint8_t* matched, const char* pattern, uint8_t c)
+{
+  if (c == (uint8_t)pattern[*matched]) (*matched)++;
+  else *matched = (c == (uint8_t)pattern[0]) ? 1 : 0;
+  if (pattern[*matched] != '\0') return 0;
+  *matched = 0;
+  return 1;
+}
+
+// Binary fields that are not in the bitmap are "no data"; skip to the next present one
+static inline int8_t dbpNextBinaryField(DashboardParser* p)
+{
+  while (p->field < DBW_FIELDS && !(p->bitmap & (1 << p->field)))
+  {
+    p->values[p->field++] = DBW_NO_DATA;
+  }
+  if (p->field == DBW_FIELDS)
+  {
+    dbpReset(p);
+    return DBP_DONE;
+  }
+  p->state = DBP_BIN_VALUE;
+  p->acc = 0;
+  p->digits = 0;
+  return DBP_MORE;
+}
+
+static inline int8_t dbpFail(DashboardParser* p)
+{
+  dbpReset(p);
+  return DBP_ERROR;
+}
+
+static inline int8_t dbpFeed(DashboardParser* p, uint8_t c)
+{
+  switch (p->state)
+  {
+    case DBP_SCAN:
+      if (c == DBW_MAGIC)
+      {
+        p->state = DBP_BIN_VERSION;
+        return DBP_MORE;
+      }
+      if (dbpMatch(&p->match, "|$|", c))
+      {
+        p->state = DBP_TEXT_SIGN;
+        p->field = 0;
+        return DBP_MORE;
+      }
+      if (dbpMatch(&p->tagMatch, "ETag: \"", c))
+      {
+        p->state = DBP_ETAG;
+        p->acc = 0;
+        p->digits = 0;
+        return DBP_MORE;
+      }
+      if (!p->notModified)
+      {
+        p->notModified = dbpMatch(&p->status, "HTTP/1.1 304", c);
+      }
+      else if (dbpMatch(&p->end, "\r\n\r\n", c))
+      {
+        // Nothing follows the headers of a 304
+        dbpReset(p);
+        return DBP_NOT_MODIFIED;
+      }
+      return DBP_MORE;
+
+    case DBP_ETAG:
+      if (c == '"')
+      {
+        // Anything but 1 to 8 hex digits is not one of ours; forget it
+        p->etag = (p->digits > 0 && p->digits <= 8) ? p->acc : 0;
+        p->state = DBP_SCAN;
+        return DBP_MORE;
+      }
+      if (c >= '0' && c <= '9') c -= '0';
+      else if (c >= 'a' && c <= 'f') c -= 'a' - 10;
+      else if (c >= 'A' && c <= 'F') c -= 'A' - 10;
+      else
+      {
+        p->state = DBP_SCAN;
+        return DBP_MORE;
+      }
+      p->acc = (p->acc << 4) | c;
+      p->digits++;
+      return DBP_MORE;
+
+    case DBP_TEXT_SIGN:
+      p->acc = 0;
+      p->digits = 0;
+      p->negative = (c == '-');
+      p->state = DBP_TEXT_DIGITS;
+      if (p->negative) return DBP_MORE;
+      // Fall through - this is the first digit
+
+    case DBP_TEXT_DIGITS:
+      if (c >= '0' && c <= '9')
+      {
+        if (++p->digits > DBP_MAX_DIGITS) return dbpFail(p);
+        p->acc = p->acc * 10 + (c - '0');
+        return DBP_MORE;
+      }
+      if (c != '|' || p->digits == 0) return dbpFail(p);
+      p->values[p->field++] = p->negative ? -(int32_t)p->acc : (int32_t)p->acc;
+      if (p->field == DBW_FIELDS)
+      {
+        dbpReset(p);
+        return DBP_DONE;
+      }
+      p->state = DBP_TEXT_SIGN;
+      return DBP_MORE;
+
+    case DBP_BIN_VERSION:
+      if (c != DBW_VERSION) return dbpFail(p);
+      p->state = DBP_BIN_BITMAP;
+      return DBP_MORE;
+
+    case DBP_BIN_BITMAP:
+      p->bitmap = c;
+      p->field = 0;
+      return dbpNextBinaryField(p);
+
+    case DBP_BIN_VALUE:
+      if (p->digits > 28) return dbpFail(p);
+      p->acc |= (uint32_t)(c & 0x7F) << p->digits;
+      p->digits += 7;
+      if (c & 0x80) return DBP_MORE;
+      p->values[p->field++] = (int32_t)((p->acc >> 1) ^ (0 - (p->acc & 1)));
+      return dbpNextBinaryField(p);
+  }
+
+  return dbpFail(p);
+}
+
+#endif // SCOREBOARD_DASHBOARD_PARSER_H
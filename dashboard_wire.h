@@ -0,0 +1,107 @@
+// Compact binary encoding of the dashboard stats.
+//
+// Shared by the server (main.cpp) and the scoreboards (scoreboard.cpp), so it
+// sticks to plain C that builds for the AVR as well as the host.
+//
+// Frame layout:
+//   byte 0      DBW_MAGIC
+//   byte 1      DBW_VERSION
+//   byte 2      field bitmap, bit n set if field n follows
+//   bytes 3..   one zigzag varint per present field, in field order
+//
+// Fields are in the same order as the text format ("|$|s1|s2|cj|dacu|dacs|
+// acu|acs|night|"). A field that is left out means "no data" (-1), so a
+// typical frame is around 11 bytes instead of the 21+ bytes of text.
+// Frames are self-delimiting, so several can be sent back to back.
+
+#ifndef SCOREBOARD_DASHBOARD_WIRE_H
+#define SCOREBOARD_DASHBOARD_WIRE_H
+
+#include <stdint.h>
+
+#define DBW_MAGIC     0xDB
+#define DBW_VERSION   1
+#define DBW_FIELDS    8
+#define DBW_MAX_FRAME (3 + DBW_FIELDS * 5)
+#define DBW_NO_DATA   (-1)
+
+// MIME type a client puts in its Accept header to ask for binary frames
+#define DBW_CONTENT_TYPE "application/x-dashboard"
+
+// Field positions
+#define DBW_S1    0
+#define DBW_S2    1
+#define DBW_CJ    2
+#define DBW_DACU  3
+#define DBW_DACS  4
+#define DBW_ACU   5
+#define DBW_ACS   6
+#define DBW_NIGHT 7
+
+// Writes a frame for `values` (DBW_FIELDS of them) to `out`, which must have
+// room for DBW_MAX_FRAME bytes. Returns the frame length.
+static inline uint8_t dbwEncode(const int32_t* values, uint8_t* out)
+{
+  uint8_t len = 3;
+  uint8_t bitmap = 0;
+
+  out[0] = DBW_MAGIC;
+  out[1] = DBW_VERSION;
+
+  for (uint8_t f = 0; f < DBW_FIELDS; f++)
+  {
+    if (values[f] == DBW_NO_DATA) continue;
+    bitmap |= (uint8_t)(1 << f);
+
+    // Zigzag so small negative numbers stay small, then 7 bits per byte
+    uint32_t v = ((uint32_t)values[f] << 1) ^ (uint32_t)(values[f] >> 31);
+    while (v >= 0x80)
+    {
+      out[len++] = (uint8_t)(v | 0x80);
+      v >>= 7;
+    }
+    out[len++] = (uint8_t)v;
+  }
+
+  out[2] = bitmap;
+  return len;
+}
+
+// Reads one frame from the start of `in`. On success fills `values` and
+// returns the number of bytes used. Returns 0 if `len` bytes are not a whole
+// frame yet, or -1 if this is not a frame we understand.
+static inline int dbwDecode(const uint8_t* in, uint16_t len, int32_t* values)
+{
+  if (len >= 1 && in[0] != DBW_MAGIC) return -1;
+  if (len >= 2 && in[1] != DBW_VERSION) return -1;
+  if (len < 3) return 0;
+
+  uint8_t bitmap = in[2];
+  uint16_t pos = 3;
+
+  for (uint8_t f = 0; f < DBW_FIELDS; f++)
+  {
+    if (!(bitmap & (1 << f)))
+    {
+      values[f] = DBW_NO_DATA;
+      continue;
+    }
+
+    uint32_t v = 0;
+    uint8_t shift = 0;
+    for (;;)
+    {
+      if (pos >= len) return 0;
+      uint8_t b = in[pos++];
+      v |= (uint32_t)(b & 0x7F) << shift;
+      if (!(b & 0x80)) break;
+      shift += 7;
+      if (shift > 28) return -1;
+    }
+    values[f] = (int32_t)((v >> 1) ^ (0 - (v & 1)));
+  }
+
+  return pos;
+}
+
+#endif // SCOREBOARD_DASHBOARD_WIRE_H
@@ -0,0 +1,286 @@
+#include "event_loop.h"
+
+#include <sys/epoll.h>  // For epoll_create1, epoll_ctl, epoll_wait
+#include <sys/socket.h> // For accept4, recv, sendmsg
+#include <netinet/in.h> // For sockaddr_in
+#include <cerrno>       // For errno
+#include <iostream>     // For cout
+#include <unistd.h>     // For close
+
+namespace {
+
+const int kMaxEvents = 256;
+const std::size_t kReadChunk = 4096;
+const int kMaxIov = 64;
+
+} // namespace
+
+EventLoop::EventLoop(int listenFd, Handler handler, LoopLimits limits)
+    : listenFd_(listenFd),
+      epollFd_(-1),
+      handler_(handler),
+      limits_(limits),
+      running_(false),
+      open_(0),
+      metrics_(nullptr) {}
+
+EventLoop::~EventLoop() {
+  for (std::size_t fd = 0; fd < conns_.size(); fd++) {
+    if (conns_[fd]) close(conns_[fd]->fd);
+  }
+  if (epollFd_ >= 0) close(epollFd_);
+}
+
+int EventLoop::run() {
+  epollFd_ = epoll_create1(EPOLL_CLOEXEC);
+  if (epollFd_ < 0) {
+    std::cout << "Failed to create epoll instance. errno: " << errno << std::endl;
+    return -1;
+  }
+
+  epoll_event ev = {};
+  ev.events = EPOLLIN;
+  ev.data.fd = listenFd_;
+  if (epoll_ctl(epollFd_, EPOLL_CTL_ADD, listenFd_, &ev) < 0) {
+    std::cout << "Failed to watch listening socket. errno: " << errno << std::endl;
+    return -1;
+  }
+
+  for (std::size_t i = 0; i < watches_.size(); i++) {
+    ev.events = EPOLLIN;
+    ev.data.fd = watches_[i].fd;
+    if (epoll_ctl(epollFd_, EPOLL_CTL_ADD, watches_[i].fd, &ev) < 0) {
+      std::cout << "Failed to watch fd " << watches_[i].fd << ". errno: " << errno << std::endl;
+      return -1;
+    }
+  }
+
+  running_ = true;
+  std::time_t lastSweep = std::time(nullptr);
+  epoll_event events[kMaxEvents];
+
+  while (running_) {
+    // Wake up at least once a second so idle connections get swept
+    int n = epoll_wait(epollFd_, events, kMaxEvents, 1000);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      std::cout << "epoll_wait failed. errno: " << errno << std::endl;
+      return -1;
+    }
+
+    for (int i = 0; i < n; i++) {
+      int fd = events[i].data.fd;
+      if (fd == listenFd_) {
+        acceptAll();
+        continue;
+      }
+      if (dispatchWatch(fd)) continue;
+      if (fd < 0 || static_cast<std::size_t>(fd) >= conns_.size() || !conns_[fd]) continue;
+
+      Connection& conn = *conns_[fd];
+      if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+        closeConnection(conn);
+        continue;
+      }
+      if (events[i].events & EPOLLIN) onReadable(conn);
+      // onReadable may have closed it
+      if (!conns_[fd]) continue;
+      if (events[i].events & EPOLLOUT) onWritable(conn);
+    }
+
+    std::time_t now = std::time(nullptr);
+    if (now != lastSweep) {
+      lastSweep = now;
+      for (std::size_t i = 0; i < ticks_.size(); i++) ticks_[i](now);
+      sweepIdle(now);
+    }
+  }
+
+  return 0;
+}
+
+void EventLoop::watch(int fd, std::function<void()> callback) {
+  Watch w;
+  w.fd = fd;
+  w.callback = callback;
+  watches_.push_back(w);
+}
+
+bool EventLoop::dispatchWatch(int fd) {
+  for (std::size_t i = 0; i < watches_.size(); i++) {
+    if (watches_[i].fd == fd) {
+      watches_[i].callback();
+      return true;
+    }
+  }
+  return false;
+}
+
+void EventLoop::broadcast(const std::function<void(Connection&)>& fn) {
+  for (std::size_t fd = 0; fd < conns_.size(); fd++) {
+    if (!conns_[fd]) continue;
+    Connection& conn = *conns_[fd];
+    fn(conn);
+    if (conn.readClosed && !conn.readPaused) conn.closeAfterWrite = true;
+    if (!flush(conn)) closeConnection(conn);
+  }
+}
+
+void EventLoop::acceptAll() {
+  // The listener is non-blocking, so drain everything that is queued
+  while (true) {
+    sockaddr_in peer = {};
+    socklen_t peerLen = sizeof(peer);
+    std::uint64_t start = metrics_ ? metricsClock() : 0;
+    int fd = accept4(listenFd_, (struct sockaddr*)&peer, &peerLen, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (metrics_ && fd >= 0) {
+      metrics_->recordSince(kStageAccept, start);
+      metrics_->add(kAccepted, 1);
+    }
+    if (fd < 0) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK) return;
+      if (errno == EINTR || errno == ECONNABORTED) continue;
+      // EMFILE and friends: leave the rest in the backlog until fds free up
+      std::cout << "Failed to grab connection. errno: " << errno << std::endl;
+      return;
+    }
+
+    if (static_cast<std::size_t>(fd) >= conns_.size()) conns_.resize(fd + 1);
+    conns_[fd].reset(new Connection());
+    Connection& conn = *conns_[fd];
+    conn.fd = fd;
+    conn.peerAddr = ntohl(peer.sin_addr.s_addr);
+    conn.lastActive = std::time(nullptr);
+
+    epoll_event ev = {};
+    ev.events = EPOLLIN | EPOLLRDHUP;
+    ev.data.fd = fd;
+    conn.events = ev.events;
+    if (epoll_ctl(epollFd_, EPOLL_CTL_ADD, fd, &ev) < 0) {
+      conns_[fd].reset();
+      close(fd);
+      continue;
+    }
+    open_++;
+  }
+}
+
+void EventLoop::onReadable(Connection& conn) {
+  bool peerClosed = false;
+  std::size_t before = conn.in.size();
+  std::uint64_t start = metrics_ ? metricsClock() : 0;
+  while (true) {
+    std::size_t used = conn.in.size();
+    conn.in.resize(used + kReadChunk);
+    ssize_t got = recv(conn.fd, &conn.in[used], kReadChunk, 0);
+    if (got > 0) {
+      conn.in.resize(used + got);
+      // A fast sender could keep this going forever; let the handler catch up
+      if (static_cast<std::size_t>(got) < kReadChunk || conn.in.size() >= limits_.maxInput) break;
+      continue;
+    }
+    conn.in.resize(used);
+    if (got == 0) {
+      peerClosed = true;
+      break;
+    }
+    if (errno == EINTR) continue;
+    if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+    closeConnection(conn);
+    return;
+  }
+
+  if (metrics_) {
+    metrics_->recordSince(kStageRead, start);
+    metrics_->add(kBytesIn, conn.in.size() - before);
+  }
+  conn.lastActive = std::time(nullptr);
+
+  if (!conn.in.empty() && !handler_(conn)) {
+    closeConnection(conn);
+    return;
+  }
+
+  // A paused handler is holding on to its input on purpose
+  if (conn.in.size() > limits_.maxInput && !conn.readPaused) {
+    closeConnection(conn);
+    return;
+  }
+
+  // Nothing more will arrive; finish sending whatever is queued (and
+  // handling what is buffered, if paused), then close
+  if (peerClosed) {
+    conn.readClosed = true;
+    if (!conn.readPaused) conn.closeAfterWrite = true;
+  }
+
+  if (!flush(conn)) closeConnection(conn);
+}
+
+void EventLoop::onWritable(Connection& conn) {
+  if (!flush(conn)) closeConnection(conn);
+}
+
+// Sends as much of the output queue as the socket will take. Returns false
+// if the connection should be closed.
+bool EventLoop::flush(Connection& conn) {
+  iovec iov[kMaxIov];
+  while (!conn.out.empty()) {
+    // Gathered write, so shared snapshot bytes are never copied
+    msghdr msg = {};
+    msg.msg_iov = iov;
+    msg.msg_iovlen = conn.out.gather(iov, kMaxIov);
+    std::uint64_t start = metrics_ ? metricsClock() : 0;
+    ssize_t sent = sendmsg(conn.fd, &msg, MSG_NOSIGNAL);
+    if (metrics_ && sent > 0) {
+      metrics_->recordSince(kStageSend, start);
+      metrics_->add(kBytesOut, sent);
+    }
+    if (sent < 0) {
+      if (errno == EINTR) continue;
+      if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+      return false;
+    }
+    conn.out.consume(sent);
+    conn.lastActive = std::time(nullptr);
+  }
+
+  if (conn.out.empty()) {
+    if (conn.closeAfterWrite) return false;
+  } else if (conn.out.pending() > limits_.maxOutput) {
+    return false;
+  }
+
+  updateInterest(conn);
+  return true;
+}
+
+void EventLoop::updateInterest(Connection& conn) {
+  unsigned events = 0;
+  if (!conn.readClosed && !conn.readPaused) events |= EPOLLIN | EPOLLRDHUP;
+  if (!conn.out.empty()) events |= EPOLLOUT;
+  if (events == conn.events) return;
+
+  epoll_event ev = {};
+  ev.events = events;
+  ev.data.fd = conn.fd;
+  epoll_ctl(epollFd_, EPOLL_CTL_MOD, conn.fd, &ev);
+  conn.events = events;
+}
+
+void EventLoop::closeConnection(Connection& conn) {
+  int fd = conn.fd;
+  epoll_ctl(epollFd_, EPOLL_CTL_DEL, fd, nullptr);
+  close(fd);
+  conns_[fd].reset();
+  open_--;
+  if (metrics_) metrics_->add(kClosed, 1);
+}
+
+void EventLoop::sweepIdle(std::time_t now) {
+  for (std::size_t fd = 0; fd < conns_.size(); fd++) {
+    if (conns_[fd] && now - conns_[fd]->lastActive > limits_.idleSeconds) {
+      closeConnection(*conns_[fd]);
+    }
+  }
+}
@@ -0,0 +1,109 @@
+#ifndef SCOREBOARD_EVENT_LOOP_H
+#define SCOREBOARD_EVENT_LOOP_H
+
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "http_parser.h"
+#include "metrics.h"
+#include "output_queue.h"
+
+// One accepted client socket. Each connection owns its own input and output
+// buffers so a slow peer (e.g. an ESP8266 on a 9600 baud link) only ever
+// holds up itself, never the rest of the loop.
+struct Connection {
+  int fd = -1;
+  std::string in;               // Bytes received but not yet consumed
+  HttpParser parser;            // Request parsing state for `in`
+  OutputQueue out;              // Bytes queued for sending
+  std::uint32_t peerAddr = 0;   // IPv4 address of the peer, host byte order
+  bool closeAfterWrite = false; // Close once `out` has drained
+  bool readClosed = false;      // Peer has shut down its side
+  bool readPaused = false;      // Handler can't take more yet; stop reading (backpressure)
+  bool parked = false;          // Its request waits on something (see GamesHub); left in `in`
+  unsigned events = 0;          // epoll events currently registered
+  std::time_t lastActive = 0;   // For dropping idle connections
+  bool subscribed = false;      // Receives pushed updates (see PushHub)
+  std::uint64_t pushedVersion = 0; // Last snapshot version pushed to it
+  bool pushBinary = false;      // Subscribed to binary frames rather than text
+};
+
+// Limits applied to every connection
+struct LoopLimits {
+  std::size_t maxInput = 16 * 1024;  // Drop peers that send more than this without a full request
+  std::size_t maxOutput = 256 * 1024; // Drop peers that stop reading their responses
+  int idleSeconds = 30;               // Drop connections that go quiet for this long
+};
+
+// Single-threaded, non-blocking epoll loop serving one listening socket.
+//
+// The handler is called whenever new bytes arrive on a connection. It should
+// consume what it can from `in`, append any reply to `out` and return false
+// if the connection has to be dropped straight away. A handler that can't
+// keep up sets `readPaused`; the socket is then left unread (so TCP pushes
+// back on the sender) until a broadcast() clears it again.
+//
+// UringLoop (uring_loop.h) serves the same interface from io_uring instead.
+class EventLoop {
+ public:
+  typedef std::function<bool(Connection&)> Handler;
+  typedef std::function<void(std::time_t now)> Tick;
+
+  EventLoop(int listenFd, Handler handler, LoopLimits limits = LoopLimits());
+  virtual ~EventLoop();
+
+  // Runs until stop() is called. Returns -1 if the loop could not be set up.
+  virtual int run();
+  void stop() { running_ = false; }
+
+  std::size_t connectionCount() const { return open_; }
+
+  // Calls `callback` on the loop thread whenever `fd` (e.g. an eventfd) is
+  // readable. Must be called before run().
+  void watch(int fd, std::function<void()> callback);
+  // Calls `tick` on the loop thread about once a second
+  void addTick(Tick tick) { ticks_.push_back(tick); }
+  // Runs `fn` over every open connection, sends whatever it queued and
+  // applies any change to `readPaused`
+  void broadcast(const std::function<void(Connection&)>& fn);
+  // Times accepts, reads and sends into `metrics`, which must belong to the
+  // thread that runs the loop. Off (nullptr) by default.
+  void setMetrics(ThreadMetrics* metrics) { metrics_ = metrics; }
+
+ protected:
+  struct Watch {
+    int fd;
+    std::function<void()> callback;
+  };
+
+  // Sends what is queued on `conn` (or starts to). Returns false if the
+  // connection should be closed.
+  virtual bool flush(Connection& conn);
+  virtual void closeConnection(Connection& conn);
+  void sweepIdle(std::time_t now);
+
+  int listenFd_;
+  int epollFd_;
+  Handler handler_;
+  std::vector<Tick> ticks_;
+  std::vector<Watch> watches_;
+  LoopLimits limits_;
+  bool running_;
+  std::size_t open_;
+  ThreadMetrics* metrics_;
+  std::vector<std::unique_ptr<Connection> > conns_; // Indexed by fd
+
+ private:
+  bool dispatchWatch(int fd);
+  void acceptAll();
+  void onReadable(Connection& conn);
+  void onWritable(Connection& conn);
+  void updateInterest(Connection& conn);
+};
+
+#endif // SCOREBOARD_EVENT_LOOP_H
@@ -0,0 +1,160 @@
+// Stand-in for the collegefootballdata /games API, for exercising the client
+// without hitting the real service (or its rate limits). Every answer is
+// generated from the query, so the same request always gets the same games
+// (and the same ETag).
+#include <sys/socket.h> // For SOMAXCONN
+#include <cstdint>
+#include <cstdio> // For snprintf
+#include <cstdlib> // For exit(), atoi() and EXIT_FAILURE
+#include <cstring> // For strcmp
+#include <iostream> // For cout
+#include <string>
+#include <unistd.h> // For close, usleep
+
+#include "event_loop.h"
+#include "http_server.h"
+#include "listener.h"
+
+namespace {
+
+const char* kTeams[] = {"Alabama", "Auburn", "Clemson", "Georgia", "LSU", "Michigan", "Ohio State",
+                        "Oklahoma", "Oregon", "Penn State", "Texas", "USC", "Utah", "Washington",
+                        "Wisconsin", "Notre Dame"};
+const char* kConferences[] = {"SEC", "SEC", "ACC", "SEC", "SEC", "Big Ten", "Big Ten", "Big 12",
+                              "Pac-12", "Big Ten", "Big 12", "Pac-12", "Pac-12", "Pac-12",
+                              "Big Ten", "FBS Independents"};
+const int kTeamCount = sizeof(kTeams) / sizeof(kTeams[0]);
+
+struct UpstreamOptions {
+  int port = 9998;
+  int failEvery = 0; // Answer every Nth request with a 503; 0 never does
+  int delayMs = 0;   // Wait this long before each answer
+  bool log = false;  // Print every request
+};
+
+void usage(const char* argv0) {
+  std::cout << "Usage: " << argv0 << " [--port N] [--fail-every N] [--delay MS] [--log]\n"
+            << "  --port N        Port to serve /games on (default 9998)\n"
+            << "  --fail-every N  Answer every Nth request with a 503, to exercise\n"
+            << "                  the client's retries (default never)\n"
+            << "  --delay MS      Take this long over every answer, like a slow API.\n"
+            << "                  Requests are answered one at a time (default 0)\n"
+            << "  --log           Print each request and the status it got" << std::endl;
+}
+
+bool parseOptions(int argc, char** argv, UpstreamOptions& opts) {
+  for (int i = 1; i < argc; i++) {
+    if (std::strcmp(argv[i], "--log") == 0) {
+      opts.log = true;
+    } else if (i + 1 < argc && std::strcmp(argv[i], "--port") == 0) {
+      opts.port = std::atoi(argv[++i]);
+    } else if (i + 1 < argc && std::strcmp(argv[i], "--fail-every") == 0) {
+      opts.failEvery = std::atoi(argv[++i]);
+    } else if (i + 1 < argc && std::strcmp(argv[i], "--delay") == 0) {
+      opts.delayMs = std::atoi(argv[++i]);
+    } else {
+      return false;
+    }
+  }
+  return opts.port > 0 && opts.port < 65536 && opts.failEvery >= 0 && opts.delayMs >= 0;
+}
+
+int toInt(const StrView& v, int fallback) {
+  if (v.empty()) return fallback;
+  return std::atoi(std::string(v.data, v.size).c_str());
+}
+
+// A week of games shaped like the real feed, including a nested field the
+// client has to skip over
+void renderGames(std::string& out, int year, bool postseason, int week) {
+  int games = postseason ? 4 : kTeamCount / 2;
+  out = "[";
+  for (int g = 0; g < games; g++) {
+    int home = (g * 2 + week + year) % kTeamCount;
+    int away = (home + 1 + 2 * week) % kTeamCount;
+    if (away == home) away = (away + 1) % kTeamCount;
+    unsigned seed = year * 7919u + week * 131u + g * 17u + (postseason ? 3u : 0u);
+    long id = (year * 100L + (postseason ? 99 : week)) * 100 + g;
+
+    if (g > 0) out += ',';
+    out += "{\"id\":" + std::to_string(id);
+    out += ",\"season\":" + std::to_string(year);
+    out += ",\"week\":" + std::to_string(week);
+    out += postseason ? ",\"seasonType\":\"postseason\"" : ",\"seasonType\":\"regular\"";
+    out += ",\"homeTeam\":\"" + std::string(kTeams[home]) + "\"";
+    out += ",\"homeConference\":\"" + std::string(kConferences[home]) + "\"";
+    out += ",\"homePoints\":" + std::to_string(seed % 45);
+    out += ",\"homeLineScores\":[" + std::to_string(seed % 14) + ",7,0,3]";
+    out += ",\"awayTeam\":\"" + std::string(kTeams[away]) + "\"";
+    out += ",\"awayConference\":\"" + std::string(kConferences[away]) + "\"";
+    out += ",\"awayPoints\":" + std::to_string((seed / 45) % 42);
+    out += ",\"venueId\":" + std::to_string(3000 + home);
+    out += ",\"venue\":\"" + std::string(kTeams[home]) + " Stadium\"}";
+  }
+  out += "]";
+}
+
+// Appends a reply carrying an ETag and Last-Modified, or a bodiless 304 if
+// the client's copy is still current. Returns the status.
+int appendGames(OutputQueue& out, const HttpRequest& req, const std::string& body) {
+  std::uint64_t hash = 14695981039346656037ull;
+  for (std::size_t i = 0; i < body.size(); i++) {
+    hash = (hash ^ static_cast<unsigned char>(body[i])) * 1099511628211ull;
+  }
+  char etag[24];
+  int n = std::snprintf(etag, sizeof(etag), "\"%016llx\"", static_cast<unsigned long long>(hash));
+  bool notModified = req.header("If-None-Match") == StrView(etag, n);
+
+  std::string head = notModified ? "HTTP/1.1 304 Not Modified\r\n" : "HTTP/1.1 200 OK\r\n";
+  head += "ETag: " + std::string(etag, n) + "\r\n";
+  head += "Last-Modified: Sat, 01 Feb 2020 00:00:00 GMT\r\n";
+  if (!notModified) {
+    head += "Content-Type: application/json\r\n";
+    head += "Content-Length: " + std::to_string(body.size()) + "\r\n";
+  }
+  head += req.keepAlive ? "Connection: keep-alive\r\n\r\n" : "Connection: close\r\n\r\n";
+  out.append(head.data(), head.size());
+  if (!notModified && req.method != "HEAD") out.append(body.data(), body.size());
+  return notModified ? 304 : 200;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  UpstreamOptions opts;
+  if (!parseOptions(argc, argv, opts)) {
+    usage(argv[0]);
+    exit(EXIT_FAILURE);
+  }
+
+  int sockfd = openListener(opts.port, SOMAXCONN, false);
+  if (sockfd < 0) exit(EXIT_FAILURE);
+
+  Router router;
+  EventLoop loop(sockfd, [&router](Connection& conn) { return serveHttp(router, conn); });
+
+  int requests = 0;
+  std::string body;
+  router.add("GET", "/games", [&](const HttpRequest& req, Connection& conn) {
+    if (opts.delayMs > 0) usleep(opts.delayMs * 1000);
+    int status = 503;
+    if (opts.failEvery > 0 && ++requests % opts.failEvery == 0) {
+      appendResponse(conn.out, 503, "text/plain", "Service Unavailable", req.keepAlive);
+    } else {
+      bool postseason = req.param("seasonType") == "postseason";
+      int year = toInt(req.param("year"), 2018);
+      int week = toInt(req.param("week"), 1);
+      renderGames(body, year, postseason, week);
+      status = appendGames(conn.out, req, body);
+    }
+    if (opts.log) {
+      std::cout << "GET /games?" << std::string(req.query.data, req.query.size) << " " << status
+                << std::endl;
+    }
+  });
+
+  std::cout << "Serving /games on port " << opts.port << std::endl;
+  int rc = loop.run();
+  close(sockfd);
+  return rc < 0 ? EXIT_FAILURE : 0;
+}
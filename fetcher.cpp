@@ -0,0 +1,244 @@
+#include "fetcher.h"
+
+#include <curl/curl.h>
+
+#include <strings.h> // For strncasecmp
+
+#include <atomic>
+#include <cstring>
+#include <chrono>
+#include <mutex>
+#include <random>
+#include <thread>
+
+struct Fetcher::Shared {
+  CURLSH* share;
+  std::mutex locks[CURL_LOCK_DATA_LAST];
+};
+
+namespace {
+
+void lockShare(CURL*, curl_lock_data data, curl_lock_access, void* userptr) {
+  static_cast<std::mutex*>(userptr)[data].lock();
+}
+
+void unlockShare(CURL*, curl_lock_data data, void* userptr) {
+  static_cast<std::mutex*>(userptr)[data].unlock();
+}
+
+struct Attempt {
+  CURL* curl;
+  FetchSink* sink;
+  ResponseCache::Writer* writer; // Copies the body into the cache, if there is one
+  CacheValidators seen;          // Validators on the final response
+  bool checkedStatus; // Looked at the status line yet?
+  bool wanted;        // Is this a body worth handing to the sink?
+  bool aborted;       // The sink asked to stop
+};
+
+// Value of `line` if it is the header `name`, without the line ending
+bool headerValue(const char* line, std::size_t size, const char* name, std::string& value) {
+  std::size_t n = std::strlen(name);
+  if (size <= n || line[n] != ':' || strncasecmp(line, name, n) != 0) return false;
+  std::size_t begin = n + 1;
+  while (begin < size && line[begin] == ' ') begin++;
+  std::size_t end = size;
+  while (end > begin && (line[end - 1] == '\r' || line[end - 1] == '\n' || line[end - 1] == ' ')) end--;
+  value.assign(line + begin, end - begin);
+  return true;
+}
+
+size_t onHeader(char* line, size_t size, size_t count, void* userdata) {
+  Attempt* attempt = static_cast<Attempt*>(userdata);
+  size_t bytes = size * count;
+  // A new status line means a redirect was followed; only the last response counts
+  if (bytes > 5 && std::strncmp(line, "HTTP/", 5) == 0) attempt->seen = CacheValidators();
+  if (!headerValue(line, bytes, "ETag", attempt->seen.etag)) {
+    headerValue(line, bytes, "Last-Modified", attempt->seen.lastModified);
+  }
+  return bytes;
+}
+
+size_t onWrite(char* data, size_t size, size_t count, void* userdata) {
+  Attempt* attempt = static_cast<Attempt*>(userdata);
+  size_t bytes = size * count;
+
+  // Error pages are not what the sink is expecting, so they are dropped
+  if (!attempt->checkedStatus) {
+    long status = 0;
+    curl_easy_getinfo(attempt->curl, CURLINFO_RESPONSE_CODE, &status);
+    attempt->wanted = status >= 200 && status < 300;
+    attempt->checkedStatus = true;
+  }
+  if (!attempt->wanted) return bytes;
+
+  if (attempt->writer) attempt->writer->write(data, bytes);
+  if (!attempt->sink->data(data, bytes)) {
+    attempt->aborted = true;
+    return 0;
+  }
+  return bytes;
+}
+
+bool retryable(long status) { return status == 429 || status >= 500; }
+
+// Asks for the body only if it changed since the cached copy
+curl_slist* conditionalHeaders(const CacheValidators& validators) {
+  curl_slist* headers = nullptr;
+  if (!validators.etag.empty()) {
+    headers = curl_slist_append(headers, ("If-None-Match: " + validators.etag).c_str());
+  }
+  if (!validators.lastModified.empty()) {
+    headers = curl_slist_append(headers, ("If-Modified-Since: " + validators.lastModified).c_str());
+  }
+  return headers;
+}
+
+// Replays the cached body for a 304 into the sink. False if there was no
+// usable copy after all.
+bool replayCached(const ResponseCache& cache, const std::string& url, FetchSink& sink) {
+  MappedBody body;
+  if (!cache.mapBody(url, body)) return false;
+  return sink.data(body.data(), body.size()) && sink.end(200);
+}
+
+} // namespace
+
+Fetcher::Fetcher(const FetcherOptions& options) : options_(options), shared_(new Shared()) {
+  curl_global_init(CURL_GLOBAL_DEFAULT);
+
+  // Workers share DNS answers and TLS sessions, so even a worker's first
+  // request to a host skips most of the handshake
+  shared_->share = curl_share_init();
+  curl_share_setopt(shared_->share, CURLSHOPT_LOCKFUNC, lockShare);
+  curl_share_setopt(shared_->share, CURLSHOPT_UNLOCKFUNC, unlockShare);
+  curl_share_setopt(shared_->share, CURLSHOPT_USERDATA, shared_->locks);
+  curl_share_setopt(shared_->share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+  curl_share_setopt(shared_->share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+}
+
+Fetcher::~Fetcher() {
+  curl_share_cleanup(shared_->share);
+  curl_global_cleanup();
+}
+
+std::vector<FetchResult> Fetcher::fetchAll(const std::vector<std::string>& urls,
+                                           const SinkFactory& sinkFor) {
+  std::vector<FetchResult> results(urls.size());
+  std::atomic<std::size_t> next(0);
+
+  auto worker = [&](unsigned seed) {
+    std::minstd_rand jitter(seed);
+
+    // One handle per worker for its whole run: curl keeps the connection
+    // open between requests to the same host
+    CURL* curl = curl_easy_init();
+    curl_easy_setopt(curl, CURLOPT_SHARE, shared_->share);
+    curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+    curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+    curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+    curl_easy_setopt(curl, CURLOPT_ACCEPT_ENCODING, "");
+    curl_easy_setopt(curl, CURLOPT_TIMEOUT, options_.timeoutSeconds);
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, onWrite);
+    curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, onHeader);
+    ResponseCache* cache = options_.cache;
+    ResponseCache::Writer writer;
+
+    for (std::size_t i = next++; i < urls.size(); i = next++) {
+      FetchResult& result = results[i];
+      result.url = urls[i];
+      std::unique_ptr<FetchSink> sink = sinkFor(urls[i]);
+      curl_easy_setopt(curl, CURLOPT_URL, urls[i].c_str());
+
+      while (result.attempts < options_.maxAttempts) {
+        if (result.attempts > 0) {
+          // Exponential backoff, +-50% so retries from every worker don't line up
+          long delay = static_cast<long>(options_.backoffMs) << (result.attempts - 1);
+          delay = delay / 2 + static_cast<long>(jitter() % (delay + 1));
+          std::this_thread::sleep_for(std::chrono::milliseconds(delay));
+        }
+        result.attempts++;
+
+        CacheValidators validators;
+        if (cache) {
+          validators = cache->validators(urls[i]);
+          writer.begin(*cache, urls[i]);
+        }
+        curl_slist* headers = conditionalHeaders(validators);
+        curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+
+        Attempt attempt = {curl, sink.get(), cache ? &writer : nullptr, CacheValidators(),
+                           false, false, false};
+        curl_easy_setopt(curl, CURLOPT_WRITEDATA, &attempt);
+        curl_easy_setopt(curl, CURLOPT_HEADERDATA, &attempt);
+        sink->begin();
+
+        CURLcode rc = curl_easy_perform(curl);
+        curl_easy_setopt(curl, CURLOPT_HTTPHEADER, nullptr);
+        curl_slist_free_all(headers);
+        result.status = -1;
+        if (rc != CURLE_OK) {
+          writer.abort();
+          result.error = attempt.aborted ? "aborted by sink" : curl_easy_strerror(rc);
+          if (attempt.aborted) break;
+          continue;
+        }
+
+        curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &result.status);
+        if (result.status == 304 && !validators.empty()) {
+          writer.abort();
+          if (replayCached(*cache, urls[i], *sink)) {
+            result.ok = true;
+            result.fromCache = true;
+            result.error.clear();
+            break;
+          }
+          // The cached copy is gone or bad; the next attempt asks for it all
+          cache->remove(urls[i]);
+          result.error = "unusable cached body";
+          continue;
+        }
+        if (retryable(result.status)) {
+          writer.abort();
+          result.error = "HTTP " + std::to_string(result.status);
+          continue;
+        }
+        if (result.status < 200 || result.status >= 300) {
+          writer.abort();
+          result.error = "HTTP " + std::to_string(result.status);
+          sink->end(result.status);
+          break;
+        }
+        if (sink->end(result.status)) {
+          if (cache) {
+            // Without validators there is nothing to revalidate with next time
+            if (attempt.seen.empty()) {
+              writer.abort();
+              cache->remove(urls[i]);
+            } else {
+              writer.commit(attempt.seen);
+            }
+          }
+          result.ok = true;
+          result.error.clear();
+          break;
+        }
+        writer.abort();
+        result.error = "unusable body";
+      }
+    }
+
+    curl_easy_cleanup(curl);
+  };
+
+  int threads = options_.parallelism;
+  if (threads < 1) threads = 1;
+  if (static_cast<std::size_t>(threads) > urls.size()) threads = static_cast<int>(urls.size());
+
+  std::vector<std::thread> workers;
+  for (int t = 1; t < threads; t++) workers.push_back(std::thread(worker, t));
+  if (threads > 0) worker(0);
+  for (std::size_t t = 0; t < workers.size(); t++) workers[t].join();
+
+  return results;
+}
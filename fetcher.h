@@ -0,0 +1,70 @@
+#ifndef SCOREBOARD_FETCHER_H
+#define SCOREBOARD_FETCHER_H
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "response_cache.h"
+
+// Where one request's body goes. A request may be attempted several times,
+// so begin() must throw away anything an earlier attempt delivered.
+class FetchSink {
+ public:
+  virtual ~FetchSink() {}
+  virtual void begin() {}
+  // Return false to abort the attempt (it is not retried)
+  virtual bool data(const char* data, std::size_t size) = 0;
+  // Called once the body is complete. Return false if it was unusable
+  // (e.g. truncated JSON) to have the request retried.
+  virtual bool end(long status) = 0;
+};
+
+struct FetchResult {
+  std::string url;
+  long status = -1;   // Last HTTP status, -1 if no response at all
+  int attempts = 0;
+  bool ok = false;
+  bool fromCache = false; // Answered 304 and the sink was fed the cached body
+  std::string error;  // Why the last attempt failed
+};
+
+struct FetcherOptions {
+  int parallelism = 8;        // Requests in flight at once
+  int maxAttempts = 4;        // Including the first
+  int backoffMs = 250;        // First retry delay; doubles (with jitter) after that
+  long timeoutSeconds = 60;   // Per attempt
+  ResponseCache* cache = nullptr; // Revalidate against this instead of refetching
+};
+
+// Runs many GETs concurrently with bounded parallelism.
+//
+// Each worker thread keeps one curl handle for all of its requests, so
+// connections (and TLS sessions) to the same host are reused instead of
+// being set up again for every request. Connection failures, timeouts, 429
+// and 5xx responses are retried with exponential backoff.
+//
+// With a cache, requests carry the validators of the cached copy and a 304
+// feeds the sink the cached body straight from a memory mapping, so an
+// unchanged resource costs one tiny round trip.
+class Fetcher {
+ public:
+  typedef std::function<std::unique_ptr<FetchSink>(const std::string& url)> SinkFactory;
+
+  explicit Fetcher(const FetcherOptions& options = FetcherOptions());
+  ~Fetcher();
+
+  // Fetches every URL, streaming each body into the sink `sinkFor` makes for
+  // it. Returns one result per URL, in the same order.
+  std::vector<FetchResult> fetchAll(const std::vector<std::string>& urls, const SinkFactory& sinkFor);
+
+ private:
+  struct Shared;
+
+  FetcherOptions options_;
+  std::unique_ptr<Shared> shared_;
+};
+
+#endif // SCOREBOARD_FETCHER_H
@@ -0,0 +1,97 @@
+#include "game_feed.h"
+
+#include <cstdlib> // For strtoll
+
+namespace {
+
+struct FieldName {
+  const char* name;
+  int field;
+};
+
+} // namespace
+
+// The feed has used both snake_case and camelCase names over time
+GameFeedHandler::Field GameFeedHandler::fieldFor(const std::string& name) {
+  static const FieldName kNames[] = {
+      {"id", kId},
+      {"season", kSeason},
+      {"week", kWeek},
+      {"season_type", kSeasonType},
+      {"seasonType", kSeasonType},
+      {"home_team", kHomeTeam},
+      {"homeTeam", kHomeTeam},
+      {"home_conference", kHomeConference},
+      {"homeConference", kHomeConference},
+      {"home_points", kHomePoints},
+      {"homePoints", kHomePoints},
+      {"away_team", kAwayTeam},
+      {"awayTeam", kAwayTeam},
+      {"away_conference", kAwayConference},
+      {"awayConference", kAwayConference},
+      {"away_points", kAwayPoints},
+      {"awayPoints", kAwayPoints},
+      {"venue_id", kVenueId},
+      {"venueId", kVenueId},
+      {"venue", kVenue},
+  };
+  for (std::size_t i = 0; i < sizeof(kNames) / sizeof(kNames[0]); i++) {
+    if (name == kNames[i].name) return static_cast<Field>(kNames[i].field);
+  }
+  return kNone;
+}
+
+void GameFeedHandler::startObject() {
+  depth_++;
+  if (inGame()) {
+    game_ = GameRecord();
+    field_ = kNone;
+  }
+}
+
+void GameFeedHandler::endObject() {
+  if (inGame()) {
+    games_++;
+    onGame_(game_);
+  }
+  depth_--;
+}
+
+void GameFeedHandler::startArray() { depth_++; }
+
+void GameFeedHandler::endArray() { depth_--; }
+
+void GameFeedHandler::key(const std::string& name) {
+  if (inGame()) field_ = fieldFor(name);
+}
+
+void GameFeedHandler::string(const std::string& value) {
+  if (!inGame()) return;
+  switch (field_) {
+    case kSeasonType: game_.seasonType = value; break;
+    case kHomeTeam: game_.homeTeam = value; break;
+    case kHomeConference: game_.homeConference = value; break;
+    case kAwayTeam: game_.awayTeam = value; break;
+    case kAwayConference: game_.awayConference = value; break;
+    case kVenue: game_.venue = value; break;
+    default: break;
+  }
+}
+
+void GameFeedHandler::number(const std::string& text) {
+  if (!inGame()) return;
+  long long value = std::strtoll(text.c_str(), nullptr, 10);
+  switch (field_) {
+    case kId: game_.id = value; break;
+    case kSeason: game_.season = static_cast<int>(value); break;
+    case kWeek: game_.week = static_cast<int>(value); break;
+    case kHomePoints: game_.homePoints = static_cast<int>(value); break;
+    case kAwayPoints: game_.awayPoints = static_cast<int>(value); break;
+    case kVenueId: game_.venueId = static_cast<int>(value); break;
+    default: break;
+  }
+}
+
+void GameFeedHandler::null() {
+  // Unplayed games have null points; the record's defaults already say so
+}
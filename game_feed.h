@@ -0,0 +1,76 @@
+#ifndef SCOREBOARD_GAME_FEED_H
+#define SCOREBOARD_GAME_FEED_H
+
+#include <cstdint>
+#include <functional>
+#include <string>
+
+#include "json_sax.h"
+
+// The fields we use from one game in the collegefootballdata /games feed
+struct GameRecord {
+  std::int64_t id = 0;
+  int season = 0;
+  int week = 0;
+  std::string seasonType;     // "regular" or "postseason"
+  std::string homeTeam;
+  std::string homeConference;
+  int homePoints = -1;        // -1 until the game has been played
+  std::string awayTeam;
+  std::string awayConference;
+  int awayPoints = -1;
+  int venueId = -1;
+  std::string venue;
+};
+
+// Pulls GameRecords out of a /games response as it streams past.
+//
+// Only the top level array of game objects is looked at; nested values
+// (line scores, win probabilities, ...) are skipped without being stored.
+// `onGame` is called once per game, with a record that is reused for the
+// next one.
+class GameFeedHandler : public JsonHandler {
+ public:
+  typedef std::function<void(const GameRecord& game)> Callback;
+
+  explicit GameFeedHandler(Callback onGame) : onGame_(onGame), depth_(0), field_(kNone) {}
+
+  std::size_t games() const { return games_; }
+
+  void startObject() override;
+  void endObject() override;
+  void startArray() override;
+  void endArray() override;
+  void key(const std::string& name) override;
+  void string(const std::string& value) override;
+  void number(const std::string& text) override;
+  void null() override;
+
+ private:
+  enum Field {
+    kNone,
+    kId,
+    kSeason,
+    kWeek,
+    kSeasonType,
+    kHomeTeam,
+    kHomeConference,
+    kHomePoints,
+    kAwayTeam,
+    kAwayConference,
+    kAwayPoints,
+    kVenueId,
+    kVenue
+  };
+
+  static Field fieldFor(const std::string& name);
+  bool inGame() const { return depth_ == 2; }
+
+  Callback onGame_;
+  GameRecord game_;
+  int depth_;    // 1 inside the feed array, 2 inside a game object
+  Field field_;  // Field the next value belongs to
+  std::size_t games_ = 0;
+};
+
+#endif // SCOREBOARD_GAME_FEED_H
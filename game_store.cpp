@@ -0,0 +1,166 @@
+#include "game_store.h"
+
+#include <cstring>
+
+namespace {
+
+std::uint64_t hashBytes(const char* s, std::size_t size) {
+  std::uint64_t hash = 14695981039346656037ull; // FNV-1a
+  for (std::size_t i = 0; i < size; i++) {
+    hash = (hash ^ static_cast<unsigned char>(s[i])) * 1099511628211ull;
+  }
+  return hash;
+}
+
+} // namespace
+
+const std::uint16_t StringPool::kNone;
+const std::size_t StringPool::kBlockSize;
+const std::size_t GameStore::kNoRow;
+
+std::size_t StringPool::slotFor(const char* s, std::size_t size) const {
+  std::size_t mask = slots_.size() - 1;
+  std::size_t slot = hashBytes(s, size) & mask;
+  while (slots_[slot] != kNone) {
+    const char* name = names_[slots_[slot]];
+    if (std::strncmp(name, s, size) == 0 && name[size] == '\0') break;
+    slot = (slot + 1) & mask;
+  }
+  return slot;
+}
+
+void StringPool::grow() {
+  std::vector<std::uint16_t> old;
+  old.swap(slots_);
+  slots_.assign(old.empty() ? 256 : old.size() * 2, kNone);
+  for (std::size_t i = 0; i < old.size(); i++) {
+    if (old[i] == kNone) continue;
+    const char* name = names_[old[i]];
+    slots_[slotFor(name, std::strlen(name))] = old[i];
+  }
+}
+
+std::uint16_t StringPool::find(const std::string& s) const {
+  if (slots_.empty()) return kNone;
+  return slots_[slotFor(s.data(), s.size())];
+}
+
+std::uint16_t StringPool::intern(const std::string& s) {
+  // Keep the table at most half full so probes stay short
+  if ((names_.size() + 1) * 2 > slots_.size()) grow();
+  std::size_t slot = slotFor(s.data(), s.size());
+  if (slots_[slot] != kNone) return slots_[slot];
+  if (names_.size() >= kNone) return kNone; // Out of ids
+
+  std::size_t need = s.size() + 1;
+  if (blockUsed_ + need > kBlockSize) {
+    // Oversized strings get a block of their own
+    std::size_t size = need > kBlockSize ? need : kBlockSize;
+    blocks_.push_back(std::unique_ptr<char[]>(new char[size]));
+    blockBytes_ += size;
+    blockUsed_ = 0;
+  }
+  char* copy = blocks_.back().get() + blockUsed_;
+  std::memcpy(copy, s.data(), s.size());
+  copy[s.size()] = '\0';
+  blockUsed_ += need;
+
+  std::uint16_t id = static_cast<std::uint16_t>(names_.size());
+  names_.push_back(copy);
+  slots_[slot] = id;
+  return id;
+}
+
+std::size_t StringPool::bytes() const {
+  return blockBytes_ + names_.capacity() * sizeof(const char*) +
+         slots_.capacity() * sizeof(std::uint16_t);
+}
+
+std::size_t GameStore::add(const GameRecord& game) {
+  // Every name first, so a game that doesn't fit leaves no half-written row
+  std::uint16_t names[kNames] = {names_.intern(game.homeTeam), names_.intern(game.awayTeam),
+                                 names_.intern(game.homeConference),
+                                 names_.intern(game.awayConference), names_.intern(game.venue)};
+  for (int n = 0; n < kNames; n++) {
+    if (names[n] == StringPool::kNone) return kNoRow;
+  }
+
+  std::unordered_map<std::int64_t, std::uint32_t>::const_iterator it = rowForId_.find(game.id);
+  if (it != rowForId_.end()) {
+    set(it->second, game, names);
+    return it->second;
+  }
+
+  std::size_t i = ids_.size();
+  ids_.push_back(game.id);
+  season_.push_back(0);
+  week_.push_back(0);
+  postseason_.push_back(0);
+  homeTeam_.push_back(0);
+  awayTeam_.push_back(0);
+  homeConference_.push_back(0);
+  awayConference_.push_back(0);
+  homePoints_.push_back(0);
+  awayPoints_.push_back(0);
+  venueId_.push_back(0);
+  venue_.push_back(0);
+  set(i, game, names);
+  rowForId_[game.id] = static_cast<std::uint32_t>(i);
+  return i;
+}
+
+void GameStore::set(std::size_t i, const GameRecord& game, const std::uint16_t* names) {
+  season_[i] = static_cast<std::uint16_t>(game.season);
+  week_[i] = static_cast<std::uint8_t>(game.week);
+  postseason_[i] = game.seasonType == "postseason";
+  homeTeam_[i] = names[kHomeTeam];
+  awayTeam_[i] = names[kAwayTeam];
+  homeConference_[i] = names[kHomeConference];
+  awayConference_[i] = names[kAwayConference];
+  homePoints_[i] = static_cast<std::int16_t>(game.homePoints);
+  awayPoints_[i] = static_cast<std::int16_t>(game.awayPoints);
+  venueId_[i] = game.venueId;
+  venue_[i] = names[kVenue];
+}
+
+GameRow GameStore::row(std::size_t i) const {
+  GameRow r;
+  r.id = ids_[i];
+  r.season = season_[i];
+  r.week = week_[i];
+  r.postseason = postseason_[i] != 0;
+  r.homeTeam = homeTeam_[i];
+  r.awayTeam = awayTeam_[i];
+  r.homePoints = homePoints_[i];
+  r.awayPoints = awayPoints_[i];
+  return r;
+}
+
+void GameStore::gamesForTeam(std::uint16_t team, std::vector<std::uint32_t>& rows) const {
+  rows.clear();
+  if (team == StringPool::kNone) return;
+  const std::uint16_t* home = homeTeam_.data();
+  const std::uint16_t* away = awayTeam_.data();
+  for (std::size_t i = 0, n = ids_.size(); i < n; i++) {
+    if (home[i] == team || away[i] == team) rows.push_back(static_cast<std::uint32_t>(i));
+  }
+}
+
+void GameStore::gamesInWeek(int season, int week, bool postseason,
+                            std::vector<std::uint32_t>& rows) const {
+  rows.clear();
+  const std::uint16_t* seasons = season_.data();
+  const std::uint8_t* weeks = week_.data();
+  const std::uint8_t* post = postseason_.data();
+  for (std::size_t i = 0, n = ids_.size(); i < n; i++) {
+    if (seasons[i] == season && weeks[i] == week && post[i] == postseason) {
+      rows.push_back(static_cast<std::uint32_t>(i));
+    }
+  }
+}
+
+std::size_t GameStore::bytes() const {
+  std::size_t perRow = sizeof(std::int64_t) + sizeof(std::uint16_t) * 6 + sizeof(std::uint8_t) * 2 +
+                       sizeof(std::int16_t) * 2 + sizeof(std::int32_t);
+  return ids_.capacity() * perRow + names_.bytes();
+}
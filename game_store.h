@@ -0,0 +1,109 @@
+#ifndef SCOREBOARD_GAME_STORE_H
+#define SCOREBOARD_GAME_STORE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "game_feed.h"
+
+// Interns strings into a few large blocks and hands out small dense ids.
+// Interned strings never move, so name() pointers stay valid for the life of
+// the pool.
+class StringPool {
+ public:
+  static const std::uint16_t kNone = 0xffff;
+
+  // kNone once all 65535 ids are taken and `s` isn't one of them
+  std::uint16_t intern(const std::string& s);
+  // kNone if `s` was never interned
+  std::uint16_t find(const std::string& s) const;
+
+  const char* name(std::uint16_t id) const { return names_[id]; }
+  std::size_t size() const { return names_.size(); }
+  std::size_t bytes() const;
+
+ private:
+  static const std::size_t kBlockSize = 16 * 1024;
+
+  std::size_t slotFor(const char* s, std::size_t size) const;
+  void grow();
+
+  std::vector<std::unique_ptr<char[]>> blocks_;
+  std::size_t blockBytes_ = 0;         // Of all blocks, oversized ones included
+  std::size_t blockUsed_ = kBlockSize; // Forces a block on the first intern
+  std::vector<const char*> names_;     // Indexed by id, NUL terminated
+  std::vector<std::uint16_t> slots_;   // Open addressing table of ids
+};
+
+// One game as stored, for reading rows back out
+struct GameRow {
+  std::int64_t id;
+  std::uint16_t season;
+  std::uint8_t week;
+  bool postseason;
+  std::uint16_t homeTeam;
+  std::uint16_t awayTeam;
+  std::int16_t homePoints;  // -1 until played
+  std::int16_t awayPoints;
+};
+
+// Every game we know of, stored column by column.
+//
+// Names are interned once in a StringPool and rows only hold 16 bit ids, so
+// a game costs a few dozen bytes instead of a tree of heap strings. Queries
+// scan just the columns they filter on, front to back.
+class GameStore {
+ public:
+  static const std::size_t kNoRow = static_cast<std::size_t>(-1);
+
+  // Adds `game`, or overwrites the row already holding its id (a corrected
+  // score, a refetched week). Returns the row, or kNoRow (and nothing
+  // changed) if its names don't fit in the pool's ids.
+  std::size_t add(const GameRecord& game);
+
+  std::size_t size() const { return ids_.size(); }
+  GameRow row(std::size_t i) const;
+
+  const StringPool& names() const { return names_; }
+  std::uint16_t teamId(const std::string& name) const { return names_.find(name); }
+  std::uint16_t homeConference(std::size_t i) const { return homeConference_[i]; }
+  std::uint16_t awayConference(std::size_t i) const { return awayConference_[i]; }
+  std::int32_t venueId(std::size_t i) const { return venueId_[i]; }
+
+  // Rows `team` played in, home or away
+  void gamesForTeam(std::uint16_t team, std::vector<std::uint32_t>& rows) const;
+  // Rows of one week of one season
+  void gamesInWeek(int season, int week, bool postseason, std::vector<std::uint32_t>& rows) const;
+
+  // Bytes held by the columns and the pool, not counting the id index
+  std::size_t bytes() const;
+
+ private:
+  // The names of a game, in the order set() takes them
+  enum { kHomeTeam, kAwayTeam, kHomeConference, kAwayConference, kVenue, kNames };
+
+  void set(std::size_t i, const GameRecord& game, const std::uint16_t* names);
+
+  StringPool names_; // Teams, conferences and venues share one pool
+
+  std::vector<std::int64_t> ids_;
+  std::vector<std::uint16_t> season_;
+  std::vector<std::uint8_t> week_;
+  std::vector<std::uint8_t> postseason_;
+  std::vector<std::uint16_t> homeTeam_;
+  std::vector<std::uint16_t> awayTeam_;
+  std::vector<std::uint16_t> homeConference_;
+  std::vector<std::uint16_t> awayConference_;
+  std::vector<std::int16_t> homePoints_;
+  std::vector<std::int16_t> awayPoints_;
+  std::vector<std::int32_t> venueId_;
+  std::vector<std::uint16_t> venue_;
+
+  std::unordered_map<std::int64_t, std::uint32_t> rowForId_;
+};
+
+#endif // SCOREBOARD_GAME_STORE_H
@@ -0,0 +1,319 @@
+#include "games_proxy.h"
+
+#include <sys/eventfd.h> // For eventfd
+#include <cerrno>        // For errno
+#include <chrono>
+#include <cstdio>        // For snprintf
+#include <cstdlib>       // For exit() and EXIT_FAILURE
+#include <iostream>      // For cout
+#include <unistd.h>      // For close
+
+#include "game_feed.h"
+#include "json_sax.h"
+
+namespace {
+
+// Parses one query's feed into `games`, starting over on every attempt
+class GamesSink : public FetchSink {
+ public:
+  explicit GamesSink(std::vector<GameRecord>& games)
+      : games_(games), handler_([this](const GameRecord& game) { games_.push_back(game); }) {}
+
+  void begin() override {
+    games_.clear();
+    handler_ = GameFeedHandler([this](const GameRecord& game) { games_.push_back(game); });
+    parser_.reset(new JsonStreamParser(handler_));
+  }
+
+  bool data(const char* data, std::size_t size) override { return parser_->feed(data, size); }
+
+  bool end(long status) override {
+    if (status != 200) return true; // Nothing to retry; the result says why
+    return parser_->finish();
+  }
+
+ private:
+  std::vector<GameRecord>& games_;
+  GameFeedHandler handler_;
+  std::unique_ptr<JsonStreamParser> parser_;
+};
+
+bool allDigits(const StrView& v, std::size_t minSize, std::size_t maxSize) {
+  if (v.size < minSize || v.size > maxSize) return false;
+  for (std::size_t i = 0; i < v.size; i++) {
+    if (v.data[i] < '0' || v.data[i] > '9') return false;
+  }
+  return true;
+}
+
+void appendString(std::string& out, const char* name, const std::string& value) {
+  out += ",\"";
+  out += name;
+  out += "\":\"";
+  for (std::size_t i = 0; i < value.size(); i++) {
+    char c = value[i];
+    if (c == '"' || c == '\\') {
+      out += '\\';
+      out += c;
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      char escaped[8];
+      std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+      out += escaped;
+    } else {
+      out += c;
+    }
+  }
+  out += '"';
+}
+
+// -1 is how GameRecord says "not known (yet)"
+void appendNumber(std::string& out, const char* name, long long value) {
+  out += ",\"";
+  out += name;
+  out += "\":";
+  out += value < 0 ? std::string("null") : std::to_string(value);
+}
+
+// The games as a JSON array of objects, with the feed's camelCase names for
+// the fields GameRecord keeps and nothing else
+void renderGames(std::string& out, const std::vector<GameRecord>& games) {
+  out = "[";
+  for (std::size_t i = 0; i < games.size(); i++) {
+    const GameRecord& g = games[i];
+    if (i > 0) out += ',';
+    out += "{\"id\":" + std::to_string(g.id);
+    appendNumber(out, "season", g.season);
+    appendNumber(out, "week", g.week);
+    appendString(out, "seasonType", g.seasonType);
+    appendString(out, "homeTeam", g.homeTeam);
+    appendString(out, "homeConference", g.homeConference);
+    appendNumber(out, "homePoints", g.homePoints);
+    appendString(out, "awayTeam", g.awayTeam);
+    appendString(out, "awayConference", g.awayConference);
+    appendNumber(out, "awayPoints", g.awayPoints);
+    appendNumber(out, "venueId", g.venueId);
+    appendString(out, "venue", g.venue);
+    out += '}';
+  }
+  out += "]";
+}
+
+FetcherOptions fetcherOptions(const GamesProxyOptions& options) {
+  FetcherOptions fetch;
+  fetch.parallelism = options.parallelism;
+  // Connections wait on a first fetch, so give up well before they go idle
+  fetch.maxAttempts = 2;
+  fetch.timeoutSeconds = 10;
+  fetch.cache = options.cache;
+  return fetch;
+}
+
+} // namespace
+
+GamesProxy::GamesProxy(const GamesProxyOptions& options)
+    : options_(options), fetcher_(fetcherOptions(options)), stopping_(false) {
+  queuedThread_ = std::thread(&GamesProxy::fetchQueued, this);
+  refreshThread_ = std::thread(&GamesProxy::refresh, this);
+}
+
+GamesProxy::~GamesProxy() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  queuedWake_.notify_one();
+  refreshWake_.notify_one();
+  queuedThread_.join();
+  refreshThread_.join();
+}
+
+bool GamesProxy::keyFor(const HttpRequest& req, std::string& key) {
+  StrView year = req.param("year");
+  StrView seasonType = req.param("seasonType");
+  StrView week = req.param("week");
+  if (!allDigits(year, 4, 4)) return false;
+  if (seasonType.empty()) seasonType = "regular";
+  if (seasonType != "regular" && seasonType != "postseason") return false;
+  if (!week.empty() && !allDigits(week, 1, 2)) return false;
+
+  key.assign("year=").append(year.data, year.size);
+  key.append("&seasonType=").append(seasonType.data, seasonType.size);
+  if (!week.empty()) key.append("&week=").append(week.data, week.size);
+  return true;
+}
+
+std::shared_ptr<const GamesReply> GamesProxy::lookup(const std::string& key) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  Entry& entry = entries_[key];
+  entry.asked = true;
+  if (!entry.reply && !entry.pending) {
+    entry.pending = true;
+    queued_.push_back(key);
+    queuedWake_.notify_one();
+  }
+  return entry.reply;
+}
+
+void GamesProxy::addWakeup(int eventFd) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  wakeups_.push_back(eventFd);
+}
+
+void GamesProxy::removeWakeup(int eventFd) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (std::size_t i = 0; i < wakeups_.size(); i++) {
+    if (wakeups_[i] == eventFd) {
+      wakeups_.erase(wakeups_.begin() + i);
+      return;
+    }
+  }
+}
+
+void GamesProxy::fetchQueued() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    queuedWake_.wait(lock, [this]() { return stopping_ || !queued_.empty(); });
+    if (stopping_) return;
+    std::vector<std::string> keys;
+    keys.swap(queued_);
+    fetchPending(lock, keys);
+  }
+}
+
+void GamesProxy::refresh() {
+  typedef std::chrono::steady_clock Clock;
+  const Clock::duration every = std::chrono::seconds(options_.refreshSeconds);
+  Clock::time_point nextRound = Clock::now() + every;
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    refreshWake_.wait_until(lock, nextRound, [this]() { return stopping_; });
+    if (stopping_) return;
+    if (Clock::now() < nextRound) continue;
+    nextRound = Clock::now() + every;
+
+    std::vector<std::string> keys;
+    for (std::map<std::string, Entry>::iterator it = entries_.begin(); it != entries_.end();) {
+      Entry& entry = it->second;
+      // Still on its first fetch, which fetchQueued() has in hand
+      if (entry.pending) {
+        ++it;
+        continue;
+      }
+      if (entry.asked) {
+        entry.asked = false;
+        entry.idleRounds = 0;
+      } else if (++entry.idleRounds > options_.idleRounds) {
+        entries_.erase(it++);
+        continue;
+      }
+      entry.pending = true;
+      keys.push_back(it->first);
+      ++it;
+    }
+    if (!keys.empty()) fetchPending(lock, keys);
+  }
+}
+
+// Fetches `keys`, all marked pending, with `lock` released, then stores the
+// replies and wakes the loops
+void GamesProxy::fetchPending(std::unique_lock<std::mutex>& lock,
+                              const std::vector<std::string>& keys) {
+  lock.unlock();
+  std::vector<std::shared_ptr<const GamesReply> > replies = fetch(keys);
+  lock.lock();
+
+  for (std::size_t i = 0; i < keys.size(); i++) {
+    // Pending entries are never dropped, so they are all still there
+    Entry& entry = entries_[keys[i]];
+    entry.pending = false;
+    // A failed refresh keeps the last good copy
+    if (replies[i]->ok || !entry.reply || !entry.reply->ok) entry.reply = replies[i];
+  }
+  for (std::size_t i = 0; i < wakeups_.size(); i++) eventfd_write(wakeups_[i], 1);
+}
+
+std::vector<std::shared_ptr<const GamesReply> > GamesProxy::fetch(
+    const std::vector<std::string>& keys) {
+  std::vector<std::string> urls;
+  std::map<std::string, std::size_t> index;
+  for (std::size_t i = 0; i < keys.size(); i++) {
+    urls.push_back(options_.upstream + "/games?" + keys[i]);
+    index[urls.back()] = i;
+  }
+
+  std::vector<std::vector<GameRecord> > games(keys.size());
+  std::vector<FetchResult> results = fetcher_.fetchAll(urls, [&](const std::string& url) {
+    return std::unique_ptr<FetchSink>(new GamesSink(games[index.find(url)->second]));
+  });
+
+  std::vector<std::shared_ptr<const GamesReply> > replies;
+  std::string body;
+  for (std::size_t i = 0; i < keys.size(); i++) {
+    std::shared_ptr<GamesReply> reply = std::make_shared<GamesReply>();
+    if (results[i].ok) {
+      renderGames(body, games[i]);
+      reply->ok = true;
+      reply->games = games[i].size();
+      reply->response.render("application/json", StrView(body.data(), body.size()));
+    } else {
+      std::cout << "Failed to fetch " << urls[i] << ": " << results[i].error << std::endl;
+    }
+    replies.push_back(reply);
+  }
+  return replies;
+}
+
+GamesHub::GamesHub(EventLoop& loop, GamesProxy& proxy, const Router& router)
+    : loop_(loop), proxy_(proxy), router_(router) {
+  wakeFd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (wakeFd_ < 0) {
+    std::cout << "Failed to create eventfd. errno: " << errno << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  proxy.addWakeup(wakeFd_);
+  loop.watch(wakeFd_, [this]() { onFetched(); });
+}
+
+GamesHub::~GamesHub() {
+  proxy_.removeWakeup(wakeFd_);
+  close(wakeFd_);
+}
+
+void GamesHub::serve(const HttpRequest& req, Connection& conn) {
+  std::string key;
+  if (!GamesProxy::keyFor(req, key)) {
+    appendResponse(conn.out, 400, "text/plain", "Bad Request", req.keepAlive,
+                   req.method == "HEAD");
+    return;
+  }
+
+  std::shared_ptr<const GamesReply> reply = proxy_.lookup(key);
+  if (!reply) {
+    // Nothing to send yet; stop reading until the fetch lands
+    conn.parked = true;
+    conn.readPaused = true;
+    return;
+  }
+  if (!reply->ok) {
+    appendResponse(conn.out, 502, "text/plain", "Bad Gateway", req.keepAlive,
+                   req.method == "HEAD");
+    return;
+  }
+  StrView response = reply->response.reply(req);
+  conn.out.appendShared(reply, response.data, response.size);
+}
+
+void GamesHub::onFetched() {
+  eventfd_t ignored;
+  eventfd_read(wakeFd_, &ignored);
+
+  // Route every parked request again: the ones whose query landed are
+  // answered, the rest park again without queueing a second fetch
+  loop_.broadcast([this](Connection& conn) {
+    if (!conn.parked) return;
+    conn.parked = false;
+    conn.readPaused = false;
+    serveHttp(router_, conn);
+  });
+}
@@ -0,0 +1,113 @@
+#ifndef SCOREBOARD_GAMES_PROXY_H
+#define SCOREBOARD_GAMES_PROXY_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "event_loop.h"
+#include "fetcher.h"
+#include "http_parser.h"
+#include "http_server.h"
+
+// One query's games as last fetched, rendered once like a snapshot and
+// shared by every connection sending it
+struct GamesReply {
+  bool ok = false;           // False if the fetch failed and there was no earlier copy
+  std::size_t games = 0;
+  CachedResponse response;   // The games as compact JSON, GameRecord's fields only
+};
+
+struct GamesProxyOptions {
+  std::string upstream;      // Base URL of the games API, e.g. http://127.0.0.1:9998
+  int refreshSeconds = 60;   // How often every query still being asked for is refetched
+  int idleRounds = 10;       // Refreshes without a request before a query is dropped
+  int parallelism = 4;       // Upstream requests in flight at once
+  ResponseCache* cache = nullptr; // Revalidate against this instead of refetching
+};
+
+// The server's side of the games API: scoreboards ask it, never the
+// upstream, however many of them there are.
+//
+// Each query (year, season type and week) is fetched from the upstream in
+// the background, parsed with GameFeedHandler and rendered into a reply that
+// every connection shares. One thread refetches every query that is still
+// being asked for each refreshSeconds, so after the first request nobody
+// waits on the upstream, and if a refresh fails the last good copy keeps
+// being served.
+//
+// A query with no copy yet is queued once, however many connections on
+// however many loops ask for it meanwhile (singleflight), and fetched by a
+// second thread straight away, so it never waits behind a refresh round.
+// Every loop's wakeup eventfd is signalled when it lands.
+class GamesProxy {
+ public:
+  explicit GamesProxy(const GamesProxyOptions& options);
+  ~GamesProxy();
+
+  // The canonical key for a /games query, e.g. "year=2018&seasonType=regular&week=3".
+  // False if the query is not one we serve.
+  static bool keyFor(const HttpRequest& req, std::string& key);
+
+  // The latest reply for `key`, or null if there is none yet, in which case
+  // it is fetched (if it isn't already on its way)
+  std::shared_ptr<const GamesReply> lookup(const std::string& key);
+
+  // Registers an eventfd that is signalled after every batch of fetches
+  void addWakeup(int eventFd);
+  void removeWakeup(int eventFd);
+
+ private:
+  struct Entry {
+    std::shared_ptr<const GamesReply> reply;
+    bool asked = false;   // Requested since the last refresh
+    bool pending = false; // Queued or being fetched; nobody else fetches or drops it
+    int idleRounds = 0;
+  };
+
+  void fetchQueued();
+  void refresh();
+  void fetchPending(std::unique_lock<std::mutex>& lock, const std::vector<std::string>& keys);
+  std::vector<std::shared_ptr<const GamesReply> > fetch(const std::vector<std::string>& keys);
+
+  GamesProxyOptions options_;
+  Fetcher fetcher_;
+
+  std::mutex mutex_;
+  std::condition_variable queuedWake_;  // For fetchQueued()
+  std::condition_variable refreshWake_; // For refresh(), only when stopping
+  std::map<std::string, Entry> entries_;
+  std::vector<std::string> queued_; // Keys with no reply and a fetch not yet started
+  std::vector<int> wakeups_;
+  bool stopping_;
+  std::thread queuedThread_;
+  std::thread refreshThread_;
+};
+
+// Per event loop front of the proxy: answers GET /games and parks
+// connections whose query is still being fetched. A parked connection stops
+// being read and keeps its request buffered; once the fetch lands the
+// request is routed again and finds its reply.
+class GamesHub {
+ public:
+  GamesHub(EventLoop& loop, GamesProxy& proxy, const Router& router);
+  ~GamesHub();
+
+  // Route handler for /games
+  void serve(const HttpRequest& req, Connection& conn);
+
+ private:
+  void onFetched();
+
+  EventLoop& loop_;
+  GamesProxy& proxy_;
+  const Router& router_;
+  int wakeFd_;
+};
+
+#endif // SCOREBOARD_GAMES_PROXY_H
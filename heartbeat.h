@@ -0,0 +1,41 @@
+#ifndef SCOREBOARD_HEARTBEAT_H
+#define SCOREBOARD_HEARTBEAT_H
+
+#include <endian.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// One activity report: this user was active on this system just now
+struct Heartbeat {
+  std::uint64_t user;
+  std::uint64_t system;
+};
+
+// Heartbeats on the wire are 16 byte records, both ids little endian.
+//
+// A UDP datagram is just a run of records. On TCP each batch is framed by a
+// 4 byte little endian length (of the records that follow, so a multiple of
+// 16) to keep batches whole across reads.
+const std::size_t kHeartbeatSize = 16;
+const std::size_t kHeartbeatFrameHeader = 4;
+const std::size_t kMaxHeartbeatBatch = 4096; // Records in one frame or datagram
+
+inline void encodeHeartbeat(const Heartbeat& hb, unsigned char* out) {
+  std::uint64_t user = htole64(hb.user);
+  std::uint64_t system = htole64(hb.system);
+  std::memcpy(out, &user, 8);
+  std::memcpy(out + 8, &system, 8);
+}
+
+inline Heartbeat decodeHeartbeat(const unsigned char* in) {
+  Heartbeat hb;
+  std::memcpy(&hb.user, in, 8);
+  std::memcpy(&hb.system, in + 8, 8);
+  hb.user = le64toh(hb.user);
+  hb.system = le64toh(hb.system);
+  return hb;
+}
+
+#endif // SCOREBOARD_HEARTBEAT_H
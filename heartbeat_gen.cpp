@@ -0,0 +1,155 @@
+// Fires heartbeats (heartbeat.h) at the server's ingestion port as fast as
+// it will take them, or at a fixed rate, to load test and demo the counters.
+#include <sys/socket.h> // For socket functions
+#include <netinet/in.h> // For sockaddr_in
+#include <arpa/inet.h>  // For inet_pton
+#include <cerrno>       // For errno
+#include <chrono>
+#include <cstdint>
+#include <cstdlib> // For exit(), atoi(), atoll() and EXIT_FAILURE
+#include <cstring> // For strcmp
+#include <iostream> // For cout
+#include <thread>
+#include <unistd.h> // For close, write
+#include <vector>
+
+#include "heartbeat.h"
+
+namespace {
+
+struct GenOptions {
+  const char* host = "127.0.0.1";
+  int port = 9998;
+  bool udp = false;
+  std::uint64_t count = 10000000;
+  std::size_t batch = 1024;      // Records per frame or datagram
+  std::uint64_t users = 1000000; // Ids are drawn from [0, users)
+  std::uint64_t systems = 1000;
+  std::uint64_t rate = 0;        // Heartbeats a second; 0 is as fast as possible
+};
+
+void usage(const char* argv0) {
+  std::cout << "Usage: " << argv0 << " [--host IP] [--port N] [--udp] [--count N] [--batch N]\n"
+            << "                [--users N] [--systems N] [--rate N]\n"
+            << "  --host IP     Server address (default 127.0.0.1)\n"
+            << "  --port N      Server --ingest-port (default 9998)\n"
+            << "  --udp         Send datagrams instead of a TCP stream\n"
+            << "  --count N     Heartbeats to send (default 10000000)\n"
+            << "  --batch N     Heartbeats per frame/datagram, at most "
+            << kMaxHeartbeatBatch << " (default 1024)\n"
+            << "  --users N     Distinct users to draw from (default 1000000)\n"
+            << "  --systems N   Distinct systems to draw from (default 1000)\n"
+            << "  --rate N      Heartbeats a second, 0 for flat out (default 0)" << std::endl;
+}
+
+bool parseOptions(int argc, char** argv, GenOptions& opts) {
+  for (int i = 1; i < argc; i++) {
+    if (std::strcmp(argv[i], "--udp") == 0) {
+      opts.udp = true;
+    } else if (i + 1 < argc && std::strcmp(argv[i], "--host") == 0) {
+      opts.host = argv[++i];
+    } else if (i + 1 < argc && std::strcmp(argv[i], "--port") == 0) {
+      opts.port = std::atoi(argv[++i]);
+    } else if (i + 1 < argc && std::strcmp(argv[i], "--count") == 0) {
+      opts.count = std::atoll(argv[++i]);
+    } else if (i + 1 < argc && std::strcmp(argv[i], "--batch") == 0) {
+      opts.batch = std::atoi(argv[++i]);
+    } else if (i + 1 < argc && std::strcmp(argv[i], "--users") == 0) {
+      opts.users = std::atoll(argv[++i]);
+    } else if (i + 1 < argc && std::strcmp(argv[i], "--systems") == 0) {
+      opts.systems = std::atoll(argv[++i]);
+    } else if (i + 1 < argc && std::strcmp(argv[i], "--rate") == 0) {
+      opts.rate = std::atoll(argv[++i]);
+    } else {
+      return false;
+    }
+  }
+  return opts.port > 0 && opts.port < 65536 && opts.batch > 0 &&
+         opts.batch <= kMaxHeartbeatBatch && opts.users > 0 && opts.systems > 0;
+}
+
+std::uint64_t nextRandom(std::uint64_t& state) {
+  state ^= state << 13; // xorshift64
+  state ^= state >> 7;
+  state ^= state << 17;
+  return state;
+}
+
+bool sendAll(int fd, const unsigned char* data, std::size_t size) {
+  while (size > 0) {
+    ssize_t sent = write(fd, data, size);
+    if (sent < 0) {
+      if (errno == EINTR) continue;
+      return false;
+    }
+    data += sent;
+    size -= sent;
+  }
+  return true;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  GenOptions opts;
+  if (!parseOptions(argc, argv, opts)) {
+    usage(argv[0]);
+    exit(EXIT_FAILURE);
+  }
+
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(opts.port);
+  if (inet_pton(AF_INET, opts.host, &addr.sin_addr) != 1) {
+    std::cout << "Not an IPv4 address: " << opts.host << std::endl;
+    exit(EXIT_FAILURE);
+  }
+
+  int fd = socket(AF_INET, opts.udp ? SOCK_DGRAM : SOCK_STREAM, 0);
+  if (fd < 0 || connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+    std::cout << "Failed to connect to " << opts.host << ":" << opts.port << ". errno: " << errno
+              << std::endl;
+    exit(EXIT_FAILURE);
+  }
+
+  std::vector<unsigned char> frame(kHeartbeatFrameHeader + opts.batch * kHeartbeatSize);
+  std::uint64_t state = 0x2545f4914f6cdd1dull;
+  std::uint64_t sent = 0;
+  auto start = std::chrono::steady_clock::now();
+
+  while (sent < opts.count) {
+    std::size_t n = opts.count - sent < opts.batch ? opts.count - sent : opts.batch;
+    unsigned char* records = &frame[kHeartbeatFrameHeader];
+    for (std::size_t i = 0; i < n; i++) {
+      Heartbeat hb;
+      hb.user = nextRandom(state) % opts.users;
+      hb.system = nextRandom(state) % opts.systems;
+      encodeHeartbeat(hb, records + i * kHeartbeatSize);
+    }
+
+    bool ok;
+    if (opts.udp) {
+      ok = send(fd, records, n * kHeartbeatSize, 0) >= 0 || errno == ECONNREFUSED;
+    } else {
+      std::uint32_t length = htole32(static_cast<std::uint32_t>(n * kHeartbeatSize));
+      std::memcpy(&frame[0], &length, sizeof(length));
+      ok = sendAll(fd, &frame[0], kHeartbeatFrameHeader + n * kHeartbeatSize);
+    }
+    if (!ok) {
+      std::cout << "Send failed. errno: " << errno << std::endl;
+      exit(EXIT_FAILURE);
+    }
+    sent += n;
+
+    // Hold back to the requested rate
+    if (opts.rate > 0) {
+      auto due = start + std::chrono::microseconds(sent * 1000000 / opts.rate);
+      std::this_thread::sleep_until(due);
+    }
+  }
+
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  std::cout << "Sent " << sent << " heartbeats in " << seconds << " s ("
+            << static_cast<std::uint64_t>(sent / seconds) << "/s)" << std::endl;
+  close(fd);
+}
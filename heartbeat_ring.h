@@ -0,0 +1,69 @@
+#ifndef SCOREBOARD_HEARTBEAT_RING_H
+#define SCOREBOARD_HEARTBEAT_RING_H
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+
+#include "heartbeat.h"
+
+// Fixed size single producer, single consumer queue of heartbeats.
+//
+// Allocated once up front. The producer and consumer each own one index and
+// only read the other's, on separate cache lines, and each keeps a cached
+// copy of the other's index so most calls touch no shared line at all.
+class HeartbeatRing {
+ public:
+  // `capacity` must be a power of two
+  explicit HeartbeatRing(std::size_t capacity)
+      : slots_(new Heartbeat[capacity]), mask_(capacity - 1), head_(0), tail_(0),
+        cachedTail_(0), cachedHead_(0) {}
+
+  std::size_t capacity() const { return mask_ + 1; }
+
+  // Producer: room for `n` more? (Never a false "yes".)
+  bool hasRoom(std::size_t n) {
+    std::size_t head = head_.load(std::memory_order_relaxed);
+    if (head - cachedTail_ + n <= capacity()) return true;
+    cachedTail_ = tail_.load(std::memory_order_acquire);
+    return head - cachedTail_ + n <= capacity();
+  }
+
+  // Producer: adds one heartbeat. Only call after hasRoom() said yes.
+  void push(const Heartbeat& hb) {
+    std::size_t head = head_.load(std::memory_order_relaxed);
+    slots_[head & mask_] = hb;
+    head_.store(head + 1, std::memory_order_release);
+  }
+
+  // Producer: adds a batch and publishes it with a single store
+  void push(const Heartbeat* hbs, std::size_t n) {
+    std::size_t head = head_.load(std::memory_order_relaxed);
+    for (std::size_t i = 0; i < n; i++) slots_[(head + i) & mask_] = hbs[i];
+    head_.store(head + n, std::memory_order_release);
+  }
+
+  // Consumer: takes up to `max` heartbeats. Returns how many.
+  std::size_t pop(Heartbeat* out, std::size_t max) {
+    std::size_t tail = tail_.load(std::memory_order_relaxed);
+    if (cachedHead_ == tail) {
+      cachedHead_ = head_.load(std::memory_order_acquire);
+      if (cachedHead_ == tail) return 0;
+    }
+    std::size_t n = cachedHead_ - tail;
+    if (n > max) n = max;
+    for (std::size_t i = 0; i < n; i++) out[i] = slots_[(tail + i) & mask_];
+    tail_.store(tail + n, std::memory_order_release);
+    return n;
+  }
+
+ private:
+  std::unique_ptr<Heartbeat[]> slots_;
+  const std::size_t mask_;
+  alignas(64) std::atomic<std::size_t> head_; // Next slot to fill; written by the producer
+  alignas(64) std::atomic<std::size_t> tail_; // Next slot to take; written by the consumer
+  alignas(64) std::size_t cachedTail_;        // Producer's copy of tail_
+  alignas(64) std::size_t cachedHead_;        // Consumer's copy of head_
+};
+
+#endif // SCOREBOARD_HEARTBEAT_RING_H
@@ -0,0 +1,85 @@
+#ifndef SCOREBOARD_HISTOGRAM_H
+#define SCOREBOARD_HISTOGRAM_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Counts values (latencies in microseconds, say) in fixed memory, to within
+// 1% of each value, HdrHistogram style: every power of two is split into
+// 128 equal buckets. Values below 256 are exact; anything at or beyond 2^40
+// is counted as the largest value.
+class LogLinearHistogram {
+ public:
+  static const int kSubBits = 7;
+  static const int kMaxBits = 40;
+  static const std::size_t kBuckets = std::size_t(kMaxBits - kSubBits + 1) << kSubBits;
+
+  LogLinearHistogram() : counts_(kBuckets, 0), total_(0), max_(0) {}
+
+  static std::size_t bucketOf(std::uint64_t value) {
+    if (value >= (std::uint64_t(1) << kMaxBits)) value = (std::uint64_t(1) << kMaxBits) - 1;
+    if (value < (std::uint64_t(2) << kSubBits)) return static_cast<std::size_t>(value);
+    int shift = 63 - __builtin_clzll(value) - kSubBits;
+    return (std::size_t(shift + 1) << kSubBits) + static_cast<std::size_t>(value >> shift) -
+           (std::size_t(1) << kSubBits);
+  }
+
+  // Largest value that lands in `bucket`
+  static std::uint64_t highestIn(std::size_t bucket) {
+    if (bucket < (std::size_t(2) << kSubBits)) return bucket;
+    int shift = static_cast<int>(bucket >> kSubBits) - 1;
+    std::uint64_t sub = (bucket & ((std::size_t(1) << kSubBits) - 1)) +
+                        (std::size_t(1) << kSubBits);
+    return ((sub + 1) << shift) - 1;
+  }
+
+  void record(std::uint64_t value) { add(bucketOf(value), 1, value); }
+
+  void add(std::size_t bucket, std::uint64_t n, std::uint64_t max) {
+    counts_[bucket] += n;
+    total_ += n;
+    if (max > max_) max_ = max;
+  }
+
+  void merge(const LogLinearHistogram& other) {
+    for (std::size_t i = 0; i < kBuckets; i++) counts_[i] += other.counts_[i];
+    total_ += other.total_;
+    if (other.max_ > max_) max_ = other.max_;
+  }
+
+  void clear() {
+    counts_.assign(kBuckets, 0);
+    total_ = 0;
+    max_ = 0;
+  }
+
+  std::uint64_t count() const { return total_; }
+  std::uint64_t max() const { return max_; }
+  std::uint64_t countIn(std::size_t bucket) const { return counts_[bucket]; }
+
+  // The value `percentile` percent of values are at or below (to within the
+  // bucket's 1%). 0 if nothing was recorded.
+  std::uint64_t percentile(double percentile) const {
+    if (total_ == 0) return 0;
+    std::uint64_t rank = static_cast<std::uint64_t>(percentile / 100 * total_ + 0.5);
+    if (rank < 1) rank = 1;
+    if (rank > total_) rank = total_;
+    std::uint64_t seen = 0;
+    for (std::size_t i = 0; i < kBuckets; i++) {
+      seen += counts_[i];
+      if (seen >= rank) {
+        std::uint64_t value = highestIn(i);
+        return value < max_ ? value : max_;
+      }
+    }
+    return max_;
+  }
+
+ private:
+  std::vector<std::uint64_t> counts_;
+  std::uint64_t total_;
+  std::uint64_t max_;
+};
+
+#endif // SCOREBOARD_HISTOGRAM_H
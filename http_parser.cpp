@@ -0,0 +1,162 @@
+#include "http_parser.h"
+
+namespace {
+
+inline char lower(char c) { return (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c; }
+
+inline bool isSpace(char c) { return c == ' ' || c == '\t'; }
+
+StrView trim(const char* begin, const char* end) {
+  while (begin < end && isSpace(*begin)) begin++;
+  while (end > begin && isSpace(end[-1])) end--;
+  return StrView(begin, end - begin);
+}
+
+// Finds "\r\n\r\n" in [data + from, data + size). Returns the offset of the
+// first '\r' or size if it is not there.
+std::size_t findHeaderEnd(const char* data, std::size_t from, std::size_t size) {
+  for (std::size_t i = from; i + 3 < size; i++) {
+    const void* cr = std::memchr(data + i, '\r', size - 3 - i);
+    if (!cr) break;
+    i = static_cast<const char*>(cr) - data;
+    if (data[i + 1] == '\n' && data[i + 2] == '\r' && data[i + 3] == '\n') return i;
+  }
+  return size;
+}
+
+bool parseLength(const StrView& value, std::size_t& length) {
+  if (value.empty()) return false;
+  length = 0;
+  for (std::size_t i = 0; i < value.size; i++) {
+    char c = value.data[i];
+    if (c < '0' || c > '9') return false;
+    length = length * 10 + (c - '0');
+    if (length > HttpParser::kMaxBodyBytes) return true; // Caller rejects it
+  }
+  return true;
+}
+
+} // namespace
+
+bool StrView::equalsIgnoreCase(const StrView& other) const {
+  if (size != other.size) return false;
+  for (std::size_t i = 0; i < size; i++) {
+    if (lower(data[i]) != lower(other.data[i])) return false;
+  }
+  return true;
+}
+
+bool StrView::hasToken(const StrView& token) const {
+  const char* p = data;
+  const char* end = data + size;
+  while (p < end) {
+    const char* comma = static_cast<const char*>(std::memchr(p, ',', end - p));
+    const char* stop = comma ? comma : end;
+    if (trim(p, stop).equalsIgnoreCase(token)) return true;
+    p = stop + 1;
+  }
+  return false;
+}
+
+StrView HttpRequest::header(const StrView& name) const {
+  for (std::size_t i = 0; i < headerCount; i++) {
+    if (headers[i].name.equalsIgnoreCase(name)) return headers[i].value;
+  }
+  return StrView();
+}
+
+StrView HttpRequest::param(const StrView& name) const {
+  const char* p = query.data;
+  const char* end = query.data + query.size;
+  while (p < end) {
+    const char* amp = static_cast<const char*>(std::memchr(p, '&', end - p));
+    if (!amp) amp = end;
+    const char* eq = static_cast<const char*>(std::memchr(p, '=', amp - p));
+    if (eq && StrView(p, eq - p) == name) return StrView(eq + 1, amp - eq - 1);
+    p = amp + 1;
+  }
+  return StrView();
+}
+
+HttpParser::Status HttpParser::parse(const char* data, std::size_t size, HttpRequest& req,
+                                     std::size_t& consumed) {
+  // Pick up the search where the last partial read left it
+  std::size_t from = scanned_ > 3 ? scanned_ - 3 : 0;
+  std::size_t headerEnd = findHeaderEnd(data, from, size);
+  if (headerEnd == size) {
+    scanned_ = size;
+    if (size > kMaxHeaderBytes) return fail(431);
+    return kIncomplete;
+  }
+  if (headerEnd > kMaxHeaderBytes) return fail(431);
+
+  const char* p = data;
+  const char* end = data + headerEnd;
+
+  // Request line: METHOD SP target SP HTTP/1.x
+  const char* lineEnd = static_cast<const char*>(std::memchr(p, '\r', end - p));
+  if (!lineEnd) lineEnd = end;
+  const char* sp1 = static_cast<const char*>(std::memchr(p, ' ', lineEnd - p));
+  if (!sp1 || sp1 == p) return fail(400);
+  const char* target = sp1 + 1;
+  const char* sp2 = static_cast<const char*>(std::memchr(target, ' ', lineEnd - target));
+  if (!sp2 || sp2 == target) return fail(400);
+  const char* version = sp2 + 1;
+  if (lineEnd - version != 8 || std::memcmp(version, "HTTP/1.", 7) != 0) return fail(505);
+  if (version[7] != '0' && version[7] != '1') return fail(505);
+
+  req.method = StrView(p, sp1 - p);
+  const char* question = static_cast<const char*>(std::memchr(target, '?', sp2 - target));
+  if (question) {
+    req.path = StrView(target, question - target);
+    req.query = StrView(question + 1, sp2 - question - 1);
+  } else {
+    req.path = StrView(target, sp2 - target);
+    req.query = StrView();
+  }
+  req.minorVersion = version[7] - '0';
+  req.headerCount = 0;
+
+  // Header lines: name ":" OWS value OWS
+  p = lineEnd + 2;
+  while (p < end) {
+    lineEnd = static_cast<const char*>(std::memchr(p, '\r', end - p));
+    if (!lineEnd) lineEnd = end;
+    const char* colon = static_cast<const char*>(std::memchr(p, ':', lineEnd - p));
+    if (!colon || colon == p) return fail(400);
+    if (req.headerCount == HttpRequest::kMaxHeaders) return fail(431);
+    HttpHeader& h = req.headers[req.headerCount++];
+    h.name = StrView(p, colon - p);
+    h.value = trim(colon + 1, lineEnd);
+    p = lineEnd + 2;
+  }
+
+  // Scoreboards only ever send small requests, so chunked bodies are not supported
+  if (!req.header("Transfer-Encoding").empty()) return fail(501);
+
+  std::size_t bodyLength = 0;
+  StrView contentLength = req.header("Content-Length");
+  if (!contentLength.empty()) {
+    if (!parseLength(contentLength, bodyLength)) return fail(400);
+    if (bodyLength > kMaxBodyBytes) return fail(413);
+  }
+
+  std::size_t total = headerEnd + 4 + bodyLength;
+  if (size < total) {
+    // Headers are done, only the body is outstanding
+    scanned_ = headerEnd;
+    return kIncomplete;
+  }
+  req.body = StrView(data + headerEnd + 4, bodyLength);
+
+  StrView connection = req.header("Connection");
+  if (req.minorVersion == 0) {
+    req.keepAlive = connection.hasToken("keep-alive");
+  } else {
+    req.keepAlive = !connection.hasToken("close");
+  }
+
+  consumed = total;
+  scanned_ = 0;
+  return kComplete;
+}
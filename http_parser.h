@@ -0,0 +1,83 @@
+#ifndef SCOREBOARD_HTTP_PARSER_H
+#define SCOREBOARD_HTTP_PARSER_H
+
+#include <cstddef>
+#include <cstring>
+
+// Non-owning view of bytes inside a connection buffer. Only valid until the
+// buffer is next modified.
+struct StrView {
+  const char* data;
+  std::size_t size;
+
+  StrView() : data(""), size(0) {}
+  StrView(const char* d, std::size_t n) : data(d), size(n) {}
+  StrView(const char* s) : data(s), size(std::strlen(s)) {}
+
+  bool empty() const { return size == 0; }
+  bool operator==(const StrView& other) const {
+    return size == other.size && std::memcmp(data, other.data, size) == 0;
+  }
+  bool operator!=(const StrView& other) const { return !(*this == other); }
+  bool equalsIgnoreCase(const StrView& other) const;
+  // True if this is a comma separated list containing `token` (e.g. Connection)
+  bool hasToken(const StrView& token) const;
+};
+
+struct HttpHeader {
+  StrView name;
+  StrView value;
+};
+
+// One parsed request. Every field points into the buffer that was parsed.
+struct HttpRequest {
+  static const std::size_t kMaxHeaders = 32;
+
+  StrView method;
+  StrView path;   // Target up to the '?'
+  StrView query;  // Everything after the '?', if any
+  int minorVersion = 1;
+  HttpHeader headers[kMaxHeaders];
+  std::size_t headerCount = 0;
+  StrView body;
+  bool keepAlive = true;
+
+  // Returns an empty view if the header is not present
+  StrView header(const StrView& name) const;
+  // Value of a query string parameter, as sent (not decoded); empty if absent
+  StrView param(const StrView& name) const;
+};
+
+// Incremental HTTP/1.x request parser.
+//
+// parse() is handed everything buffered for a connection so far. If the
+// request is not complete yet it remembers how far it searched, so a request
+// dribbling in a few bytes at a time is still only scanned once. Pipelined
+// requests are handled by calling parse() again on the bytes after
+// `consumed`. Nothing is allocated or copied.
+class HttpParser {
+ public:
+  enum Status { kIncomplete, kComplete, kError };
+
+  static const std::size_t kMaxHeaderBytes = 8 * 1024;
+  static const std::size_t kMaxBodyBytes = 8 * 1024;
+
+  HttpParser() : scanned_(0), errorStatus_(0) {}
+
+  Status parse(const char* data, std::size_t size, HttpRequest& req, std::size_t& consumed);
+
+  // HTTP status to reply with after parse() returned kError
+  int errorStatus() const { return errorStatus_; }
+
+ private:
+  Status fail(int status) {
+    errorStatus_ = status;
+    scanned_ = 0;
+    return kError;
+  }
+
+  std::size_t scanned_;
+  int errorStatus_;
+};
+
+#endif // SCOREBOARD_HTTP_PARSER_H
@@ -0,0 +1,159 @@
+#include "http_server.h"
+
+#include <cstdio>  // For snprintf
+#include <cstring> // For memcmp
+
+namespace {
+
+const char* reasonPhrase(int status) {
+  switch (status) {
+    case 200: return "OK";
+    case 304: return "Not Modified";
+    case 400: return "Bad Request";
+    case 403: return "Forbidden";
+    case 404: return "Not Found";
+    case 405: return "Method Not Allowed";
+    case 413: return "Payload Too Large";
+    case 431: return "Request Header Fields Too Large";
+    case 501: return "Not Implemented";
+    case 502: return "Bad Gateway";
+    case 503: return "Service Unavailable";
+    case 505: return "HTTP Version Not Supported";
+    default: return "Unknown";
+  }
+}
+
+// Shared by appendResponse() and renderResponse(); Out only needs append()
+template <typename Out>
+void writeResponse(Out& out, int status, const StrView& contentType, const StrView& body,
+                   bool keepAlive, bool headOnly, const StrView& headers) {
+  char head[64];
+  int n = std::snprintf(head, sizeof(head), "HTTP/1.1 %d %s\r\n", status, reasonPhrase(status));
+  out.append(head, n);
+  StrView field;
+  // A 304 has no body, and its headers describe the one the client already has
+  if (status != 304) {
+    field = StrView("Content-Type: ");
+    out.append(field.data, field.size);
+    out.append(contentType.data, contentType.size);
+    n = std::snprintf(head, sizeof(head), "\r\nContent-Length: %zu\r\n", body.size);
+    out.append(head, n);
+  }
+  out.append(headers.data, headers.size);
+  field = keepAlive ? StrView("Connection: keep-alive\r\n\r\n") : StrView("Connection: close\r\n\r\n");
+  out.append(field.data, field.size);
+  if (!headOnly && status != 304) out.append(body.data, body.size);
+}
+
+} // namespace
+
+void Router::add(const char* method, const char* path, Route route) {
+  Entry entry;
+  entry.method = StrView(method);
+  entry.path = StrView(path);
+  entry.route = route;
+  routes_.push_back(entry);
+}
+
+void Router::dispatch(const HttpRequest& req, Connection& conn) const {
+  bool pathKnown = false;
+  for (std::size_t i = 0; i < routes_.size(); i++) {
+    const Entry& entry = routes_[i];
+    if (entry.path != req.path) continue;
+    pathKnown = true;
+    // HEAD is answered by the GET route with the body left off
+    if (entry.method == req.method || (entry.method == "GET" && req.method == "HEAD")) {
+      entry.route(req, conn);
+      return;
+    }
+  }
+
+  int status = pathKnown ? 405 : 404;
+  appendResponse(conn.out, status, "text/plain", reasonPhrase(status), req.keepAlive,
+                 req.method == "HEAD");
+}
+
+void appendResponse(OutputQueue& out, int status, const StrView& contentType,
+                    const StrView& body, bool keepAlive, bool headOnly) {
+  writeResponse(out, status, contentType, body, keepAlive, headOnly, StrView());
+}
+
+void renderResponse(std::string& out, int status, const StrView& contentType,
+                    const StrView& body, bool keepAlive, const StrView& headers) {
+  writeResponse(out, status, contentType, body, keepAlive, false, headers);
+}
+
+void CachedResponse::render(const StrView& contentType, const StrView& body) {
+  // 32 bit FNV-1a: plenty to tell one body from the last
+  std::uint32_t hash = 2166136261u;
+  for (std::size_t i = 0; i < body.size; i++) {
+    hash = (hash ^ static_cast<std::uint8_t>(body.data[i])) * 16777619u;
+  }
+  char tag[32];
+  int n = std::snprintf(tag, sizeof(tag), "\"%08x\"", static_cast<unsigned>(hash));
+  etag.assign(tag, n);
+  n = std::snprintf(tag, sizeof(tag), "ETag: \"%08x\"\r\n", static_cast<unsigned>(hash));
+  StrView header(tag, n);
+
+  renderResponse(keepAliveResponse, 200, contentType, body, true, header);
+  renderResponse(closeResponse, 200, contentType, body, false, header);
+  renderResponse(notModifiedKeepAlive, 304, contentType, StrView(), true, header);
+  renderResponse(notModifiedClose, 304, contentType, StrView(), false, header);
+  keepAliveHeader = keepAliveResponse.size() - body.size;
+  closeHeader = closeResponse.size() - body.size;
+}
+
+bool CachedResponse::matches(const StrView& ifNoneMatch) const {
+  StrView value = ifNoneMatch;
+  while (value.size > 0 && (*value.data == ' ' || *value.data == '\t')) {
+    value.data++;
+    value.size--;
+  }
+  if (value.size == 1 && *value.data == '*') return true;
+  // A list of quoted tags, maybe weak (W/"..."); ours have no commas or quotes
+  // inside, so finding the quoted tag anywhere is enough
+  for (std::size_t i = 0; i + etag.size() <= value.size; i++) {
+    if (std::memcmp(value.data + i, etag.data(), etag.size()) == 0) return true;
+  }
+  return false;
+}
+
+bool serveHttp(const Router& router, Connection& conn, ThreadMetrics* metrics) {
+  std::size_t offset = 0;
+  HttpRequest req;
+
+  // The views in `req` point into `conn.in`, so it is only trimmed once every
+  // buffered request has been answered
+  while (offset < conn.in.size() && !conn.closeAfterWrite) {
+    std::size_t consumed = 0;
+    std::uint64_t start = metrics ? metricsClock() : 0;
+    HttpParser::Status status =
+        conn.parser.parse(conn.in.data() + offset, conn.in.size() - offset, req, consumed);
+    if (status == HttpParser::kIncomplete) break;
+    if (metrics) start = metrics->recordSince(kStageParse, start);
+
+    if (status == HttpParser::kError) {
+      if (metrics) metrics->add(kBadRequests, 1);
+      int code = conn.parser.errorStatus();
+      appendResponse(conn.out, code, "text/plain", reasonPhrase(code), false);
+      conn.closeAfterWrite = true;
+      offset = conn.in.size();
+      break;
+    }
+
+    router.dispatch(req, conn);
+    // A parked request stays buffered and is routed again once what it waits
+    // for is ready; any pipelined behind it wait their turn
+    if (conn.parked) break;
+    if (metrics) {
+      metrics->recordSince(kStageResponse, start);
+      metrics->add(kRequests, 1);
+    }
+    // A subscription keeps the connection open whatever the request asked for
+    if (!req.keepAlive && !conn.subscribed) conn.closeAfterWrite = true;
+    offset += consumed;
+  }
+
+  conn.in.erase(0, offset);
+  return true;
+}
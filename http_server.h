@@ -0,0 +1,86 @@
+#ifndef SCOREBOARD_HTTP_SERVER_H
+#define SCOREBOARD_HTTP_SERVER_H
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "event_loop.h"
+#include "http_parser.h"
+#include "metrics.h"
+
+// Maps request paths to handlers. Routes are registered once at startup and
+// looked up by a linear scan, which beats hashing for the handful we have.
+class Router {
+ public:
+  // Appends the reply for `req` to `conn.out`
+  typedef std::function<void(const HttpRequest& req, Connection& conn)> Route;
+
+  void add(const char* method, const char* path, Route route);
+
+  // Runs the matching route, or replies 404/405 itself
+  void dispatch(const HttpRequest& req, Connection& conn) const;
+
+ private:
+  struct Entry {
+    StrView method;
+    StrView path;
+    Route route;
+  };
+  std::vector<Entry> routes_;
+};
+
+// Appends a complete HTTP/1.1 response to `out`. Only the first call on a
+// connection allocates; later ones reuse the buffer's capacity.
+void appendResponse(OutputQueue& out, int status, const StrView& contentType,
+                    const StrView& body, bool keepAlive, bool headOnly = false);
+
+// Renders the same response into a string, for replies that are built once
+// and then shared between connections. `headers` are extra "Name: value\r\n"
+// lines. A 304 gets no Content-Type, Content-Length or body.
+void renderResponse(std::string& out, int status, const StrView& contentType,
+                    const StrView& body, bool keepAlive, const StrView& headers = StrView());
+
+// A 200 reply rendered once, for sending to any number of connections: with
+// either Connection header, and as the bodyless 304 for a client whose
+// If-None-Match already names it
+struct CachedResponse {
+  std::string keepAliveResponse;   // Reply with "Connection: keep-alive"
+  std::string closeResponse;       // Reply with "Connection: close"
+  std::size_t keepAliveHeader = 0; // Header length, for answering HEAD
+  std::size_t closeHeader = 0;
+
+  // The body's ETag, quoted: a hash of the bytes rather than a version
+  // number, so it survives restarts and every cluster node agrees
+  std::string etag;
+  std::string notModifiedKeepAlive;
+  std::string notModifiedClose;
+
+  void render(const StrView& contentType, const StrView& body);
+
+  // True if an If-None-Match header names this body (or is "*")
+  bool matches(const StrView& ifNoneMatch) const;
+
+  StrView response(bool keepAlive, bool headOnly) const {
+    const std::string& r = keepAlive ? keepAliveResponse : closeResponse;
+    return StrView(r.data(), headOnly ? (keepAlive ? keepAliveHeader : closeHeader) : r.size());
+  }
+
+  StrView notModified(bool keepAlive) const {
+    const std::string& r = keepAlive ? notModifiedKeepAlive : notModifiedClose;
+    return StrView(r.data(), r.size());
+  }
+
+  // What to send `req`: the 304 if it already has this body
+  StrView reply(const HttpRequest& req) const {
+    return matches(req.header("If-None-Match")) ? notModified(req.keepAlive)
+                                                : response(req.keepAlive, req.method == "HEAD");
+  }
+};
+
+// EventLoop handler: parses every complete request buffered on `conn`
+// (including pipelined ones) and dispatches each through `router`. Times
+// parsing and responding into `metrics`, if given.
+bool serveHttp(const Router& router, Connection& conn, ThreadMetrics* metrics = nullptr);
+
+#endif // SCOREBOARD_HTTP_SERVER_H
@@ -0,0 +1,51 @@
+#include "http_stream.h"
+
+#include <curl/curl.h>
+
+namespace {
+
+struct StreamState {
+  const BodyCallback* onData;
+  bool aborted;
+};
+
+size_t onWrite(char* data, size_t size, size_t count, void* userdata) {
+  StreamState* state = static_cast<StreamState*>(userdata);
+  size_t bytes = size * count;
+  if (!(*state->onData)(data, bytes)) {
+    state->aborted = true;
+    return 0; // Makes curl stop with CURLE_WRITE_ERROR
+  }
+  return bytes;
+}
+
+} // namespace
+
+long streamGet(const std::string& url, const BodyCallback& onData, std::string& error) {
+  CURL* curl = curl_easy_init();
+  if (!curl) {
+    error = "curl_easy_init failed";
+    return -1;
+  }
+
+  StreamState state;
+  state.onData = &onData;
+  state.aborted = false;
+
+  curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+  curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+  curl_easy_setopt(curl, CURLOPT_ACCEPT_ENCODING, ""); // Whatever curl can decode
+  curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, onWrite);
+  curl_easy_setopt(curl, CURLOPT_WRITEDATA, &state);
+
+  long status = -1;
+  CURLcode rc = curl_easy_perform(curl);
+  if (rc == CURLE_OK) {
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &status);
+  } else {
+    error = state.aborted ? "aborted by the body handler" : curl_easy_strerror(rc);
+  }
+
+  curl_easy_cleanup(curl);
+  return status;
+}
@@ -0,0 +1,17 @@
+#ifndef SCOREBOARD_HTTP_STREAM_H
+#define SCOREBOARD_HTTP_STREAM_H
+
+#include <cstddef>
+#include <functional>
+#include <string>
+
+// Called with each piece of the response body as it arrives. Return false
+// to abort the transfer.
+typedef std::function<bool(const char* data, std::size_t size)> BodyCallback;
+
+// GETs `url` and streams the body to `onData` instead of collecting it in
+// memory. Returns the HTTP status code, or -1 with `error` set if the
+// transfer itself failed.
+long streamGet(const std::string& url, const BodyCallback& onData, std::string& error);
+
+#endif // SCOREBOARD_HTTP_STREAM_H
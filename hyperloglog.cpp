@@ -0,0 +1,52 @@
+#include "hyperloglog.h"
+
+#include <cmath>
+
+HyperLogLog::HyperLogLog(int precision)
+    : precision_(precision), registers_(new std::atomic<std::uint8_t>[std::size_t(1) << precision]) {
+  clear();
+}
+
+bool HyperLogLog::raise(std::size_t i, std::uint8_t value) {
+  std::atomic<std::uint8_t>& reg = registers_[i];
+  std::uint8_t current = reg.load(std::memory_order_relaxed);
+  // Registers only grow, so most adds see a big enough value and never write
+  while (current < value) {
+    if (reg.compare_exchange_weak(current, value, std::memory_order_relaxed)) return true;
+  }
+  return false;
+}
+
+bool HyperLogLog::add(std::uint64_t hash) {
+  std::size_t index = hash >> (64 - precision_);
+  std::uint64_t rest = hash << precision_;
+  // Position of the first set bit in what is left of the hash
+  int maxRank = this->maxRank();
+  int rank = rest == 0 ? maxRank : __builtin_clzll(rest) + 1;
+  if (rank > maxRank) rank = maxRank;
+  return raise(index, static_cast<std::uint8_t>(rank));
+}
+
+double HyperLogLog::estimate() const {
+  std::size_t m = size();
+  double sum = 0;
+  std::size_t zeros = 0;
+  for (std::size_t i = 0; i < m; i++) {
+    std::uint8_t r = get(i);
+    sum += std::ldexp(1.0, -r);
+    if (r == 0) zeros++;
+  }
+  double alpha = 0.7213 / (1.0 + 1.079 / m);
+  double e = alpha * m * m / sum;
+  // Small counts are far more accurate from the empty registers
+  if (e <= 2.5 * m && zeros > 0) e = m * std::log(static_cast<double>(m) / zeros);
+  return e;
+}
+
+void HyperLogLog::merge(const HyperLogLog& other) {
+  for (std::size_t i = 0, m = size(); i < m; i++) raise(i, other.get(i));
+}
+
+void HyperLogLog::clear() {
+  for (std::size_t i = 0, m = size(); i < m; i++) registers_[i].store(0, std::memory_order_relaxed);
+}
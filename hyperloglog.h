@@ -0,0 +1,49 @@
+#ifndef SCOREBOARD_HYPERLOGLOG_H
+#define SCOREBOARD_HYPERLOGLOG_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+// Spreads ids (user numbers, system numbers) over all 64 bits before they
+// go into a sketch. splitmix64's finalizer.
+inline std::uint64_t mixId(std::uint64_t x) {
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+  return x ^ (x >> 31);
+}
+
+// Counts distinct values in 2^precision bytes, whatever the number of
+// values: the standard error is about 1.04 / sqrt(2^precision).
+//
+// add() only ever raises a register with a compare-and-swap, so any number
+// of threads can add at once without a lock. Sketches of the same precision
+// merge by taking the larger of each register.
+class HyperLogLog {
+ public:
+  explicit HyperLogLog(int precision);
+  HyperLogLog(const HyperLogLog&) = delete;
+  HyperLogLog& operator=(const HyperLogLog&) = delete;
+
+  // Returns true if the sketch changed, i.e. the value may be new
+  bool add(std::uint64_t hash);
+  double estimate() const;
+  void merge(const HyperLogLog& other);
+  // Not atomic with respect to concurrent add()s
+  void clear();
+
+  int precision() const { return precision_; }
+  std::size_t size() const { return std::size_t(1) << precision_; }
+  // The largest value add() ever puts in a register
+  std::uint8_t maxRank() const { return static_cast<std::uint8_t>(64 - precision_ + 1); }
+  std::uint8_t get(std::size_t i) const { return registers_[i].load(std::memory_order_relaxed); }
+  // Raises register `i` to at least `value`. Returns true if it was lower.
+  bool raise(std::size_t i, std::uint8_t value);
+
+ private:
+  int precision_;
+  std::unique_ptr<std::atomic<std::uint8_t>[]> registers_;
+};
+
+#endif // SCOREBOARD_HYPERLOGLOG_H
@@ -0,0 +1,190 @@
+#include "ingest.h"
+
+#include <sys/eventfd.h> // For eventfd
+#include <sys/socket.h>  // For recvmmsg
+#include <cerrno>        // For errno
+#include <chrono>
+#include <cstring>       // For memcpy
+#include <ctime>         // For time
+#include <iostream>      // For cout
+#include <unistd.h>      // For close
+
+#include "listener.h"
+
+namespace {
+
+const int kUdpBatch = 16;                       // Datagrams per recvmmsg
+const std::size_t kDatagramSize = 64 * 1024;    // Largest a UDP datagram can be
+const int kUdpReceiveBuffer = 4 * 1024 * 1024;
+const std::size_t kDrainBatch = 1024;
+
+} // namespace
+
+const std::size_t HeartbeatIngest::kRingCapacity;
+
+HeartbeatIngest::HeartbeatIngest(ActivityCounters& activity, ActivityJournal& journal)
+    : activity_(activity),
+      journal_(journal),
+      ring_(kRingCapacity),
+      listenFd_(-1),
+      udpFd_(-1),
+      roomFd_(-1),
+      udpBuffers_(new unsigned char[kUdpBatch * kDatagramSize]),
+      batch_(new Heartbeat[kMaxHeartbeatBatch]),
+      running_(false),
+      waitingForRoom_(false) {}
+
+HeartbeatIngest::~HeartbeatIngest() {
+  running_ = false;
+  if (drainer_.joinable()) drainer_.join();
+  loop_.reset();
+  if (listenFd_ >= 0) close(listenFd_);
+  if (udpFd_ >= 0) close(udpFd_);
+  if (roomFd_ >= 0) close(roomFd_);
+}
+
+bool HeartbeatIngest::open(int port, int backlog, const char* address) {
+  listenFd_ = openListener(port, backlog, false, address);
+  if (listenFd_ < 0) return false;
+  udpFd_ = openDatagram(port, kUdpReceiveBuffer, address);
+  if (udpFd_ < 0) return false;
+  roomFd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (roomFd_ < 0) {
+    std::cout << "Failed to create eventfd. errno: " << errno << std::endl;
+    return false;
+  }
+  return true;
+}
+
+int HeartbeatIngest::run() {
+  // Senders keep their connection open between batches
+  LoopLimits limits;
+  limits.maxInput = 1024 * 1024;
+  limits.idleSeconds = 300;
+  loop_.reset(new EventLoop(listenFd_, [this](Connection& conn) { return onTcp(conn); }, limits));
+  loop_->watch(udpFd_, [this]() { onUdp(); });
+  loop_->watch(roomFd_, [this]() { onRoom(); });
+
+  running_ = true;
+  drainer_ = std::thread(&HeartbeatIngest::drain, this);
+  int rc = loop_->run();
+  running_ = false;
+  drainer_.join();
+  return rc;
+}
+
+bool HeartbeatIngest::reserve(std::size_t n) {
+  if (ring_.hasRoom(n)) return true;
+  // Ask for a wakeup, then look again: the drainer may have made room
+  // between the first look and the request, and would not know to signal
+  waitingForRoom_.store(true, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (ring_.hasRoom(n)) {
+    waitingForRoom_.store(false, std::memory_order_relaxed);
+    return true;
+  }
+  return false;
+}
+
+bool HeartbeatIngest::onTcp(Connection& conn) {
+  conn.readPaused = false;
+  const unsigned char* in = reinterpret_cast<const unsigned char*>(conn.in.data());
+  std::size_t size = conn.in.size();
+  std::size_t offset = 0;
+
+  while (size - offset >= kHeartbeatFrameHeader) {
+    std::uint32_t length;
+    std::memcpy(&length, in + offset, sizeof(length));
+    length = le32toh(length);
+    if (length % kHeartbeatSize != 0 || length > kMaxHeartbeatBatch * kHeartbeatSize) return false;
+    if (size - offset - kHeartbeatFrameHeader < length) break; // Rest of the frame is on its way
+
+    std::size_t n = length / kHeartbeatSize;
+    if (!reserve(n)) {
+      conn.readPaused = true;
+      stats_.pauses.fetch_add(1, std::memory_order_relaxed);
+      break;
+    }
+    const unsigned char* record = in + offset + kHeartbeatFrameHeader;
+    for (std::size_t i = 0; i < n; i++) batch_[i] = decodeHeartbeat(record + i * kHeartbeatSize);
+    ring_.push(batch_.get(), n);
+    stats_.received.fetch_add(n, std::memory_order_relaxed);
+    offset += kHeartbeatFrameHeader + length;
+  }
+
+  conn.in.erase(0, offset);
+  return true;
+}
+
+void HeartbeatIngest::onUdp() {
+  mmsghdr msgs[kUdpBatch];
+  iovec iov[kUdpBatch];
+  for (int i = 0; i < kUdpBatch; i++) {
+    iov[i].iov_base = udpBuffers_.get() + i * kDatagramSize;
+    iov[i].iov_len = kDatagramSize;
+    std::memset(&msgs[i].msg_hdr, 0, sizeof(msgs[i].msg_hdr));
+    msgs[i].msg_hdr.msg_iov = &iov[i];
+    msgs[i].msg_hdr.msg_iovlen = 1;
+  }
+
+  // One syscall per batch of datagrams, until the socket is empty
+  while (true) {
+    int got = recvmmsg(udpFd_, msgs, kUdpBatch, MSG_DONTWAIT, nullptr);
+    if (got < 0) {
+      if (errno == EINTR) continue;
+      return; // EAGAIN, or an error the next datagram may not have
+    }
+    for (int i = 0; i < got; i++) {
+      const unsigned char* record = static_cast<const unsigned char*>(iov[i].iov_base);
+      std::size_t n = msgs[i].msg_len / kHeartbeatSize; // A torn trailing record is ignored
+      if (n > kMaxHeartbeatBatch) n = kMaxHeartbeatBatch;
+      if (!ring_.hasRoom(n)) {
+        stats_.udpDropped.fetch_add(n, std::memory_order_relaxed);
+        continue;
+      }
+      for (std::size_t j = 0; j < n; j++) batch_[j] = decodeHeartbeat(record + j * kHeartbeatSize);
+      ring_.push(batch_.get(), n);
+      stats_.received.fetch_add(n, std::memory_order_relaxed);
+    }
+    if (got < kUdpBatch) return;
+  }
+}
+
+void HeartbeatIngest::onRoom() {
+  eventfd_t count;
+  eventfd_read(roomFd_, &count);
+  // Give every paused sender another go at what it has buffered
+  loop_->broadcast([this](Connection& conn) {
+    if (!conn.readPaused) return;
+    if (!onTcp(conn)) {
+      conn.in.clear();
+      conn.readPaused = false;
+      conn.closeAfterWrite = true;
+    }
+  });
+}
+
+void HeartbeatIngest::drain() {
+  std::unique_ptr<Heartbeat[]> batch(new Heartbeat[kDrainBatch]);
+  std::unique_ptr<Heartbeat[]> changed(new Heartbeat[kDrainBatch]);
+  while (running_) {
+    std::size_t n = ring_.pop(batch.get(), kDrainBatch);
+    if (n == 0) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      continue;
+    }
+
+    std::time_t now = std::time(nullptr); // One clock read per batch
+    std::size_t changes = 0;
+    for (std::size_t i = 0; i < n; i++) {
+      if (activity_.record(batch[i].user, batch[i].system, now)) changed[changes++] = batch[i];
+    }
+    journal_.append(now, changed.get(), changes, activity_.recorded());
+
+    // Pairs with reserve(): either it sees the room or we see its request
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (waitingForRoom_.load(std::memory_order_relaxed) && waitingForRoom_.exchange(false)) {
+      eventfd_write(roomFd_, 1);
+    }
+  }
+}
@@ -0,0 +1,70 @@
+#ifndef SCOREBOARD_INGEST_H
+#define SCOREBOARD_INGEST_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <thread>
+
+#include "activity.h"
+#include "event_loop.h"
+#include "heartbeat_ring.h"
+#include "journal.h"
+
+struct IngestStats {
+  std::atomic<std::uint64_t> received{0};   // Heartbeats queued for counting
+  std::atomic<std::uint64_t> udpDropped{0}; // Heartbeats dropped because the ring was full
+  std::atomic<std::uint64_t> pauses{0};     // Times a TCP sender had to wait for room
+};
+
+// Receives heartbeats (see heartbeat.h) over UDP and TCP on one port.
+// Anyone who can reach it can inflate the counts, so like POST /gp/heartbeat
+// it is only open to this host unless it is bound to another address.
+//
+// The receive loop only decodes records into a preallocated ring; a drainer
+// thread empties the ring in batches into the activity counters. When the
+// ring is full, TCP connections stop being read until the drainer has made
+// room, so senders are slowed down by TCP flow control instead of losing
+// data. UDP has no way to push back; its overflow is dropped and counted.
+// The drainer also journals whatever changed the counters.
+class HeartbeatIngest {
+ public:
+  static const std::size_t kRingCapacity = 1 << 16;
+
+  HeartbeatIngest(ActivityCounters& activity, ActivityJournal& journal);
+  ~HeartbeatIngest();
+
+  // Opens the TCP and UDP sockets on `address` (any if null). Returns false
+  // on failure.
+  bool open(int port, int backlog, const char* address);
+  // Runs the receive loop (on the calling thread) and the drainer. Returns
+  // -1 if the loop could not be set up.
+  int run();
+
+  const IngestStats& stats() const { return stats_; }
+
+ private:
+  bool onTcp(Connection& conn);
+  void onUdp();
+  void onRoom();
+  void drain();
+  // True if `n` records fit; otherwise asks the drainer for a wakeup
+  bool reserve(std::size_t n);
+
+  ActivityCounters& activity_;
+  ActivityJournal& journal_;
+  HeartbeatRing ring_;
+  int listenFd_;
+  int udpFd_;
+  int roomFd_; // eventfd the drainer signals once there is room again
+  std::unique_ptr<EventLoop> loop_;
+  std::unique_ptr<unsigned char[]> udpBuffers_;
+  std::unique_ptr<Heartbeat[]> batch_;
+  std::atomic<bool> running_;
+  std::atomic<bool> waitingForRoom_;
+  std::thread drainer_;
+  IngestStats stats_;
+};
+
+#endif // SCOREBOARD_INGEST_H
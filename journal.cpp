@@ -0,0 +1,275 @@
+#include "journal.h"
+
+#include <fcntl.h>      // For open
+#include <sys/mman.h>   // For mmap
+#include <sys/stat.h>   // For fstat, mkdir
+#include <sys/uio.h>    // For writev
+#include <cerrno>       // For errno
+#include <cstdio>       // For rename
+#include <cstring>      // For memcpy, memcmp
+#include <iostream>     // For cout
+#include <unistd.h>     // For close, write, fsync, ftruncate, access, unlink
+
+namespace {
+
+const char kSnapshotMagic[8] = {'S', 'B', 'S', 'N', 'A', 'P', '0', '1'};
+const std::uint32_t kEntryMagic = 0x324a4248; // "HBJ2"
+
+struct SnapshotHeader {
+  char magic[8];
+  std::uint64_t size;     // Of the state that follows
+  std::uint64_t checksum; // Of the state
+};
+
+// One append: `count` heartbeats that changed a sketch, all counted in
+// `second`, after which the server had recorded `recorded` heartbeats
+struct EntryHeader {
+  std::uint32_t magic;
+  std::uint32_t count;
+  std::int64_t second;
+  std::uint64_t recorded;
+  std::uint64_t checksum; // Of `second`, `count`, `recorded` and the records
+};
+
+std::uint64_t checksum(std::uint64_t hash, const void* data, std::size_t size) {
+  const unsigned char* p = static_cast<const unsigned char*>(data);
+  for (std::size_t i = 0; i < size; i++) hash = (hash ^ p[i]) * 1099511628211ull; // FNV-1a
+  return hash;
+}
+
+std::uint64_t entryChecksum(const EntryHeader& header, const void* records) {
+  std::uint64_t hash = 14695981039346656037ull;
+  hash = checksum(hash, &header.second, sizeof(header.second));
+  hash = checksum(hash, &header.count, sizeof(header.count));
+  hash = checksum(hash, &header.recorded, sizeof(header.recorded));
+  return checksum(hash, records, header.count * sizeof(Heartbeat));
+}
+
+// Read-only view of a whole file, unmapped when it goes out of scope
+struct MappedFile {
+  const unsigned char* data = nullptr;
+  std::size_t size = 0;
+
+  bool map(const std::string& path) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+    struct stat st;
+    bool ok = fstat(fd, &st) == 0 && st.st_size > 0;
+    if (ok) {
+      void* p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      ok = p != MAP_FAILED;
+      if (ok) {
+        data = static_cast<const unsigned char*>(p);
+        size = st.st_size;
+      }
+    }
+    close(fd);
+    return ok;
+  }
+
+  ~MappedFile() {
+    if (data) munmap(const_cast<unsigned char*>(data), size);
+  }
+};
+
+bool writeAll(int fd, const void* data, std::size_t size) {
+  const char* p = static_cast<const char*>(data);
+  while (size > 0) {
+    ssize_t n = write(fd, p, size);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      return false;
+    }
+    p += n;
+    size -= n;
+  }
+  return true;
+}
+
+} // namespace
+
+const int ActivityJournal::kCheckpointSeconds;
+
+ActivityJournal::ActivityJournal(const std::string& dir)
+    : snapshotPath_(dir + "/activity.snap"), logPath_(dir + "/activity.log"),
+      oldLogPath_(dir + "/activity.log.old"), logFd_(-1), writing_(false), oldLog_(false),
+      stopping_(false), replayed_(0) {
+  mkdir(dir.c_str(), 0755); // Fine if it already exists
+  writer_ = std::thread(&ActivityJournal::writeSnapshots, this);
+}
+
+ActivityJournal::~ActivityJournal() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  // Finishes a snapshot that was already taken
+  taken_.notify_one();
+  writer_.join();
+  if (logFd_ >= 0) close(logFd_);
+}
+
+bool ActivityJournal::restore(ActivityCounters& activity, std::time_t now) {
+  MappedFile snapshot;
+  if (snapshot.map(snapshotPath_)) {
+    SnapshotHeader header;
+    bool ok = snapshot.size >= sizeof(header);
+    if (ok) {
+      std::memcpy(&header, snapshot.data, sizeof(header));
+      const unsigned char* state = snapshot.data + sizeof(header);
+      ok = std::memcmp(header.magic, kSnapshotMagic, sizeof(kSnapshotMagic)) == 0 &&
+           header.size == snapshot.size - sizeof(header) &&
+           header.checksum == checksum(14695981039346656037ull, state, header.size) &&
+           activity.loadState(state, header.size);
+    }
+    if (!ok) std::cout << "Ignoring unreadable snapshot " << snapshotPath_ << std::endl;
+  }
+
+  if (!replayLog(activity)) return false;
+  activity.resume(now);
+  return true;
+}
+
+std::size_t ActivityJournal::replay(const std::string& path, ActivityCounters& activity) {
+  std::size_t valid = 0;
+  MappedFile log;
+  if (log.map(path)) {
+    // Stop at the first entry that is cut short or damaged: the server
+    // died while writing it
+    while (log.size - valid >= sizeof(EntryHeader)) {
+      EntryHeader header;
+      std::memcpy(&header, log.data + valid, sizeof(header));
+      std::size_t bytes = header.count * sizeof(Heartbeat);
+      if (header.magic != kEntryMagic || log.size - valid - sizeof(header) < bytes) break;
+      const unsigned char* records = log.data + valid + sizeof(header);
+      if (entryChecksum(header, records) != header.checksum) break;
+
+      for (std::uint32_t i = 0; i < header.count; i++) {
+        Heartbeat hb;
+        std::memcpy(&hb, records + i * sizeof(Heartbeat), sizeof(hb));
+        activity.replay(hb.user, hb.system, header.second);
+      }
+      activity.raiseRecorded(header.recorded);
+      replayed_ += header.count;
+      valid += sizeof(header) + bytes;
+    }
+  }
+  return valid;
+}
+
+bool ActivityJournal::replayLog(ActivityCounters& activity) {
+  // Left by a snapshot that never got written, so still needed
+  oldLog_ = access(oldLogPath_.c_str(), F_OK) == 0;
+  if (oldLog_) replay(oldLogPath_, activity);
+  std::size_t valid = replay(logPath_, activity);
+
+  logFd_ = open(logPath_.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+  if (logFd_ < 0) {
+    std::cout << "Failed to open " << logPath_ << ". errno: " << errno << std::endl;
+    return false;
+  }
+  // Drop a torn tail so new entries follow straight on from the good ones
+  if (ftruncate(logFd_, valid) < 0) {
+    std::cout << "Failed to truncate " << logPath_ << ". errno: " << errno << std::endl;
+    return false;
+  }
+  return true;
+}
+
+void ActivityJournal::append(std::time_t second, const Heartbeat* hbs, std::size_t n,
+                             std::uint64_t recorded) {
+  EntryHeader header;
+  header.magic = kEntryMagic;
+  header.count = static_cast<std::uint32_t>(n);
+  header.second = second;
+  header.recorded = recorded;
+  header.checksum = entryChecksum(header, hbs);
+
+  iovec iov[2];
+  iov[0].iov_base = &header;
+  iov[0].iov_len = sizeof(header);
+  iov[1].iov_base = const_cast<Heartbeat*>(hbs);
+  iov[1].iov_len = n * sizeof(Heartbeat);
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (logFd_ < 0) return;
+  // One write per entry; O_APPEND keeps entries whole and in order
+  if (writev(logFd_, iov, 2) != static_cast<ssize_t>(sizeof(header) + iov[1].iov_len)) {
+    std::cout << "Failed to append to " << logPath_ << ". errno: " << errno << std::endl;
+  }
+}
+
+bool ActivityJournal::checkpoint(const ActivityCounters& activity) {
+  // Appends wait while the state is taken and the log started over, so every
+  // heartbeat is either in the snapshot or in the new log (or both, which
+  // replays harmlessly)
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (writing_) return false;
+  state_.resize(activity.stateSize());
+  activity.saveState(&state_[0]);
+
+  // The old log is only deleted once the snapshot is safely written. If the
+  // last one never was, its log is still needed, so keep appending to this
+  // one; the new snapshot covers both
+  if (!oldLog_ && logFd_ >= 0) {
+    if (std::rename(logPath_.c_str(), oldLogPath_.c_str()) != 0) {
+      std::cout << "Failed to rename " << logPath_ << ". errno: " << errno << std::endl;
+      return false;
+    }
+    int fd = open(logPath_.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+    if (fd < 0) {
+      std::cout << "Failed to open " << logPath_ << ". errno: " << errno << std::endl;
+      std::rename(oldLogPath_.c_str(), logPath_.c_str()); // logFd_ still writes to it
+      return false;
+    }
+    close(logFd_);
+    logFd_ = fd;
+    oldLog_ = true;
+  }
+
+  writing_ = true;
+  taken_.notify_one();
+  return true;
+}
+
+void ActivityJournal::writeSnapshots() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    taken_.wait(lock, [this]() { return stopping_ || writing_; });
+    if (!writing_) return;
+
+    // checkpoint() leaves state_ alone until writing_ is cleared
+    lock.unlock();
+    bool ok = writeSnapshot(state_);
+    if (ok && unlink(oldLogPath_.c_str()) != 0 && errno != ENOENT) {
+      std::cout << "Failed to delete " << oldLogPath_ << ". errno: " << errno << std::endl;
+      ok = false;
+    }
+    lock.lock();
+    if (ok) oldLog_ = false;
+    writing_ = false;
+  }
+}
+
+bool ActivityJournal::writeSnapshot(const std::vector<unsigned char>& state) {
+  SnapshotHeader header;
+  std::memcpy(header.magic, kSnapshotMagic, sizeof(kSnapshotMagic));
+  header.size = state.size();
+  header.checksum = checksum(14695981039346656037ull, &state[0], state.size());
+
+  std::string tmp = snapshotPath_ + ".tmp";
+  int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    std::cout << "Failed to create " << tmp << ". errno: " << errno << std::endl;
+    return false;
+  }
+  bool ok = writeAll(fd, &header, sizeof(header)) && writeAll(fd, &state[0], state.size()) &&
+            fsync(fd) == 0;
+  close(fd);
+  if (!ok || std::rename(tmp.c_str(), snapshotPath_.c_str()) != 0) {
+    std::cout << "Failed to write " << snapshotPath_ << ". errno: " << errno << std::endl;
+    unlink(tmp.c_str());
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,77 @@
+#ifndef SCOREBOARD_JOURNAL_H
+#define SCOREBOARD_JOURNAL_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "activity.h"
+#include "heartbeat.h"
+
+// Keeps the activity counters across restarts.
+//
+// Heartbeats that changed a sketch are appended to a log as they are
+// counted (ones that changed nothing would change nothing on replay either,
+// so a busy day does not mean a busy log). Each entry also carries
+// recorded() as of its batch, changed or not, so this server's entry in the
+// cluster's G-counter comes back whole; like the sketches it replays by
+// taking the maximum. Every so often the counters'
+// whole state is taken and the log starts over, both in the time of a
+// memcpy; a background thread then writes the state to a snapshot, which
+// replaces the old one by rename, and only then deletes the old log. A
+// restart maps the snapshot and replays the old log (if it is still there)
+// and the one written since, so it is back to where it was in milliseconds.
+//
+// The log is written with plain write()s, so a crash of the server loses
+// nothing; only the snapshot is fsync'ed, so a power cut can lose the log
+// tail since the last snapshot.
+class ActivityJournal {
+ public:
+  static const int kCheckpointSeconds = 30;
+
+  explicit ActivityJournal(const std::string& dir);
+  ~ActivityJournal();
+
+  // Loads the snapshot and log (if any) into `activity`, then opens the log
+  // for appending. False if the directory can't be used.
+  bool restore(ActivityCounters& activity, std::time_t now);
+
+  // Logs the `n` heartbeats of a batch counted in `second` that changed a
+  // sketch, and `recorded`, the counters' recorded() after the batch. Any
+  // thread.
+  void append(std::time_t second, const Heartbeat* hbs, std::size_t n, std::uint64_t recorded);
+
+  // Takes the state of `activity` and starts a new log; the snapshot is
+  // written in the background. Call on the thread that ticks the counters,
+  // so the snapshot is consistent. False if the last snapshot is still
+  // being written or the log could not be started over.
+  bool checkpoint(const ActivityCounters& activity);
+
+  std::size_t replayed() const { return replayed_; }
+
+ private:
+  std::size_t replay(const std::string& path, ActivityCounters& activity);
+  bool replayLog(ActivityCounters& activity);
+  void writeSnapshots();
+  bool writeSnapshot(const std::vector<unsigned char>& state);
+
+  std::string snapshotPath_;
+  std::string logPath_;
+  std::string oldLogPath_; // The log a snapshot being written replaces
+  std::mutex mutex_; // Orders appends against checkpoints
+  std::condition_variable taken_;
+  int logFd_;
+  std::vector<unsigned char> state_; // State waiting to be written
+  bool writing_; // From taking the state until its old log is gone
+  bool oldLog_;  // Still there, because its snapshot was never written
+  bool stopping_;
+  std::size_t replayed_;
+  std::thread writer_;
+};
+
+#endif // SCOREBOARD_JOURNAL_H
@@ -0,0 +1,304 @@
+#include "json_sax.h"
+
+#include <cstdio> // For snprintf
+
+namespace {
+
+inline bool isWhitespace(char c) { return c == ' ' || c == '\t' || c == '\n' || c == '\r'; }
+
+inline bool isNumberChar(char c) {
+  return (c >= '0' && c <= '9') || c == '-' || c == '+' || c == '.' || c == 'e' || c == 'E';
+}
+
+inline int hexValue(char c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  return -1;
+}
+
+} // namespace
+
+JsonStreamParser::JsonStreamParser(JsonHandler& handler)
+    : handler_(handler),
+      lexer_(kIdle),
+      expect_(kValue),
+      number_(kNumInt),
+      allowClose_(false),
+      unicode_(0),
+      unicodeDigits_(0),
+      highSurrogate_(0),
+      offset_(0) {}
+
+bool JsonStreamParser::feed(const char* data, std::size_t size) {
+  if (!error_.empty()) return false;
+  for (std::size_t i = 0; i < size; i++, offset_++) {
+    if (!step(data[i])) return false;
+  }
+  return true;
+}
+
+bool JsonStreamParser::finish() {
+  if (!error_.empty()) return false;
+  // A number at the very end has nothing after it to end it
+  if (lexer_ == kNumber && !endNumber()) return false;
+  if (lexer_ == kLiteral && !endLiteral()) return false;
+  if (expect_ != kDone || lexer_ != kIdle) return fail("unexpected end of input");
+  return true;
+}
+
+bool JsonStreamParser::step(char c) {
+  switch (lexer_) {
+    case kString:
+      if (c == '"') return endString();
+      if (c == '\\') {
+        lexer_ = kEscape;
+        return true;
+      }
+      if (static_cast<unsigned char>(c) < 0x20) return fail("control character in string");
+      if (highSurrogate_) return fail("unpaired surrogate");
+      token_ += c;
+      return true;
+
+    case kEscape:
+      lexer_ = kString;
+      if (c == 'u') {
+        lexer_ = kUnicode;
+        unicode_ = 0;
+        unicodeDigits_ = 0;
+        return true;
+      }
+      if (highSurrogate_) return fail("unpaired surrogate");
+      switch (c) {
+        case '"': token_ += '"'; return true;
+        case '\\': token_ += '\\'; return true;
+        case '/': token_ += '/'; return true;
+        case 'b': token_ += '\b'; return true;
+        case 'f': token_ += '\f'; return true;
+        case 'n': token_ += '\n'; return true;
+        case 'r': token_ += '\r'; return true;
+        case 't': token_ += '\t'; return true;
+        default: return fail("bad escape");
+      }
+
+    case kUnicode: {
+      int v = hexValue(c);
+      if (v < 0) return fail("bad \\u escape");
+      unicode_ = (unicode_ << 4) | v;
+      if (++unicodeDigits_ < 4) return true;
+      lexer_ = kString;
+      return appendCodepoint(unicode_);
+    }
+
+    case kNumber:
+      if (isNumberChar(c)) return numberChar(c);
+      if (!endNumber()) return false;
+      return step(c); // The character after the number still needs handling
+
+    case kLiteral:
+      if (c >= 'a' && c <= 'z') {
+        token_ += c;
+        return true;
+      }
+      if (!endLiteral()) return false;
+      return step(c);
+
+    case kIdle:
+      break;
+  }
+
+  if (isWhitespace(c)) return true;
+
+  switch (expect_) {
+    case kValue:
+      if (allowClose_ && c == ']') return endContainer(c);
+      return startValue(c);
+
+    case kKey:
+      if (allowClose_ && c == '}') return endContainer(c);
+      if (c != '"') return fail("expected a key");
+      lexer_ = kString;
+      token_.clear();
+      return true;
+
+    case kColon:
+      if (c != ':') return fail("expected ':'");
+      expect_ = kValue;
+      allowClose_ = false;
+      return true;
+
+    case kCommaOrEnd:
+      if (c == ',') {
+        expect_ = stack_.back() == '{' ? kKey : kValue;
+        allowClose_ = false;
+        return true;
+      }
+      return endContainer(c);
+
+    case kDone:
+      return fail("trailing characters after document");
+  }
+  return fail("internal error");
+}
+
+bool JsonStreamParser::startValue(char c) {
+  token_.clear();
+  switch (c) {
+    case '{':
+      stack_.push_back('{');
+      handler_.startObject();
+      expect_ = kKey;
+      allowClose_ = true;
+      return true;
+    case '[':
+      stack_.push_back('[');
+      handler_.startArray();
+      expect_ = kValue;
+      allowClose_ = true;
+      return true;
+    case '"':
+      lexer_ = kString;
+      return true;
+    default:
+      if (c == '-' || (c >= '0' && c <= '9')) {
+        lexer_ = kNumber;
+        number_ = c == '-' ? kNumMinus : c == '0' ? kNumZero : kNumInt;
+        token_ += c;
+        return true;
+      }
+      if (c >= 'a' && c <= 'z') {
+        lexer_ = kLiteral;
+        token_ += c;
+        return true;
+      }
+      return fail("expected a value");
+  }
+}
+
+bool JsonStreamParser::endContainer(char c) {
+  if (stack_.empty()) return fail("unbalanced bracket");
+  char open = stack_.back();
+  if ((open == '{' && c != '}') || (open == '[' && c != ']')) return fail("expected ',' or a closing bracket");
+  stack_.pop_back();
+  if (open == '{') handler_.endObject();
+  else handler_.endArray();
+  valueDone();
+  return true;
+}
+
+bool JsonStreamParser::endString() {
+  if (highSurrogate_) return fail("unpaired surrogate");
+  lexer_ = kIdle;
+  if (expect_ == kKey) {
+    handler_.key(token_);
+    expect_ = kColon;
+    return true;
+  }
+  handler_.string(token_);
+  valueDone();
+  return true;
+}
+
+bool JsonStreamParser::numberChar(char c) {
+  bool digit = c >= '0' && c <= '9';
+  bool e = c == 'e' || c == 'E';
+  Number next;
+  switch (number_) {
+    case kNumMinus:
+      if (!digit) return fail("malformed number");
+      next = c == '0' ? kNumZero : kNumInt;
+      break;
+    case kNumZero: // No more digits after a leading zero
+    case kNumInt:
+      if (digit && number_ == kNumInt) next = kNumInt;
+      else if (c == '.') next = kNumPoint;
+      else if (e) next = kNumE;
+      else return fail("malformed number");
+      break;
+    case kNumPoint:
+    case kNumFraction:
+      if (digit) next = kNumFraction;
+      else if (e && number_ == kNumFraction) next = kNumE;
+      else return fail("malformed number");
+      break;
+    case kNumE:
+      if (digit) next = kNumExponent;
+      else if (c == '+' || c == '-') next = kNumExpSign;
+      else return fail("malformed number");
+      break;
+    default: // kNumExpSign, kNumExponent
+      if (!digit) return fail("malformed number");
+      next = kNumExponent;
+      break;
+  }
+  number_ = next;
+  token_ += c;
+  return true;
+}
+
+bool JsonStreamParser::endNumber() {
+  lexer_ = kIdle;
+  if (number_ != kNumZero && number_ != kNumInt && number_ != kNumFraction &&
+      number_ != kNumExponent) {
+    return fail("malformed number");
+  }
+  handler_.number(token_);
+  valueDone();
+  return true;
+}
+
+bool JsonStreamParser::endLiteral() {
+  lexer_ = kIdle;
+  if (token_ == "true") handler_.boolean(true);
+  else if (token_ == "false") handler_.boolean(false);
+  else if (token_ == "null") handler_.null();
+  else return fail("unknown literal");
+  valueDone();
+  return true;
+}
+
+bool JsonStreamParser::appendCodepoint(unsigned cp) {
+  if (cp >= 0xD800 && cp <= 0xDBFF) {
+    if (highSurrogate_) return fail("unpaired surrogate");
+    highSurrogate_ = cp;
+    return true;
+  }
+  if (cp >= 0xDC00 && cp <= 0xDFFF) {
+    if (!highSurrogate_) return fail("unpaired surrogate");
+    cp = 0x10000 + ((highSurrogate_ - 0xD800) << 10) + (cp - 0xDC00);
+    highSurrogate_ = 0;
+  } else if (highSurrogate_) {
+    return fail("unpaired surrogate");
+  }
+
+  // UTF-8 encode
+  if (cp < 0x80) {
+    token_ += static_cast<char>(cp);
+  } else if (cp < 0x800) {
+    token_ += static_cast<char>(0xC0 | (cp >> 6));
+    token_ += static_cast<char>(0x80 | (cp & 0x3F));
+  } else if (cp < 0x10000) {
+    token_ += static_cast<char>(0xE0 | (cp >> 12));
+    token_ += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+    token_ += static_cast<char>(0x80 | (cp & 0x3F));
+  } else {
+    token_ += static_cast<char>(0xF0 | (cp >> 18));
+    token_ += static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+    token_ += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+    token_ += static_cast<char>(0x80 | (cp & 0x3F));
+  }
+  return true;
+}
+
+void JsonStreamParser::valueDone() {
+  expect_ = stack_.empty() ? kDone : kCommaOrEnd;
+  allowClose_ = false;
+}
+
+bool JsonStreamParser::fail(const char* what) {
+  char where[32];
+  std::snprintf(where, sizeof(where), " at byte %zu", offset_);
+  error_ = what;
+  error_ += where;
+  return false;
+}
@@ -0,0 +1,71 @@
+#ifndef SCOREBOARD_JSON_SAX_H
+#define SCOREBOARD_JSON_SAX_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Receives JSON events from JsonStreamParser. Override what you need; the
+// strings passed in are reused between calls, so copy anything you keep.
+class JsonHandler {
+ public:
+  virtual ~JsonHandler() {}
+  virtual void startObject() {}
+  virtual void endObject() {}
+  virtual void startArray() {}
+  virtual void endArray() {}
+  virtual void key(const std::string& /*name*/) {}
+  virtual void string(const std::string& /*value*/) {}
+  virtual void number(const std::string& /*text*/) {} // As written, e.g. "-3.5e2"
+  virtual void boolean(bool /*value*/) {}
+  virtual void null() {}
+};
+
+// Push-style JSON parser. Bytes can be fed in arbitrary chunks as they come
+// off the network (a token may be split between chunks); nothing is kept
+// but the current token and the nesting stack, so memory use does not grow
+// with the size of the document.
+class JsonStreamParser {
+ public:
+  explicit JsonStreamParser(JsonHandler& handler);
+
+  // Returns false on a syntax error; see error()
+  bool feed(const char* data, std::size_t size);
+  // Call after the last chunk. Returns true if a complete document was seen.
+  bool finish();
+
+  const std::string& error() const { return error_; }
+
+ private:
+  enum Lexer { kIdle, kString, kEscape, kUnicode, kNumber, kLiteral };
+  enum Expect { kValue, kKey, kColon, kCommaOrEnd, kDone };
+  // Where a number is in -?(0|[1-9][0-9]*)(\.[0-9]+)?([eE][+-]?[0-9]+)?
+  enum Number { kNumMinus, kNumZero, kNumInt, kNumPoint, kNumFraction, kNumE, kNumExpSign,
+                kNumExponent };
+
+  bool step(char c);
+  bool startValue(char c);
+  bool endContainer(char c);
+  bool endString();
+  bool numberChar(char c);
+  bool endNumber();
+  bool endLiteral();
+  bool appendCodepoint(unsigned cp);
+  void valueDone();
+  bool fail(const char* what);
+
+  JsonHandler& handler_;
+  Lexer lexer_;
+  Expect expect_;
+  Number number_;
+  bool allowClose_;         // Just opened a container, so it may close straight away
+  std::vector<char> stack_; // '{' or '[' per open container
+  std::string token_;
+  unsigned unicode_;        // \uXXXX being read
+  int unicodeDigits_;
+  unsigned highSurrogate_;  // First half of a surrogate pair, if any
+  std::size_t offset_;      // Bytes consumed, for error messages
+  std::string error_;
+};
+
+#endif // SCOREBOARD_JSON_SAX_H
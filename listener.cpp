@@ -0,0 +1,88 @@
+#include "listener.h"
+
+#include <sys/socket.h> // For socket functions
+#include <netinet/in.h> // For sockaddr_in
+#include <arpa/inet.h>  // For inet_pton
+#include <cerrno>       // For errno
+#include <iostream>     // For cout
+#include <unistd.h>     // For close
+
+namespace {
+
+// Fills in `sockaddr` for `port` on `address`, or on any address if null
+bool socketAddress(int port, const char* address, sockaddr_in& sockaddr) {
+  sockaddr = sockaddr_in();
+  sockaddr.sin_family = AF_INET;
+  sockaddr.sin_addr.s_addr = INADDR_ANY;
+  sockaddr.sin_port = htons(port); // htons is necessary to convert a number to
+                                   // network byte order
+  if (address && inet_pton(AF_INET, address, &sockaddr.sin_addr) != 1) {
+    std::cout << "Failed to parse address " << address << std::endl;
+    return false;
+  }
+  return true;
+}
+
+} // namespace
+
+int openListener(int port, int backlog, bool reusePort, const char* address) {
+  // Create a socket (IPv4, TCP)
+  int sockfd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (sockfd == -1) {
+    std::cout << "Failed to create socket. errno: " << errno << std::endl;
+    return -1;
+  }
+
+  // Allow a restarted server to bind while old connections sit in TIME_WAIT
+  int enable = 1;
+  setsockopt(sockfd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+  if (reusePort && setsockopt(sockfd, SOL_SOCKET, SO_REUSEPORT, &enable, sizeof(enable)) < 0) {
+    std::cout << "Failed to set SO_REUSEPORT. errno: " << errno << std::endl;
+    close(sockfd);
+    return -1;
+  }
+
+  sockaddr_in sockaddr;
+  if (!socketAddress(port, address, sockaddr)) {
+    close(sockfd);
+    return -1;
+  }
+  if (bind(sockfd, (struct sockaddr*)&sockaddr, sizeof(sockaddr)) < 0) {
+    std::cout << "Failed to bind to port " << port << ". errno: " << errno << std::endl;
+    close(sockfd);
+    return -1;
+  }
+
+  if (listen(sockfd, backlog) < 0) {
+    std::cout << "Failed to listen on socket. errno: " << errno << std::endl;
+    close(sockfd);
+    return -1;
+  }
+
+  return sockfd;
+}
+
+int openDatagram(int port, int receiveBuffer, const char* address) {
+  int sockfd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (sockfd == -1) {
+    std::cout << "Failed to create UDP socket. errno: " << errno << std::endl;
+    return -1;
+  }
+
+  // Bursts land here while the loop is busy; the default buffer is small.
+  // The kernel caps this at net.core.rmem_max.
+  setsockopt(sockfd, SOL_SOCKET, SO_RCVBUF, &receiveBuffer, sizeof(receiveBuffer));
+
+  sockaddr_in sockaddr;
+  if (!socketAddress(port, address, sockaddr)) {
+    close(sockfd);
+    return -1;
+  }
+  if (bind(sockfd, (struct sockaddr*)&sockaddr, sizeof(sockaddr)) < 0) {
+    std::cout << "Failed to bind UDP port " << port << ". errno: " << errno << std::endl;
+    close(sockfd);
+    return -1;
+  }
+
+  return sockfd;
+}
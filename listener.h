@@ -0,0 +1,18 @@
+#ifndef SCOREBOARD_LISTENER_H
+#define SCOREBOARD_LISTENER_H
+
+// Creates a non-blocking TCP socket listening on `port` on `address` (an
+// IPv4 address such as "127.0.0.1"), or on any address if it is null.
+//
+// With `reusePort` several sockets can bind the same port (SO_REUSEPORT) and
+// the kernel spreads incoming connections between them, which lets every
+// worker thread accept on its own socket. Prints the reason and returns -1
+// on failure.
+int openListener(int port, int backlog, bool reusePort, const char* address = nullptr);
+
+// Creates a non-blocking UDP socket bound to `port` on `address` (any if
+// null), asking for a `receiveBuffer` byte socket buffer. Prints the reason and returns -1
+// on failure.
+int openDatagram(int port, int receiveBuffer, const char* address = nullptr);
+
+#endif // SCOREBOARD_LISTENER_H
@@ -1,52 +1,388 @@
-#include <sys/socket.h> // For socket functions
-#include <netinet/in.h> // For sockaddr_in
-#include <cstdlib> // For exit() and EXIT_FAILURE
+#include <sys/socket.h> // For SOMAXCONN
+#include <netinet/in.h> // For INADDR_LOOPBACK
+#include <chrono> // For the status registers' stamps
+#include <cstdlib> // For exit(), atoi() and EXIT_FAILURE
+#include <ctime> // For time
+#include <cstring> // For strcmp
+#include <functional> // For ref
 #include <iostream> // For cout
-#include <unistd.h> // For read
+#include <thread> // For worker threads
+#include <unistd.h> // For close
+#include <string>
+#include <vector>
 
-int main() {
-  // Create a socket (IPv4, TCP)
-  int sockfd = socket(AF_INET, SOCK_STREAM, 0);
-  if (sockfd == -1) {
-    std::cout << "Failed to create socket. errno: " << errno << std::endl;
-    exit(EXIT_FAILURE);
+#include "activity.h"
+#include "cluster.h"
+#include "dashboard.h"
+#include "event_loop.h"
+#include "http_server.h"
+#include "ingest.h"
+#include "journal.h"
+#include "listener.h"
+#include "metrics.h"
+#include "push.h"
+#include "snapshot.h"
+#include "uring_loop.h"
+
+#ifdef SCOREBOARD_GAMES_PROXY
+#include "games_proxy.h"
+#include "response_cache.h"
+#else
+class GamesProxy; // Needs libcurl
+#endif
+
+namespace {
+
+struct ServerOptions {
+  int port = 9999;
+  int threads = 1;           // 0 means one per core
+  int backlog = SOMAXCONN;   // Every scoreboard polls on the same minute boundary
+  int ingestPort = 0;        // Heartbeat ingestion (TCP and UDP); 0 is off
+  const char* ingestBind = "127.0.0.1"; // Address it listens on, loopback like /gp/heartbeat
+  const char* stateDir = "state"; // Where the activity counters are kept
+  int nodeId = 0;            // Unique within a cluster; 0 until given
+  int syncPort = 0;          // Where peers send their deltas; 0 is off
+  const char* syncBind = "127.0.0.1"; // Address it listens on; peers are trusted
+  std::vector<std::string> peers; // host:port of other nodes' sync ports
+  bool ioUring = false;      // Serve the scoreboards from io_uring instead of epoll
+  std::string upstream;      // Games API to proxy at /games; empty is off
+  int refreshSeconds = 60;   // How often the proxied games are refetched
+  const char* gamesCache = nullptr; // Revalidate them against an on-disk cache here
+};
+
+void usage(const char* argv0) {
+  std::cout << "Usage: " << argv0 << " [--port N] [--threads N] [--backlog N]\n"
+            << "       [--ingest-port N [--ingest-bind ADDR]] [--state-dir DIR]\n"
+            << "       [--node-id N --sync-port N [--sync-bind ADDR] --peer HOST:PORT...]\n"
+            << "       [--io-uring] [--upstream URL [--refresh S] [--games-cache DIR]]\n"
+            << "  --port N         Port to serve the scoreboards on (default 9999)\n"
+            << "  --threads N      Worker threads, each with its own SO_REUSEPORT listener\n"
+            << "                   and event loop. 0 starts one per core (default 1)\n"
+            << "  --backlog N      Pending connections each listener queues (default "
+            << SOMAXCONN << ")\n"
+            << "  --ingest-port N  Receive binary heartbeats (heartbeat.h) over TCP and UDP\n"
+            << "                   on this port (default off)\n"
+            << "  --ingest-bind ADDR Address the heartbeat port listens on; 0.0.0.0 takes\n"
+            << "                   them from any host (default 127.0.0.1)\n"
+            << "  --state-dir DIR  Keeps the activity counters here across restarts\n"
+            << "                   (default ./state)\n"
+            << "  --node-id N      This server's id in a cluster, unique and kept across\n"
+            << "                   restarts. Needed with --sync-port or --peer\n"
+            << "  --sync-port N    Receive other nodes' counters and status on this port\n"
+            << "  --sync-bind ADDR Address the sync port listens on; 0.0.0.0 takes deltas\n"
+            << "                   from any host, so firewall it (default 127.0.0.1)\n"
+            << "  --peer HOST:PORT Send ours to another node's sync port once a second.\n"
+            << "                   Repeat for every other node\n"
+            << "  --io-uring       Serve the scoreboards with io_uring (Linux 6.0+), falling\n"
+            << "                   back to epoll where it isn't available\n"
+            << "  --upstream URL   Serve GET /games from this games API (e.g.\n"
+            << "                   http://127.0.0.1:9998 for fake_upstream), fetching each\n"
+            << "                   query once for every client. Needs libcurl\n"
+            << "  --refresh S      Refetch every query still being asked for this often\n"
+            << "                   (default 60)\n"
+            << "  --games-cache DIR Keep the upstream's answers here and only revalidate\n"
+            << "                   them (default: refetch in full)" << std::endl;
+}
+
+bool parseOptions(int argc, char** argv, ServerOptions& opts) {
+  for (int i = 1; i < argc; i++) {
+    if (std::strcmp(argv[i], "--io-uring") == 0) {
+      opts.ioUring = true;
+    } else if (i + 1 < argc && std::strcmp(argv[i], "--port") == 0) {
+      opts.port = std::atoi(argv[++i]);
+    } else if (i + 1 < argc && std::strcmp(argv[i], "--threads") == 0) {
+      opts.threads = std::atoi(argv[++i]);
+    } else if (i + 1 < argc && std::strcmp(argv[i], "--backlog") == 0) {
+      opts.backlog = std::atoi(argv[++i]);
+    } else if (i + 1 < argc && std::strcmp(argv[i], "--ingest-port") == 0) {
+      opts.ingestPort = std::atoi(argv[++i]);
+    } else if (i + 1 < argc && std::strcmp(argv[i], "--ingest-bind") == 0) {
+      opts.ingestBind = argv[++i];
+    } else if (i + 1 < argc && std::strcmp(argv[i], "--state-dir") == 0) {
+      opts.stateDir = argv[++i];
+    } else if (i + 1 < argc && std::strcmp(argv[i], "--node-id") == 0) {
+      opts.nodeId = std::atoi(argv[++i]);
+    } else if (i + 1 < argc && std::strcmp(argv[i], "--sync-port") == 0) {
+      opts.syncPort = std::atoi(argv[++i]);
+    } else if (i + 1 < argc && std::strcmp(argv[i], "--sync-bind") == 0) {
+      opts.syncBind = argv[++i];
+    } else if (i + 1 < argc && std::strcmp(argv[i], "--peer") == 0) {
+      opts.peers.push_back(argv[++i]);
+    } else if (i + 1 < argc && std::strcmp(argv[i], "--upstream") == 0) {
+      opts.upstream = argv[++i];
+    } else if (i + 1 < argc && std::strcmp(argv[i], "--refresh") == 0) {
+      opts.refreshSeconds = std::atoi(argv[++i]);
+    } else if (i + 1 < argc && std::strcmp(argv[i], "--games-cache") == 0) {
+      opts.gamesCache = argv[++i];
+    } else {
+      return false;
+    }
   }
+  if (opts.threads == 0) opts.threads = std::thread::hardware_concurrency();
+  if (opts.threads < 1) opts.threads = 1;
+  // Two nodes with the same id would overwrite each other's counts
+  bool clustered = opts.syncPort > 0 || !opts.peers.empty();
+  if (clustered && opts.nodeId <= 0) return false;
+  if (opts.nodeId <= 0) opts.nodeId = 1;
+  return opts.port > 0 && opts.port < 65536 && opts.backlog > 0 && opts.ingestPort >= 0 &&
+         opts.ingestPort < 65536 && opts.syncPort >= 0 && opts.syncPort < 65536 &&
+         opts.refreshSeconds > 0;
+}
 
-  // Listen to port 9999 on any address
-  sockaddr_in sockaddr;
-  sockaddr.sin_family = AF_INET;
-  sockaddr.sin_addr.s_addr = INADDR_ANY;
-  sockaddr.sin_port = htons(9999); // htons is necessary to convert a number to
-                                   // network byte order
-  if (bind(sockfd, (struct sockaddr*)&sockaddr, sizeof(sockaddr)) < 0) {
-    std::cout << "Failed to bind to port 9999. errno: " << errno << std::endl;
-    exit(EXIT_FAILURE);
+// Reads "user system" pairs, one per line, from a heartbeat body. Returns
+// how many were recorded.
+std::size_t recordHeartbeats(const StrView& body, ActivityCounters& activity,
+                             ActivityJournal& journal, std::time_t now) {
+  const char* p = body.data;
+  const char* end = body.data + body.size;
+  std::size_t recorded = 0;
+  std::vector<Heartbeat> changed;
+  while (p < end) {
+    std::uint64_t ids[2] = {0, 0};
+    int found = 0;
+    while (p < end && *p != '\n') {
+      if (*p >= '0' && *p <= '9') {
+        std::uint64_t v = 0;
+        while (p < end && *p >= '0' && *p <= '9') v = v * 10 + (*p++ - '0');
+        if (found < 2) ids[found] = v;
+        found++;
+      } else {
+        p++;
+      }
+    }
+    p++;
+    if (found == 2) {
+      Heartbeat hb = {ids[0], ids[1]};
+      if (activity.record(hb.user, hb.system, now)) changed.push_back(hb);
+      recorded++;
+    }
   }
+  if (recorded > 0) journal.append(now, changed.data(), changed.size(), activity.recorded());
+  return recorded;
+}
+
+// Routes for one worker. Everything captured is either owned by that worker
+// or safe to share between them.
+void addRoutes(Router& router, SnapshotReader& reader, SnapshotPublisher& publisher,
+               PushHub& hub, ActivityCounters& activity, ActivityJournal& journal,
+               ClusterState& cluster, const MetricsRegistry& metrics) {
+  // The endpoint getPage() in scoreboard.cpp polls
+  router.add("GET", "/gp/dbd.php", [&reader](const HttpRequest& req, Connection& conn) {
+    const std::shared_ptr<const Snapshot>& snap = reader.get();
+    // Most polls find the same numbers as last time; they get a bodyless 304
+    StrView response = snap->format(wantsBinary(req)).reply(req);
+    conn.out.appendShared(snap, response.data, response.size);
+  });
 
-  // Start listening. Hold at most 10 connections in the queue
-  if (listen(sockfd, 10) < 0) {
-    std::cout << "Failed to listen on socket. errno: " << errno << std::endl;
+  // Long-lived alternative to polling /gp/dbd.php
+  router.add("GET", "/gp/subscribe", [&hub](const HttpRequest& req, Connection& conn) {
+    hub.subscribe(req, conn);
+  });
+
+  // Where the web service reports activity: "user system" lines
+  router.add("POST", "/gp/heartbeat", [&activity, &journal](const HttpRequest& req,
+                                                            Connection& conn) {
+    if (conn.peerAddr != INADDR_LOOPBACK) {
+      appendResponse(conn.out, 403, "text/plain", "Forbidden", req.keepAlive);
+      return;
+    }
+    if (recordHeartbeats(req.body, activity, journal, std::time(nullptr)) == 0) {
+      appendResponse(conn.out, 400, "text/plain", "Bad Request", req.keepAlive);
+      return;
+    }
+    appendResponse(conn.out, 200, "text/plain", "OK", req.keepAlive);
+  });
+
+  // Where the dbd.php script pushes new stats, in the same format it serves.
+  // Only the status fields are taken; the activity counts are our own. Any
+  // node will do: the latest push reaches the others with the next delta.
+  router.add("POST", "/gp/stats", [&publisher, &cluster](const HttpRequest& req,
+                                                         Connection& conn) {
+    if (conn.peerAddr != INADDR_LOOPBACK) {
+      appendResponse(conn.out, 403, "text/plain", "Forbidden", req.keepAlive);
+      return;
+    }
+    DashboardStats stats;
+    if (!parseDashboard(req.body.data, req.body.size, stats)) {
+      appendResponse(conn.out, 400, "text/plain", "Bad Request", req.keepAlive);
+      return;
+    }
+    std::int64_t stampMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    cluster.setStatus(stats, stampMs);
+    publisher.publishChange([&cluster](DashboardStats& current) { cluster.status(current); });
+    appendResponse(conn.out, 200, "text/plain", "OK", req.keepAlive);
+  });
+
+  // This node's id and the heartbeat counts of every node it has heard of
+  router.add("GET", "/gp/cluster", [&cluster](const HttpRequest& req, Connection& conn) {
+    std::string body = cluster.describe();
+    appendResponse(conn.out, 200, "text/plain", StrView(body.data(), body.size()), req.keepAlive);
+  });
+
+  // Every worker's counters and stage latencies, merged, for Prometheus
+  router.add("GET", "/metrics", [&metrics](const HttpRequest& req, Connection& conn) {
+    std::string body;
+    metrics.render(body);
+    appendResponse(conn.out, 200, "text/plain; version=0.0.4", StrView(body.data(), body.size()),
+                   req.keepAlive);
+  });
+}
+
+// Publishes the activity counts, and any status the peers sent; run once a
+// second by the first worker
+void publishActivity(ActivityCounters& activity, ClusterState& cluster,
+                     SnapshotPublisher& publisher, std::time_t now) {
+  ActivityCounts counts = activity.tick(now);
+  publisher.publishChange([&counts, &cluster](DashboardStats& stats) {
+    stats.acu = counts.users;
+    stats.acs = counts.systems;
+    stats.dacu = counts.usersToday;
+    stats.dacs = counts.systemsToday;
+    cluster.status(stats);
+  });
+}
+
+// One shard: its own listener, loop, router and snapshot cache, so workers
+// share nothing on the request path but the publisher's version counter
+// and the lock-free activity counters
+void runWorker(int listenFd, SnapshotPublisher& publisher, ActivityCounters& activity,
+               ActivityJournal& journal, ClusterState& cluster, MetricsRegistry& registry,
+               GamesProxy* games, bool ioUring, bool first) {
+  SnapshotReader reader(publisher);
+  Router router;
+  ThreadMetrics& metrics = registry.add();
+  EventLoop::Handler handler = [&router, &metrics](Connection& conn) {
+    return serveHttp(router, conn, &metrics);
+  };
+  std::unique_ptr<EventLoop> loopPtr(ioUring ? new UringLoop(listenFd, handler)
+                                             : new EventLoop(listenFd, handler));
+  EventLoop& loop = *loopPtr;
+  loop.setMetrics(&metrics);
+  PushHub hub(loop, publisher, reader);
+  addRoutes(router, reader, publisher, hub, activity, journal, cluster, registry);
+#ifdef SCOREBOARD_GAMES_PROXY
+  // Game data for the scoreboards, from memory however many ask
+  std::unique_ptr<GamesHub> gamesHub;
+  if (games) {
+    gamesHub.reset(new GamesHub(loop, *games, router));
+    GamesHub& front = *gamesHub;
+    router.add("GET", "/games", [&front](const HttpRequest& req, Connection& conn) {
+      front.serve(req, conn);
+    });
+  }
+#endif
+  if (first) {
+    // A deadline, so a late tick doesn't skip a checkpoint
+    std::time_t nextCheckpoint = std::time(nullptr) + ActivityJournal::kCheckpointSeconds;
+    loop.addTick([&activity, &cluster, &publisher, &journal,
+                  nextCheckpoint](std::time_t now) mutable {
+      publishActivity(activity, cluster, publisher, now);
+      if (now >= nextCheckpoint && journal.checkpoint(activity)) {
+        nextCheckpoint = now + ActivityJournal::kCheckpointSeconds;
+      }
+    });
+  }
+
+  if (loop.run() < 0) exit(EXIT_FAILURE);
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  ServerOptions opts;
+  if (!parseOptions(argc, argv, opts)) {
+    usage(argv[0]);
     exit(EXIT_FAILURE);
   }
 
-  // Grab a connection from the queue
-  auto addrlen = sizeof(sockaddr);
-  int connection = accept(sockfd, (struct sockaddr*)&sockaddr, (socklen_t*)&addrlen);
-  if (connection < 0) {
-    std::cout << "Failed to grab connection. errno: " << errno << std::endl;
+  // The dashboard is rendered once per change, not once per request
+  SnapshotPublisher publisher;
+  // Pick the counters up where the last run left them
+  std::time_t now = std::time(nullptr);
+  ActivityCounters activity(now);
+  ActivityJournal journal(opts.stateDir);
+  if (!journal.restore(activity, now)) exit(EXIT_FAILURE);
+  journal.checkpoint(activity);
+  ClusterState cluster(opts.nodeId, activity);
+  publishActivity(activity, cluster, publisher, now);
+  std::cout << "Restored activity counters from " << opts.stateDir << " ("
+            << journal.replayed() << " heartbeats replayed)" << std::endl;
+
+  // Open every listener up front so a bad port fails before anything runs
+  std::vector<int> listeners;
+  for (int i = 0; i < opts.threads; i++) {
+    int sockfd = openListener(opts.port, opts.backlog, opts.threads > 1);
+    if (sockfd < 0) exit(EXIT_FAILURE);
+    listeners.push_back(sockfd);
+  }
+
+  // Heartbeats get a loop of their own, so a flood of them never delays a
+  // scoreboard
+  HeartbeatIngest ingest(activity, journal);
+  std::thread ingestThread;
+  if (opts.ingestPort > 0) {
+    if (!ingest.open(opts.ingestPort, opts.backlog, opts.ingestBind)) exit(EXIT_FAILURE);
+    ingestThread = std::thread([&ingest]() {
+      if (ingest.run() < 0) exit(EXIT_FAILURE);
+    });
+  }
+
+  // Other nodes' deltas are merged on a loop of their own too
+  ClusterSync sync(cluster);
+  std::thread syncThread;
+  if (opts.syncPort > 0 && !sync.open(opts.syncPort, opts.backlog, opts.syncBind)) exit(EXIT_FAILURE);
+  for (std::size_t i = 0; i < opts.peers.size(); i++) {
+    if (!sync.addPeer(opts.peers[i])) exit(EXIT_FAILURE);
+  }
+  if (opts.syncPort > 0 || !opts.peers.empty()) {
+    syncThread = std::thread([&sync]() {
+      if (sync.run() < 0) exit(EXIT_FAILURE);
+    });
+  }
+
+  if (opts.ioUring && !UringLoop::available()) {
+    std::cout << "io_uring is not available here; serving with epoll" << std::endl;
+    opts.ioUring = false;
+  }
+
+  // Upstream game data is fetched once for every scoreboard, in the background
+  GamesProxy* games = nullptr;
+#ifdef SCOREBOARD_GAMES_PROXY
+  std::unique_ptr<ResponseCache> gamesCache;
+  std::unique_ptr<GamesProxy> gamesProxy;
+  if (!opts.upstream.empty()) {
+    GamesProxyOptions proxyOptions;
+    proxyOptions.upstream = opts.upstream;
+    proxyOptions.refreshSeconds = opts.refreshSeconds;
+    if (opts.gamesCache) {
+      gamesCache.reset(new ResponseCache(opts.gamesCache));
+      proxyOptions.cache = gamesCache.get();
+    }
+    gamesProxy.reset(new GamesProxy(proxyOptions));
+    games = gamesProxy.get();
+  }
+#else
+  if (!opts.upstream.empty()) {
+    std::cout << "Built without libcurl, so --upstream is not available" << std::endl;
     exit(EXIT_FAILURE);
   }
+#endif
 
-  // Read from the connection
-  char buffer[100];
-  auto bytesRead = read(connection, buffer, 100);
-  std::cout << "The message was: " << buffer;
+  MetricsRegistry metrics;
+  std::vector<std::thread> workers;
+  for (std::size_t i = 1; i < listeners.size(); i++) {
+    workers.push_back(std::thread(runWorker, listeners[i], std::ref(publisher), std::ref(activity),
+                                  std::ref(journal), std::ref(cluster), std::ref(metrics), games,
+                                  opts.ioUring, false));
+  }
+  runWorker(listeners[0], publisher, activity, journal, cluster, metrics, games, opts.ioUring,
+            true);
 
-  // Send a message to the connection
-  std::string response = "Good talking to you\n";
-  send(connection, response.c_str(), response.size(), 0);
+  for (std::size_t i = 0; i < workers.size(); i++) workers[i].join();
+  if (ingestThread.joinable()) ingestThread.join();
+  if (syncThread.joinable()) syncThread.join();
 
-  // Close the connections
-  close(connection);
-  close(sockfd);
-}
\ No newline at end of file
+  // Close the listening sockets
+  for (std::size_t i = 0; i < listeners.size(); i++) close(listeners[i]);
+}
@@ -0,0 +1,105 @@
+#include "metrics.h"
+
+#include <cstdarg> // For va_list
+#include <cstdio>  // For snprintf, vsnprintf
+
+namespace {
+
+const char* const kStageNames[kStageCount] = {"accept", "read", "parse", "response", "send"};
+
+struct CounterInfo {
+  const char* name;
+  const char* help;
+};
+
+const CounterInfo kCounters[kCounterCount] = {
+    {"dashboard_connections_accepted_total", "Connections accepted"},
+    {"dashboard_connections_closed_total", "Connections closed"},
+    {"dashboard_requests_total", "Requests parsed and answered"},
+    {"dashboard_bad_requests_total", "Requests the parser rejected"},
+    {"dashboard_received_bytes_total", "Bytes read from clients"},
+    {"dashboard_sent_bytes_total", "Bytes sent to clients"},
+};
+
+const double kQuantiles[] = {0.5, 0.9, 0.99, 0.999};
+
+void appendf(std::string& out, const char* format, ...) {
+  char line[256];
+  va_list args;
+  va_start(args, format);
+  int n = std::vsnprintf(line, sizeof(line), format, args);
+  va_end(args);
+  if (n > 0) out.append(line, n < int(sizeof(line)) ? n : int(sizeof(line)) - 1);
+}
+
+} // namespace
+
+ThreadMetrics::ThreadMetrics() {
+  for (int i = 0; i < kCounterCount; i++) counters_[i].store(0, std::memory_order_relaxed);
+  for (int s = 0; s < kStageCount; s++) {
+    for (std::size_t i = 0; i < LogLinearHistogram::kBuckets; i++) {
+      stages_[s].buckets[i].store(0, std::memory_order_relaxed);
+    }
+    stages_[s].sum.store(0, std::memory_order_relaxed);
+    stages_[s].max.store(0, std::memory_order_relaxed);
+  }
+}
+
+ThreadMetrics& MetricsRegistry::add() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  threads_.push_back(std::unique_ptr<ThreadMetrics>(new ThreadMetrics()));
+  return *threads_.back();
+}
+
+void MetricsRegistry::render(std::string& out) const {
+  std::uint64_t counters[kCounterCount] = {};
+  LogLinearHistogram stages[kStageCount];
+  std::uint64_t sums[kStageCount] = {};
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (std::size_t t = 0; t < threads_.size(); t++) {
+      const ThreadMetrics& m = *threads_[t];
+      for (int i = 0; i < kCounterCount; i++) {
+        counters[i] += m.counters_[i].load(std::memory_order_relaxed);
+      }
+      for (int s = 0; s < kStageCount; s++) {
+        const ThreadMetrics::Stage& stage = m.stages_[s];
+        std::uint64_t max = stage.max.load(std::memory_order_relaxed);
+        for (std::size_t i = 0; i < LogLinearHistogram::kBuckets; i++) {
+          std::uint64_t n = stage.buckets[i].load(std::memory_order_relaxed);
+          if (n > 0) stages[s].add(i, n, max);
+        }
+        sums[s] += stage.sum.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  for (int i = 0; i < kCounterCount; i++) {
+    appendf(out, "# HELP %s %s\n", kCounters[i].name, kCounters[i].help);
+    appendf(out, "# TYPE %s counter\n", kCounters[i].name);
+    appendf(out, "%s %llu\n", kCounters[i].name, (unsigned long long)counters[i]);
+  }
+
+  const char* name = "dashboard_stage_seconds";
+  appendf(out, "# HELP %s Time spent in each stage of serving a request\n", name);
+  appendf(out, "# TYPE %s summary\n", name);
+  char label[64];
+  for (int s = 0; s < kStageCount; s++) {
+    for (std::size_t q = 0; q < sizeof(kQuantiles) / sizeof(kQuantiles[0]); q++) {
+      std::snprintf(label, sizeof(label), "{stage=\"%s\",quantile=\"%g\"}", kStageNames[s],
+                    kQuantiles[q]);
+      appendf(out, "%s%s %.9f\n", name, label, stages[s].percentile(kQuantiles[q] * 100) / 1e9);
+    }
+    std::snprintf(label, sizeof(label), "{stage=\"%s\"}", kStageNames[s]);
+    appendf(out, "%s_sum%s %.9f\n", name, label, sums[s] / 1e9);
+    appendf(out, "%s_count%s %llu\n", name, label, (unsigned long long)stages[s].count());
+  }
+
+  name = "dashboard_stage_max_seconds";
+  appendf(out, "# HELP %s Slowest of each stage since the server started\n", name);
+  appendf(out, "# TYPE %s gauge\n", name);
+  for (int s = 0; s < kStageCount; s++) {
+    std::snprintf(label, sizeof(label), "{stage=\"%s\"}", kStageNames[s]);
+    appendf(out, "%s%s %.9f\n", name, label, stages[s].max() / 1e9);
+  }
+}
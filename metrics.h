@@ -0,0 +1,100 @@
+#ifndef SCOREBOARD_METRICS_H
+#define SCOREBOARD_METRICS_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "histogram.h"
+
+// Where a request's time goes, from accept() to the last byte sent
+enum MetricStage {
+  kStageAccept,   // accept4() of one connection
+  kStageRead,     // Draining a readable socket
+  kStageParse,    // HttpParser::parse() of one request
+  kStageResponse, // Routing it and queueing the reply
+  kStageSend,     // One sendmsg() of queued output
+  kStageCount
+};
+
+enum MetricCounter {
+  kAccepted,
+  kClosed,
+  kRequests,
+  kBadRequests, // Requests the parser rejected
+  kBytesIn,
+  kBytesOut,
+  kCounterCount
+};
+
+// Nanoseconds on the monotonic clock, for timing stages
+inline std::uint64_t metricsClock() {
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<std::uint64_t>(ts.tv_sec) * 1000000000ull + ts.tv_nsec;
+}
+
+// One thread's counters and per stage latency histograms (in nanoseconds,
+// on LogLinearHistogram's buckets). Only the owning thread writes, so an
+// update is a plain load and store with no locked instruction or fence;
+// the atomics only let MetricsRegistry read them from another thread.
+class ThreadMetrics {
+ public:
+  ThreadMetrics();
+
+  void add(MetricCounter counter, std::uint64_t n) { bump(counters_[counter], n); }
+
+  void record(MetricStage stage, std::uint64_t nanos) {
+    Stage& s = stages_[stage];
+    bump(s.buckets[LogLinearHistogram::bucketOf(nanos)], 1);
+    bump(s.sum, nanos);
+    if (nanos > s.max.load(std::memory_order_relaxed)) {
+      s.max.store(nanos, std::memory_order_relaxed);
+    }
+  }
+
+  // Records the time since `start` (from metricsClock()) and returns now
+  std::uint64_t recordSince(MetricStage stage, std::uint64_t start) {
+    std::uint64_t now = metricsClock();
+    record(stage, now - start);
+    return now;
+  }
+
+ private:
+  friend class MetricsRegistry;
+
+  struct Stage {
+    std::atomic<std::uint64_t> buckets[LogLinearHistogram::kBuckets];
+    std::atomic<std::uint64_t> sum;
+    std::atomic<std::uint64_t> max;
+  };
+
+  static void bump(std::atomic<std::uint64_t>& value, std::uint64_t n) {
+    value.store(value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+  }
+
+  std::atomic<std::uint64_t> counters_[kCounterCount];
+  Stage stages_[kStageCount];
+};
+
+// Hands out a ThreadMetrics to each worker and merges them all on demand.
+// Threads' metrics live as long as the registry, so totals never go back.
+class MetricsRegistry {
+ public:
+  // A new set of metrics for the calling thread to record into
+  ThreadMetrics& add();
+
+  // Appends every counter and stage in Prometheus' text format
+  void render(std::string& out) const;
+
+ private:
+  mutable std::mutex mutex_;
+  std::vector<std::unique_ptr<ThreadMetrics> > threads_;
+};
+
+#endif // SCOREBOARD_METRICS_H
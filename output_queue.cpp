@@ -0,0 +1,89 @@
+#include "output_queue.h"
+
+void OutputQueue::append(const char* data, std::size_t size) {
+  if (size == 0) return;
+
+  // Grow the last segment if it already ends at the tail of owned_
+  if (segments_.size() > head_) {
+    Segment& last = segments_.back();
+    if (!last.owner && last.offset + last.size == owned_.size()) {
+      owned_.append(data, size);
+      last.size += size;
+      pending_ += size;
+      return;
+    }
+  }
+
+  Segment seg;
+  seg.data = nullptr;
+  seg.offset = owned_.size();
+  seg.size = size;
+  owned_.append(data, size);
+  segments_.push_back(seg);
+  pending_ += size;
+}
+
+void OutputQueue::appendShared(const std::shared_ptr<const void>& owner, const char* data,
+                               std::size_t size) {
+  if (size == 0) return;
+
+  Segment seg;
+  seg.owner = owner;
+  seg.data = data;
+  seg.offset = 0;
+  seg.size = size;
+  segments_.push_back(seg);
+  pending_ += size;
+}
+
+int OutputQueue::gather(iovec* iov, int max) const {
+  int count = 0;
+  for (std::size_t i = head_; i < segments_.size() && count < max; i++) {
+    const Segment& seg = segments_[i];
+    const char* base = seg.owner ? seg.data : owned_.data() + seg.offset;
+    iov[count].iov_base = const_cast<char*>(base);
+    iov[count].iov_len = seg.size;
+    count++;
+  }
+  return count;
+}
+
+int OutputQueue::gatherStable(iovec* iov, int max, std::string& copy) const {
+  int count = gather(iov, max);
+  std::size_t owned = 0;
+  for (int i = 0; i < count; i++) {
+    if (!segments_[head_ + i].owner) owned += iov[i].iov_len;
+  }
+  copy.clear();
+  copy.reserve(owned); // No reallocation below, so earlier entries stay put
+  for (int i = 0; i < count; i++) {
+    if (segments_[head_ + i].owner) continue;
+    std::size_t at = copy.size();
+    copy.append(static_cast<const char*>(iov[i].iov_base), iov[i].iov_len);
+    iov[i].iov_base = &copy[at];
+  }
+  return count;
+}
+
+void OutputQueue::consume(std::size_t n) {
+  pending_ -= n;
+  while (n > 0) {
+    Segment& seg = segments_[head_];
+    if (n < seg.size) {
+      if (seg.owner) seg.data += n;
+      else seg.offset += n;
+      seg.size -= n;
+      return;
+    }
+    n -= seg.size;
+    seg.owner.reset();
+    head_++;
+  }
+
+  if (head_ == segments_.size()) {
+    // Everything went out; keep the capacity for the next reply
+    segments_.clear();
+    owned_.clear();
+    head_ = 0;
+  }
+}
@@ -0,0 +1,49 @@
+#ifndef SCOREBOARD_OUTPUT_QUEUE_H
+#define SCOREBOARD_OUTPUT_QUEUE_H
+
+#include <sys/uio.h> // For iovec
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Bytes waiting to be sent on a connection, in order.
+//
+// Small replies built per request are copied into a buffer the queue owns.
+// Large shared replies (the pre-rendered dashboard snapshot) are queued by
+// reference instead: the queue just holds on to the owner until the bytes
+// are on the wire, and the whole lot goes out in one sendmsg().
+class OutputQueue {
+ public:
+  OutputQueue() : head_(0), pending_(0) {}
+
+  void append(const char* data, std::size_t size);
+  void append(const char* s) { append(s, std::char_traits<char>::length(s)); }
+  void appendShared(const std::shared_ptr<const void>& owner, const char* data, std::size_t size);
+
+  bool empty() const { return pending_ == 0; }
+  std::size_t pending() const { return pending_; }
+
+  // Fills `iov` with up to `max` entries describing the unsent bytes
+  int gather(iovec* iov, int max) const;
+  // gather() for sends that complete later: owned bytes are copied into
+  // `copy`, so the entries stay valid however the queue grows meanwhile
+  int gatherStable(iovec* iov, int max, std::string& copy) const;
+  // Drops `n` bytes from the front after a successful send
+  void consume(std::size_t n);
+
+ private:
+  struct Segment {
+    std::shared_ptr<const void> owner; // Null for bytes stored in owned_
+    const char* data;                  // Shared bytes
+    std::size_t offset;                // Start within owned_ for owned bytes
+    std::size_t size;
+  };
+
+  std::string owned_;
+  std::vector<Segment> segments_;
+  std::size_t head_;    // First segment with bytes left
+  std::size_t pending_; // Unsent bytes in total
+};
+
+#endif // SCOREBOARD_OUTPUT_QUEUE_H
@@ -0,0 +1,78 @@
+#include "push.h"
+
+#include <sys/eventfd.h> // For eventfd
+#include <cerrno>        // For errno
+#include <cstdlib>       // For exit() and EXIT_FAILURE
+#include <iostream>      // For cout
+#include <unistd.h>      // For close
+
+#include "dashboard_wire.h"
+
+namespace {
+
+// No Content-Length: the body is the stream itself and ends when either side
+// closes the connection
+const char kTextStreamHeader[] =
+    "HTTP/1.1 200 OK\r\n"
+    "Content-Type: text/plain\r\n"
+    "Cache-Control: no-cache\r\n"
+    "Connection: close\r\n\r\n";
+const char kBinaryStreamHeader[] =
+    "HTTP/1.1 200 OK\r\n"
+    "Content-Type: " DBW_CONTENT_TYPE "\r\n"
+    "Cache-Control: no-cache\r\n"
+    "Connection: close\r\n\r\n";
+
+} // namespace
+
+PushHub::PushHub(EventLoop& loop, SnapshotPublisher& publisher, SnapshotReader& reader)
+    : loop_(loop), publisher_(publisher), reader_(reader) {
+  wakeFd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (wakeFd_ < 0) {
+    std::cout << "Failed to create eventfd. errno: " << errno << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  publisher.addWakeup(wakeFd_);
+  loop.watch(wakeFd_, [this]() { onPublish(); });
+  loop.addTick([this](std::time_t now) { onTick(now); });
+}
+
+PushHub::~PushHub() {
+  publisher_.removeWakeup(wakeFd_);
+  close(wakeFd_);
+}
+
+void PushHub::subscribe(const HttpRequest& req, Connection& conn) {
+  conn.pushBinary = wantsBinary(req);
+  conn.out.append(conn.pushBinary ? kBinaryStreamHeader : kTextStreamHeader);
+  if (req.method == "HEAD") {
+    conn.closeAfterWrite = true;
+    return;
+  }
+
+  const std::shared_ptr<const Snapshot>& snap = reader_.get();
+  const std::string& frame = snap->format(conn.pushBinary).frame;
+  conn.out.appendShared(snap, frame.data(), frame.size());
+  conn.subscribed = true;
+  conn.pushedVersion = snap->version;
+}
+
+void PushHub::onPublish() {
+  eventfd_t ignored;
+  eventfd_read(wakeFd_, &ignored);
+
+  // Several publishes may have landed since the wakeup; only the latest counts
+  const std::shared_ptr<const Snapshot>& snap = reader_.get();
+  loop_.broadcast([&snap](Connection& conn) {
+    if (!conn.subscribed || conn.pushedVersion == snap->version) return;
+    const std::string& frame = snap->format(conn.pushBinary).frame;
+    conn.out.appendShared(snap, frame.data(), frame.size());
+    conn.pushedVersion = snap->version;
+  });
+}
+
+void PushHub::onTick(std::time_t now) {
+  loop_.broadcast([now](Connection& conn) {
+    if (conn.subscribed && now - conn.lastActive >= kHeartbeatSeconds) conn.out.append("\n", 1);
+  });
+}
@@ -0,0 +1,39 @@
+#ifndef SCOREBOARD_PUSH_H
+#define SCOREBOARD_PUSH_H
+
+#include <ctime>
+
+#include "event_loop.h"
+#include "http_parser.h"
+#include "snapshot.h"
+
+// Streams dashboard updates to subscribed scoreboards on one event loop.
+//
+// A scoreboard sends "GET /gp/subscribe" once and keeps the connection open.
+// It gets the current payload straight away and then one more line each
+// time the stats change, in the same "|$|...|" format it polls for (or as
+// dashboard_wire.h frames if its Accept header asks for them). A bare newline
+// is sent when nothing has changed for a while so both ends can tell the
+// connection is still alive; binary readers skip it while looking for the
+// next frame's magic byte.
+class PushHub {
+ public:
+  static const int kHeartbeatSeconds = 20;
+
+  PushHub(EventLoop& loop, SnapshotPublisher& publisher, SnapshotReader& reader);
+  ~PushHub();
+
+  // Route handler for the subscribe endpoint
+  void subscribe(const HttpRequest& req, Connection& conn);
+
+ private:
+  void onPublish();
+  void onTick(std::time_t now);
+
+  EventLoop& loop_;
+  SnapshotPublisher& publisher_;
+  SnapshotReader& reader_;
+  int wakeFd_;
+};
+
+#endif // SCOREBOARD_PUSH_H
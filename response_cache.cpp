@@ -0,0 +1,126 @@
+#include "response_cache.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <fstream>
+
+MappedBody::~MappedBody() {
+  if (data_) munmap(data_, size_);
+}
+
+bool MappedBody::map(const std::string& path) {
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) return false;
+
+  struct stat st;
+  if (fstat(fd, &st) < 0) {
+    close(fd);
+    return false;
+  }
+  if (data_) munmap(data_, size_);
+  data_ = nullptr;
+  size_ = static_cast<std::size_t>(st.st_size);
+
+  // mmap() refuses empty files; an empty body needs no mapping anyway
+  if (size_ > 0) {
+    void* p = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (p == MAP_FAILED) {
+      close(fd);
+      size_ = 0;
+      return false;
+    }
+    madvise(p, size_, MADV_SEQUENTIAL); // It is read once, front to back
+    data_ = static_cast<char*>(p);
+  }
+  close(fd); // The mapping keeps the file alive
+  return true;
+}
+
+ResponseCache::ResponseCache(const std::string& dir) : dir_(dir) {
+  mkdir(dir_.c_str(), 0755); // Fine if it already exists
+}
+
+std::string ResponseCache::pathFor(const std::string& url) const {
+  // FNV-1a; the URL is stored in the entry too, so a collision is a miss
+  std::uint64_t hash = 14695981039346656037ull;
+  for (std::size_t i = 0; i < url.size(); i++) {
+    hash = (hash ^ static_cast<unsigned char>(url[i])) * 1099511628211ull;
+  }
+  char name[17];
+  std::snprintf(name, sizeof(name), "%016llx", static_cast<unsigned long long>(hash));
+  return dir_ + "/" + name;
+}
+
+CacheValidators ResponseCache::validators(const std::string& url) const {
+  CacheValidators result;
+  std::string base = pathFor(url);
+  std::ifstream meta((base + ".meta").c_str());
+  std::string cachedUrl;
+  if (!std::getline(meta, cachedUrl) || cachedUrl != url) return result;
+  if (access((base + ".body").c_str(), R_OK) != 0) return result;
+
+  std::getline(meta, result.etag);
+  std::getline(meta, result.lastModified);
+  return result;
+}
+
+bool ResponseCache::mapBody(const std::string& url, MappedBody& body) const {
+  return body.map(pathFor(url) + ".body");
+}
+
+void ResponseCache::remove(const std::string& url) const {
+  std::string base = pathFor(url);
+  unlink((base + ".meta").c_str());
+  unlink((base + ".body").c_str());
+}
+
+void ResponseCache::Writer::begin(const ResponseCache& cache, const std::string& url) {
+  abort();
+  base_ = cache.pathFor(url);
+  url_ = url;
+  file_ = std::fopen((base_ + ".tmp").c_str(), "wb");
+  failed_ = file_ == nullptr;
+}
+
+void ResponseCache::Writer::write(const char* data, std::size_t size) {
+  if (failed_ || !file_) return;
+  if (std::fwrite(data, 1, size, file_) != size) failed_ = true;
+}
+
+bool ResponseCache::Writer::commit(const CacheValidators& validators) {
+  if (!file_) return false;
+  bool ok = std::fclose(file_) == 0 && !failed_;
+  file_ = nullptr;
+  std::string tmp = base_ + ".tmp";
+  if (!ok) {
+    unlink(tmp.c_str());
+    return false;
+  }
+
+  // Drop the old validators first: a crash part way through must never pair
+  // them with the new body
+  std::string meta = base_ + ".meta";
+  unlink(meta.c_str());
+  if (std::rename(tmp.c_str(), (base_ + ".body").c_str()) != 0) {
+    unlink(tmp.c_str());
+    return false;
+  }
+
+  {
+    std::ofstream out((meta + ".tmp").c_str(), std::ios::trunc);
+    out << url_ << '\n' << validators.etag << '\n' << validators.lastModified << '\n';
+    if (!out) return false;
+  }
+  return std::rename((meta + ".tmp").c_str(), meta.c_str()) == 0;
+}
+
+void ResponseCache::Writer::abort() {
+  if (!file_) return;
+  std::fclose(file_);
+  file_ = nullptr;
+  unlink((base_ + ".tmp").c_str());
+}
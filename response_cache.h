@@ -0,0 +1,81 @@
+#ifndef SCOREBOARD_RESPONSE_CACHE_H
+#define SCOREBOARD_RESPONSE_CACHE_H
+
+#include <cstddef>
+#include <cstdio>
+#include <string>
+
+// A cached body mapped read-only into memory. Unmapped when destroyed.
+class MappedBody {
+ public:
+  MappedBody() : data_(nullptr), size_(0) {}
+  ~MappedBody();
+  MappedBody(const MappedBody&) = delete;
+  MappedBody& operator=(const MappedBody&) = delete;
+
+  bool map(const std::string& path);
+  const char* data() const { return data_; }
+  std::size_t size() const { return size_; }
+
+ private:
+  char* data_;
+  std::size_t size_;
+};
+
+// What the cache remembers about a response, to revalidate it with
+struct CacheValidators {
+  std::string etag;          // Sent back as If-None-Match
+  std::string lastModified;  // Sent back as If-Modified-Since
+
+  bool empty() const { return etag.empty() && lastModified.empty(); }
+};
+
+// On-disk cache of GET responses for conditional requests.
+//
+// Each URL gets a body file and a small metadata file holding its
+// validators, both named after a hash of the URL. Bodies are written while
+// they stream in and only replace the cached copy (by rename) once the
+// response has been accepted, so an interrupted download never corrupts an
+// entry. Different URLs can be used from different threads at once; the same
+// URL must not be.
+class ResponseCache {
+ public:
+  explicit ResponseCache(const std::string& dir);
+
+  // Validators for `url`, empty if nothing usable is cached
+  CacheValidators validators(const std::string& url) const;
+
+  // Maps the cached body for `url`, after a 304
+  bool mapBody(const std::string& url, MappedBody& body) const;
+
+  // Forgets `url`, e.g. when the server stopped sending validators
+  void remove(const std::string& url) const;
+
+  // Collects one response body and installs it if commit() is called
+  class Writer {
+   public:
+    Writer() : file_(nullptr), failed_(false) {}
+    ~Writer() { abort(); }
+    Writer(const Writer&) = delete;
+    Writer& operator=(const Writer&) = delete;
+
+    // Starts over, dropping anything an earlier attempt wrote
+    void begin(const ResponseCache& cache, const std::string& url);
+    void write(const char* data, std::size_t size);
+    bool commit(const CacheValidators& validators);
+    void abort();
+
+   private:
+    std::string base_;
+    std::string url_;
+    std::FILE* file_;
+    bool failed_;
+  };
+
+ private:
+  std::string pathFor(const std::string& url) const;
+
+  std::string dir_;
+};
+
+#endif // SCOREBOARD_RESPONSE_CACHE_H
@@ -24,8 +24,29 @@
 // Example feedback from server:   "|$|1|1|0|51|36|2|2|1|"
 
 // Library includes
+#include <Arduino.h>                      // The IDE only adds this to .ino sketches
 #include "ESP8266.h"                      // For interfacing with the ESP8266 chip
 #include "LedControl.h"                   // LED Control library (http://playground.arduino.cc/Main/LedControl)
+#include "dashboard_wire.h"               // Compact binary stats frames, shared with the server
+#include "dashboard_parser.h"             // Streaming parser for server responses, shared with the server
+
+// Function prototypes (also only generated for .ino sketches)
+void displayMatrix(int disp, int img, bool dp);
+void setFbRow(int disp, int row, byte value);
+void clearFb(int disp);
+void setFbChar(int disp, int digit, char c, bool dp);
+void flushDisplay();
+void setLEDIndicator(int which, int red, int green, int blue);
+void updateView(int whichView);
+int splitDigits(long value, char* digits);
+void formatValue(long value, char* cells, bool* dps);
+bool timeReached(unsigned long at);
+void stepFetch();
+const char* fetchRequest();
+void fetchFailed();
+int8_t checkStream(uint8_t c);
+void applyStats(const int32_t* values);
+void showStatus();
 
 // Globals
 LedControl display = LedControl(A2,A1,A0,6);  // Our daisy-chained 2 LED displays
@@ -45,6 +66,15 @@ const char *PASSWORD = "PUT WIFI PASSWORD HERE";
 
 #define STATUS_LIGHTS
 #define DIGITAL_LEDS
+#define BINARY_STATS                // Ask the server for binary frames (dashboard_wire.h) rather than "|$|...|" text
+#define PUSH_UPDATES                // Keep one connection open and let the server push changes (falls back to polling)
+#define PUSH_TIMEOUT        45000   // Resubscribe if the server goes quiet for this long (it sends a heartbeat every 20s)
+#define CONDITIONAL_POLLS           // Send the last ETag with each poll, so unchanged stats come back as a bodyless 304
+#define RECV_WAIT           20      // Longest one step waits for bytes, so the views keep rotating
+#define RECEIVE_TIMEOUT     5000    // Give up on a polled response that hasn't arrived in this long
+#define BACKOFF_MIN         2000    // Wait this long after a failed fetch...
+#define BACKOFF_MAX         60000   // ...doubling with every failure in a row, up to this
+#define WIFI_RESTART_FAILURES 4     // Failures in a row before we restart the ESP8266
 //#define SERIAL_DEBUG
 
 // Globals
@@ -91,33 +121,134 @@ const uint64_t IMAGES[] = {
   0x49db49e08fe121ef,
   0x49db49e08fe929e7,
   0x0000b8a8a8a8b800,
-  0x0000140211121400
+  0x0000140211121400,
+  0x66361e3666060600,
+  0x4242425a7e664200,
+  0x0000007e7e000000
 };
 const int IMAGES_LEN = sizeof(IMAGES)/8;
 
+#define IMAGE_K     22    // Units for abbreviated values: thousands...
+#define IMAGE_M     23    // ...and millions
+#define IMAGE_DASH  24    // No data
+
+// Shadow framebuffer for the daisy chain: one byte per row of each matrix, or
+// per digit of each 7-segment display, laid out the way the MAX7219 registers
+// hold them. Drawing only changes g_fb; flushDisplay() then sends just the rows
+// that changed, so a digit that stays the same costs nothing and a whole matrix
+// is 8 row writes rather than 64 setLed() calls.
+#define DEVICES 6
+byte g_fb[DEVICES][8];
+byte g_fbDirty[DEVICES];          // Bit n set: row n differs from what the device shows
+
+// 7-segment patterns for the characters we show, in LedControl's bit order (DP A B C D E F G)
+byte segmentsFor(char c)
+{
+  static const byte DIGITS[10] = {
+    B01111110, B00110000, B01101101, B01111001, B00110011,
+    B01011011, B01011111, B01110000, B01111111, B01111011
+  };
+  if(c >= '0' && c <= '9') return DIGITS[c - '0'];
+  if(c == '-') return B00000001;
+  if(c == 'k') return B01010111;
+  if(c == 'M') return B01110110;
+  return 0;   // ' ' and anything we have no pattern for
+}
 
-// Our bits of data from the remote server - all pre-set to -1, which means no data
-int state_s1 = -1;
-int state_s2 = -1;
-int state_cj = -1;
-int state_acu = -1;
-int state_acs = -1;
-int state_dacu = -1;
-int state_dacs = -1;
+
+// Our bits of data from the remote server - all pre-set to -1, which means no data.
+// int32_t like the parser's values: an int is only 16 bits on the Mega.
+int32_t state_s1 = -1;
+int32_t state_s2 = -1;
+int32_t state_cj = -1;
+int32_t state_acu = -1;
+int32_t state_acs = -1;
+int32_t state_dacu = -1;
+int32_t state_dacs = -1;
 
 bool csuccess = false;
-bool success = false;
-unsigned long millis_last_page_grab;
 unsigned long millis_last_view_change;
 
-// Different views
-#define VIEW__CURRENT_USERS     0
-#define VIEW__DAILY_USERS       1
-#define VIEW__CURRENT_SYSTEMS   2
-#define VIEW__DAILY_SYSTEMS     3
+DashboardParser g_parser;         // Where we are in the response being received (a few bytes, not a buffer)
+
+// Fetching is a state machine that loop() moves on one short step at a time,
+// so however slow the server or the network the views never stop rotating
+#define FETCH_WIFI_INIT   0   // (Re)starting the ESP8266 and joining the network
+#define FETCH_IDLE        1   // Waiting until it is time for the next fetch
+#define FETCH_CONNECT     2   // Opening the TCP connection
+#define FETCH_SEND        3   // Sending the request
+#define FETCH_RECEIVE     4   // Feeding the response to the parser as it arrives
+#define FETCH_PARSE       5   // The parser has a complete set of stats for us (or a 304: nothing changed)
+
+int g_fetchState = FETCH_WIFI_INIT;
+unsigned long g_fetchNextAt;      // When IDLE (or WIFI_INIT after a failure) may start again
+unsigned long g_fetchStarted;     // When the request went out
+unsigned long g_backoff = BACKOFF_MIN;
+int g_failures = 0;               // Failed fetches in a row
+bool g_unchanged = false;         // The server said our stats are still current (304)
+
+#ifdef CONDITIONAL_POLLS
+uint32_t g_etag = 0;              // ETag of the stats on show, 0 if we don't know it
+char g_request[160];              // A poll with If-None-Match is built here
+#endif
+
+int g_packetLen = 0;              // Bytes of the last packet in wifi.m_responseBuffer, and how far
+int g_packetPos = 0;              // the parser got in them
+
+#ifdef PUSH_UPDATES
+bool g_subscribing = false;       // Is this fetch a subscription (kept open) rather than one poll?
+bool g_pushFailed = false;        // The last subscription failed: poll once before trying again
+unsigned long millis_last_push;   // Last time the server sent us anything
+bool g_pushed = false;            // This subscription has brought us stats
+int8_t g_stream = 0;              // Its reply is a stream (1), or we are still reading the headers (0)
+uint8_t g_statusPos;              // checkStream() matching state for the reply's headers
+uint8_t g_lengthMatch;
+uint8_t g_endMatch;
+bool g_hasLength;
+#define STREAM_STATUS "HTTP/1.1 200 "
+#endif
+
+// A number shown in CELLS characters: across four matrices, or on four
+// digits of a 7-segment display
+#define CELLS 4
+
+// The views the matrices rotate through. The number goes across the four
+// matrices from `firstDevice` down; when it leaves the leftmost one free,
+// that shows `icon` to say what the number is.
+struct View
+{
+  const int32_t* value;
+  byte icon;
+  byte firstDevice;
+};
+
+const View VIEWS[] = {
+  { &state_acu,  16, 3 },   // Current users (in last 60 seconds)
+  { &state_dacu, 17, 3 },   // Daily users (since 00:00)
+  { &state_acs,  18, 3 },   // Active systems (in last 60 seconds)
+  { &state_dacs, 19, 3 },   // Daily active systems (since 00:00)
+};
+const int VIEWS_LEN = sizeof(VIEWS)/sizeof(VIEWS[0]);
+
+// The numbers that are always on the 7-segment displays, from digit
+// `firstDigit` of `device` down
+struct Field
+{
+  const int32_t* value;
+  byte device;
+  byte firstDigit;
+};
+
+const Field FIELDS[] = {
+  { &state_dacs, 4, 7 },
+  { &state_dacu, 4, 3 },
+  { &state_acu,  5, 7 },
+  { &state_acs,  5, 3 },
+};
+const int FIELDS_LEN = sizeof(FIELDS)/sizeof(FIELDS[0]);
 
 // Current view
-int g_currentView = VIEW__CURRENT_USERS;
+int g_currentView = 0;
 
 //////////////////////////////////////////////////////////////////////////////////
 //////////////////////////////////////////////////////////////////////////////////
@@ -143,7 +274,7 @@ void setup(void)
   pinMode(blue3Pin, OUTPUT); 
   #endif
 
-  // Setup our LED display components
+  // Setup our LED display components (clearDisplay() matches our all-zero framebuffer)
   for(int a = 0; a < display.getDeviceCount(); a++)
   {
     display.clearDisplay(a);
@@ -152,23 +283,12 @@ void setup(void)
   }
 
   // Place some test data
-  display.setChar(4,0,'0',false);
-  display.setChar(4,1,'1',false);
-  display.setChar(4,2,'2',false);
-  display.setChar(4,3,'3',false);
-  display.setChar(4,4,'4',false);
-  display.setChar(4,5,'5',false);
-  display.setChar(4,6,'6',false);
-  display.setChar(4,7,'7',false);
-
-  display.setChar(5,0,'0',false);
-  display.setChar(5,1,'1',false);
-  display.setChar(5,2,'2',false);
-  display.setChar(5,3,'3',false);
-  display.setChar(5,4,'4',false);
-  display.setChar(5,5,'5',false);
-  display.setChar(5,6,'6',false);
-  display.setChar(5,7,'7',false);
+  for(int a = 0; a < 8; a++)
+  {
+    setFbChar(4, a, '0' + a, false);
+    setFbChar(5, a, '0' + a, false);
+  }
+  flushDisplay();
 
 
   // Set the lights to blue to show we are connecting to the wifi
@@ -176,57 +296,71 @@ void setup(void)
   setLEDIndicator(2, gLED_COLORINT, gLED_COLORINT, gLED_COLORINT);  // blue
   setLEDIndicator(3, gLED_COLORINT, gLED_COLORINT, gLED_COLORINT);  // blue
 
-  // Setup WiFi
-  if (!wifi.init(SSID, PASSWORD, 9600))
-  {
-    #ifdef SERIAL_DEBUG
-        Serial.println("Wifi Init failed. Check configuration.");
-    #endif
-
-    setLEDIndicator(1, gLED_COLORINT, gLED_COLORINT, 0);  // error
-    setLEDIndicator(2, gLED_COLORINT, gLED_COLORINT, 0);  // error
-    setLEDIndicator(3, gLED_COLORINT, gLED_COLORINT, 0);  // error
-
-    // If we have a wifi error - then ask for reset
-    displayMatrix(0, 10);
-    displayMatrix(1, 10);
-    displayMatrix(2, 10);
-    displayMatrix(3, 10);
-
-    delay(5000);
-    asm volatile ("  jmp 0");     // Reset the program (not ideal but probably just about does the trick)
-    
-    while (true) ; // loop eternally
-  }
-  
-  // To get us going, grab the data
-  getPage();
+  // The WiFi is set up, and the first data grabbed, by the first few loop()s
+  g_fetchState = FETCH_WIFI_INIT;
+  g_fetchNextAt = millis();
 
   return;
 }
 
 //////////////////////////////////////////////////////////////////////////////////
 //////////////////////////////////////////////////////////////////////////////////
-void displayMatrix(int disp, int img) // display an image from the IMAGES array (created using https://xantorohara.github.io/led-matrix-editor/)
+void displayMatrix(int disp, int img, bool dp) // display an image from the IMAGES array (created using https://xantorohara.github.io/led-matrix-editor/)
 {
-  if(img < 0 || img > IMAGES_LEN) return;   // Return without doing anything if we are out of range
+  if(img < 0 || img >= IMAGES_LEN) return;   // Return without doing anything if we are out of range
 
   uint64_t image = IMAGES[img]; // Read in our image from the array
 
-  // Loop through each LED in the matrix (note: we also specify which of our displays we are setting)
+  // The editor puts column j in bit j, the matrix wants it in bit 7-j
   for (int i = 0; i < 8; i++) 
   {
     byte row = (image >> i * 8) & 0xFF;
-    
-    for (int j = 0; j < 8; j++) 
-    {
-      display.setLed(disp, i, j, bitRead(row, j));
-    }
+    if(dp && i == 7) row |= 0x80;   // The bottom right corner is free in every character
+    row = (row & 0xF0) >> 4 | (row & 0x0F) << 4;
+    row = (row & 0xCC) >> 2 | (row & 0x33) << 2;
+    row = (row & 0xAA) >> 1 | (row & 0x55) << 1;
+    setFbRow(disp, i, row);
   }
 
   return;
 }
 
+//////////////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////////
+void setFbRow(int disp, int row, byte value)  // change one row of the framebuffer, remembering if it needs sending
+{
+  if(g_fb[disp][row] == value) return;
+  g_fb[disp][row] = value;
+  g_fbDirty[disp] |= 1 << row;
+}
+
+void clearFb(int disp)  // blank a whole device
+{
+  for(int row = 0; row < 8; row++) setFbRow(disp, row, 0);
+}
+
+void setFbChar(int disp, int digit, char c, bool dp)  // a character on a 7-segment display
+{
+  setFbRow(disp, digit, segmentsFor(c) | (dp ? B10000000 : 0));
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////////
+void flushDisplay()  // send the rows that changed since the last flush
+{
+  for(int disp = 0; disp < DEVICES; disp++)
+  {
+    byte dirty = g_fbDirty[disp];
+    if(dirty == 0) continue;
+
+    for(int row = 0; row < 8; row++)
+    {
+      if(dirty & (1 << row)) display.setRow(disp, row, g_fb[disp][row]);
+    }
+    g_fbDirty[disp] = 0;
+  }
+}
+
 //////////////////////////////////////////////////////////////////////////////////
 //////////////////////////////////////////////////////////////////////////////////
 void setLEDIndicator(int which, int red, int green, int blue)
@@ -272,27 +406,15 @@ void loop(void)
       millis_last_view_change = millis();
 
       g_currentView++;
-      if(g_currentView > VIEW__DAILY_SYSTEMS) g_currentView = VIEW__CURRENT_USERS; // Reset to our first view
+      if(g_currentView >= VIEWS_LEN) g_currentView = 0; // Reset to our first view
 
       // Update the view
       updateView(g_currentView);
     }
 
 
-    // Grab a page every minute
-    if(millis() - millis_last_page_grab > REFRESH_TIME)
-    {
-      millis_last_page_grab = millis();
-
-      #ifdef BLUE_LOADING_LIGHTS
-      // set the colours to blue
-      setLEDIndicator(1, 0, 0, gLED_COLORINT);
-      setLEDIndicator(2, 0, 0, gLED_COLORINT);
-      setLEDIndicator(3, 0, 0, gLED_COLORINT);
-      #endif
-
-      success = getPage();
-    }
+    // Then one small step of fetching (or receiving pushed) data
+    stepFetch();
 
   return;
 }
@@ -302,257 +424,375 @@ void loop(void)
 void updateView(int whichView)
 {
   if(g_nightmode == 1) return;
-  
-  int ths = 0;
-  int hun = 0;
-  int ten = 0;
-  int dig = 0;
 
-  if(whichView == VIEW__CURRENT_USERS)
+  const View& view = VIEWS[whichView];
+  char cells[CELLS];
+  bool dps[CELLS];
+  formatValue(*view.value, cells, dps);
+
+  for(int c = 0; c < CELLS; c++)
   {
-      // Current users (in last 60 seconds)
+    int disp = view.firstDevice - c;
+    char cell = cells[c];
+
+    if(cell >= '0' && cell <= '9') displayMatrix(disp, cell - '0', dps[c]);
+    else if(cell == 'k') displayMatrix(disp, IMAGE_K, false);
+    else if(cell == 'M') displayMatrix(disp, IMAGE_M, false);
+    else if(cell == '-') displayMatrix(disp, IMAGE_DASH, false);
+    else if(c == 0) displayMatrix(disp, view.icon, false); // a free leftmost matrix says what we are showing
+    else clearFb(disp); // or blank
+  }
 
-      // Work out the digit for each column (we have a max of 9999 - more users than that and I'll need to make a new dashboard!)
-      ths = state_acu / 1000;
-      hun = (state_acu - (ths * 1000)) / 100;
-      ten = (state_acu - (ths * 1000) - (hun * 100)) / 10;
-      dig = (state_acu - (ths * 1000) - (hun * 100) - (ten * 10));
+  flushDisplay();
 
-      // If we have thousands, then show them, otherwise we show an explanation icon
-      if(ths != 0)
-      {
-        displayMatrix(3, ths);
-      }
-      else
-      {
-        // our image for the info
-        displayMatrix(3, 16);
-      }
+return;  
+}
 
-      // 100s
-      if(hun != 0)
-      {
-        display.shutdown(2, false);
-        displayMatrix(2, hun);
-      }
-      else display.clearDisplay(2); // or blank
+//////////////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////////
+// Powers of ten for splitting numbers into digits by repeated subtraction: the
+// AVR has no divide instruction, and a 32 bit division is a slow library call
+const long POW10[] = {
+  1000000000L, 100000000L, 10000000L, 1000000L, 100000L, 10000L, 1000L, 100L, 10L, 1L
+};
 
-      // 10s
-      if(ten != 0)
-      {
-        display.shutdown(1, false);
-        displayMatrix(1, ten);
-      }
-      else display.clearDisplay(1); // or blank
+int splitDigits(long value, char* digits)  // `value` (>= 0) as '0'-'9', most significant first, no leading zeros. Returns how many (at most 10)
+{
+  int n = 0;
+  for(int p = 0; p < 10; p++)
+  {
+    char d = '0';
+    while(value >= POW10[p])
+    {
+      value -= POW10[p];
+      d++;
+    }
+    if(n > 0 || d != '0' || p == 9) digits[n++] = d;
+  }
+  return n;
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////////
+void formatValue(long value, char* cells, bool* dps)  // lay a number out right-aligned in CELLS characters
+{
+  for(int c = 0; c < CELLS; c++)
+  {
+    cells[c] = ' ';
+    dps[c] = false;
+  }
 
-      // 0s (we always display this data)
-      displayMatrix(0, dig);
+  if(value < 0)   // no data
+  {
+    cells[CELLS - 1] = '-';
+    return;
+  }
 
+  char digits[10];
+  int n = splitDigits(value, digits);
+  if(n <= CELLS)
+  {
+    for(int a = 0; a < n; a++) cells[CELLS - n + a] = digits[a];
+    return;
   }
-  if(whichView == VIEW__DAILY_USERS)
+
+  if(n > 9)   // a billion or more - we won't be needing that
   {
-      // Daily users (since 00:00)
+    for(int c = 0; c < CELLS; c++) cells[c] = '-';
+    return;
+  }
 
-      // Work out the digit for each column (we have a max of 9999 - more users than that and I'll need to make a new dashboard!)
-      ths = state_dacu / 1000;
-      hun = (state_dacu - (ths * 1000)) / 100;
-      ten = (state_dacu - (ths * 1000) - (hun * 100)) / 10;
-      dig = (state_dacu - (ths * 1000) - (hun * 100) - (ten * 10));
+  // Too long: three significant digits and a unit, with a decimal point
+  // after the whole part, e.g. 12345 is "12.3k" and 1234567 is "1.23M"
+  int exponent = n > 6 ? 6 : 3;
+  int whole = n - exponent;
+  for(int c = 0; c < CELLS - 1; c++) cells[c] = digits[c];
+  if(whole < CELLS - 1) dps[whole - 1] = true;
+  cells[CELLS - 1] = exponent == 6 ? 'M' : 'k';
+}
 
-      // If we have thousands, then show them, otherwise we show an explanation icon
-      if(ths != 0)
-      {
-        displayMatrix(3, ths);
-      }
-      else
-      {
-        // our image for the info
-        displayMatrix(3, 17);
-      }
+//////////////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////////
+bool timeReached(unsigned long at)  // has millis() got to `at` yet? (safe across the 49 day wrap)
+{
+  return (long)(millis() - at) >= 0;
+}
 
-      // 100s
-      if(hun != 0)
-      {
-        display.shutdown(2, false);
-        displayMatrix(2, hun);
-      }
-      else display.clearDisplay(2); // or blank
+//////////////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////////
+void stepFetch()  // move the fetch on by one step - each step is one short call to the ESP8266
+{
+  switch(g_fetchState)
+  {
+    case FETCH_WIFI_INIT:
+      if(!timeReached(g_fetchNextAt)) return;
 
-      // 10s
-      if(ten != 0)
+      if(wifi.init(SSID, PASSWORD, 9600))
       {
-        display.shutdown(1, false);
-        displayMatrix(1, ten);
+        g_fetchState = FETCH_IDLE;
+        g_fetchNextAt = millis();
+        return;
       }
-      else display.clearDisplay(1); // or blank
-
-      // 0s (we always display this data)
-      displayMatrix(0, dig);
 
-  }
-  if(whichView == VIEW__CURRENT_SYSTEMS)
-  {
-      // Active systems (in last 60 seconds)
+#ifdef SERIAL_DEBUG
+      Serial.println("Wifi Init failed. Check configuration.");
+#endif
+      setLEDIndicator(1, gLED_COLORINT, gLED_COLORINT, 0);  // error
+      setLEDIndicator(2, gLED_COLORINT, gLED_COLORINT, 0);  // error
+      setLEDIndicator(3, gLED_COLORINT, gLED_COLORINT, 0);  // error
+      fetchFailed();
+      g_fetchState = FETCH_WIFI_INIT;  // Keep trying the WiFi itself
+      return;
+
+    case FETCH_IDLE:
+      if(!timeReached(g_fetchNextAt)) return;
+
+      g_oldnightmode = g_nightmode;
+#ifdef PUSH_UPDATES
+      // Subscribe if we can, but after a failed subscription poll once first
+      g_subscribing = !g_pushFailed;
+      g_pushFailed = false;
+#endif
 
-      // Work out the digit for each column (we have a max of 9999 - more users than that and I'll need to make a new dashboard!)
-      ths = state_acs / 1000;
-      hun = (state_acs - (ths * 1000)) / 100;
-      ten = (state_acs - (ths * 1000) - (hun * 100)) / 10;
-      dig = (state_acs - (ths * 1000) - (hun * 100) - (ten * 10));
+#ifdef BLUE_LOADING_LIGHTS
+      // set the colours to blue
+      setLEDIndicator(1, 0, 0, gLED_COLORINT);
+      setLEDIndicator(2, 0, 0, gLED_COLORINT);
+      setLEDIndicator(3, 0, 0, gLED_COLORINT);
+#endif
+      g_fetchState = FETCH_CONNECT;
+      return;
 
-      // If we have thousands, then show them, otherwise we show an explanation icon
-      if(ths != 0)
+    case FETCH_CONNECT:
+      wifi.releaseTCP();  // Whatever connection we had is finished with
+      if(!wifi.createTCP(SERVER_IP, SERVER_PORT))
       {
-        displayMatrix(3, ths);
+#ifdef SERIAL_DEBUG
+        Serial.println(F("create tcp - ERROR"));
+#endif
+        fetchFailed();
+        return;
       }
-      else
+      g_fetchState = FETCH_SEND;
+      return;
+
+    case FETCH_SEND:
+      if(!wifi.sendSingle(fetchRequest()))
       {
-        // our image for the info
-        displayMatrix(3, 18);
+#ifdef SERIAL_DEBUG
+        Serial.println(F("not sent"));
+#endif
+        fetchFailed();
+        return;
       }
-
-      // 100s
-      if(hun != 0)
+      dbpBegin(&g_parser);
+      g_packetLen = g_packetPos = 0;
+      g_fetchStarted = millis();
+#ifdef PUSH_UPDATES
+      millis_last_push = millis();
+      g_pushed = false;
+      g_stream = 0;
+      g_statusPos = g_lengthMatch = g_endMatch = 0;
+      g_hasLength = false;
+#endif
+      g_fetchState = FETCH_RECEIVE;
+      return;
+
+    case FETCH_RECEIVE:
+      // Feed the parser what is left of the last packet, or one new packet.
+      // recv() hands over one +IPD packet and throws away whatever of it
+      // doesn't fit, so it is given the library's whole buffer. The parser
+      // carries over between steps, so it doesn't matter where packets split.
+      if(g_packetPos == g_packetLen)
       {
-        display.shutdown(2, false);
-        displayMatrix(2, hun);
+        g_packetLen = wifi.recv(wifi.m_responseBuffer, MAX_BUFFER_SIZE, RECV_WAIT);
+        g_packetPos = 0;
+#ifdef PUSH_UPDATES
+        if(g_packetLen > 0) millis_last_push = millis();
+#endif
       }
-      else display.clearDisplay(2); // or blank
-
-      // 10s
-      if(ten != 0)
+      while(g_packetPos < g_packetLen)
       {
-        display.shutdown(1, false);
-        displayMatrix(1, ten);
+        uint8_t c = wifi.m_responseBuffer[g_packetPos++];
+#ifdef PUSH_UPDATES
+        if(g_subscribing && g_stream == 0)
+        {
+          g_stream = checkStream(c);
+          if(g_stream < 0)
+          {
+#ifdef SERIAL_DEBUG
+            Serial.println(F("subscription refused"));
+#endif
+            fetchFailed();  // Poll next time
+            return;
+          }
+        }
+#endif
+        int8_t result = dbpFeed(&g_parser, c);
+        if(result == DBP_DONE || result == DBP_NOT_MODIFIED)
+        {
+          g_unchanged = (result == DBP_NOT_MODIFIED);
+          g_fetchState = FETCH_PARSE;
+          return;
+        }
       }
-      else display.clearDisplay(1); // or blank
 
-      // 0s (we always display this data)
-      displayMatrix(0, dig);
-  }
-  if(whichView == VIEW__DAILY_SYSTEMS)
-  {
-      // Daily Active systems (since 00:00)
-
-      // Work out the digit for each column (we have a max of 9999 - more users than that and I'll need to make a new dashboard!)
-      ths = state_dacs / 1000;
-      hun = (state_dacs - (ths * 1000)) / 100;
-      ten = (state_dacs - (ths * 1000) - (hun * 100)) / 10;
-      dig = (state_dacs - (ths * 1000) - (hun * 100) - (ten * 10));
-
-      // If we have thousands, then show them, otherwise we show an explanation icon
-      if(ths != 0)
+#ifdef PUSH_UPDATES
+      // No heartbeat for too long - assume the subscription is dead and start
+      // another. One that never brought us stats failed, so poll first.
+      if(g_subscribing)
       {
-        displayMatrix(3, ths);
+        if(millis() - millis_last_push > PUSH_TIMEOUT)
+        {
+#ifdef SERIAL_DEBUG
+          Serial.println(F("subscription timed out"));
+#endif
+          if(!g_pushed)
+          {
+            fetchFailed();
+            return;
+          }
+          wifi.releaseTCP();
+          g_fetchState = FETCH_IDLE;
+          g_fetchNextAt = millis();
+        }
+        return;
       }
-      else
+#endif
+      if(millis() - g_fetchStarted > RECEIVE_TIMEOUT)
       {
-        // our image for the info
-        displayMatrix(3, 19);
+#ifdef SERIAL_DEBUG
+        Serial.println(F("no stats in response"));
+#endif
+        fetchFailed();
       }
+      return;
 
-      // 100s
-      if(hun != 0)
+    case FETCH_PARSE:
+      // Unchanged stats need no parsing and no redraw
+      if(!g_unchanged)
       {
-        display.shutdown(2, false);
-        displayMatrix(2, hun);
+        applyStats(g_parser.values);
+#ifdef CONDITIONAL_POLLS
+        g_etag = g_parser.etag;  // Pushed stats have none, so the next poll asks for everything
+#endif
       }
-      else display.clearDisplay(2); // or blank
+      g_failures = 0;
+      g_backoff = BACKOFF_MIN;
 
-      // 10s
-      if(ten != 0)
+#ifdef PUSH_UPDATES
+      // A subscription stays open for the next update
+      if(g_subscribing)
       {
-        display.shutdown(1, false);
-        displayMatrix(1, ten);
+        g_pushed = true;
+        g_fetchState = FETCH_RECEIVE;
+        return;
       }
-      else display.clearDisplay(1); // or blank
-
-      // 0s (we always display this data)
-      displayMatrix(0, dig);
+#endif
+      wifi.releaseTCP();
+      g_fetchState = FETCH_IDLE;
+      g_fetchNextAt = g_fetchStarted + REFRESH_TIME;  // Grab a page every minute
+      return;
   }
-
-
-return;  
 }
 
-
 //////////////////////////////////////////////////////////////////////////////////
 //////////////////////////////////////////////////////////////////////////////////
-int getPage()
+const char* fetchRequest()  // what we send: a subscription (no "Connection: close" - we want to keep it) or one poll
 {
-  millis_last_page_grab = millis(); // update the last time we went off to get a page
-
-  g_oldnightmode = g_nightmode;
-  
-  // The request
-  char* request =  "GET /gp/dbd.php HTTP/1.1\r\nHost: 192.168.1.112\r\nConnection: close\r\n\r\n";
-
-  // Connect to Server
-  if (wifi.createTCP(SERVER_IP, SERVER_PORT))
+#ifdef PUSH_UPDATES
+  if(g_subscribing)
   {
-
-  }
-  else
-  {
-#ifdef SERIAL_DEBUG
-    Serial.println(F("create tcp - ERROR"));
+#ifdef BINARY_STATS
+    return "GET /gp/subscribe HTTP/1.1\r\nHost: 192.168.1.112\r\nAccept: " DBW_CONTENT_TYPE "\r\n\r\n";
+#else
+    return "GET /gp/subscribe HTTP/1.1\r\nHost: 192.168.1.112\r\n\r\n";
 #endif
-    return "";
   }
-
-  if (!wifi.sendSingle(request))
-  {
-#ifdef SERIAL_DEBUG
-    Serial.print(F("not sent"));
 #endif
-    return 0;
-  }
-
-  int len = wifi.recv(wifi.m_responseBuffer, MAX_BUFFER_SIZE, 1000);
 
-char stats[255];
-char* stat = strstr((char*)wifi.m_responseBuffer,"|$|");
-char* s2 = stat + 3;
-#ifdef SERIAL_DEBUG
-Serial.println((char*)s2);
+#ifdef BINARY_STATS
+#define POLL_REQUEST "GET /gp/dbd.php HTTP/1.1\r\nHost: 192.168.1.112\r\nAccept: " DBW_CONTENT_TYPE "\r\n"
+#else
+#define POLL_REQUEST "GET /gp/dbd.php HTTP/1.1\r\nHost: 192.168.1.112\r\n"
 #endif
 
-// Read the data
-int cStat = 1; // which current stat
-char * pch;
-pch = strtok (s2,"|");
-state_s1 = atoi(pch);
+#ifdef CONDITIONAL_POLLS
+  if(g_etag != 0)  // "If-None-Match: "xxxxxxxx"" - the server answers 304 if the stats are the same
+  {
+    strcpy(g_request, POLL_REQUEST "If-None-Match: \"");
+    char* p = g_request + strlen(g_request);
+    for(int i = 7; i >= 0; i--)
+    {
+      *p++ = "0123456789abcdef"[(g_etag >> (i * 4)) & 0xF];
+    }
+    strcpy(p, "\"\r\nConnection: close\r\n\r\n");
+    return g_request;
+  }
+#endif
+  return POLL_REQUEST "Connection: close\r\n\r\n";
+}
 
+//////////////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////////
+void fetchFailed()  // back off before the next try, and restart the WiFi if failures keep coming
+{
+  wifi.releaseTCP();
 
-// ****** So this next bit walks through the response from the server and puts the numbers into variables, the server sends us the data split by | characters
-// ****** You could use this same technique in your dashboard, or some other way of seperating the values
-// ****** The only key thing is that it is going to be consistent, and that you can interpret what you get from the server reliably
+#ifdef PUSH_UPDATES
+  if(g_subscribing) g_pushFailed = true;
+#endif
 
+  g_fetchNextAt = millis() + g_backoff;
+  g_backoff *= 2;
+  if(g_backoff > BACKOFF_MAX) g_backoff = BACKOFF_MAX;
 
-  while (pch != NULL)
+  g_failures++;
+  if(g_failures >= WIFI_RESTART_FAILURES)
   {
-#ifdef SERIAL_DEBUG
-    Serial.println(pch);
-#endif
-    pch = strtok (NULL, "|");
-    if(cStat == 1) state_s2 = atoi(pch);
-    if(cStat == 2) state_cj = atoi(pch);
-    if(cStat == 3) state_dacu = atoi(pch);
-    if(cStat == 4) state_dacs = atoi(pch);
-    if(cStat == 5) state_acu = atoi(pch);
-    if(cStat == 6) state_acs = atoi(pch);
-    if(cStat == 7) g_nightmode = atoi(pch);
-    cStat++;
+    g_failures = 0;
+    g_fetchState = FETCH_WIFI_INIT;
+  }
+  else
+  {
+    g_fetchState = FETCH_IDLE;
   }
+}
 
+//////////////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////////
+#ifdef PUSH_UPDATES
+int8_t checkStream(uint8_t c)  // is the reply to a subscription a stream? Only a 200 without a Content-Length is: 1 if so, -1 if not, 0 until its headers end
+{
+  if(g_statusPos < sizeof(STREAM_STATUS) - 1)
+  {
+    return c == (uint8_t)STREAM_STATUS[g_statusPos++] ? 0 : -1;
+  }
+  if(dbpMatch(&g_lengthMatch, "Content-Length:", c)) g_hasLength = true;
+  if(!dbpMatch(&g_endMatch, "\r\n\r\n", c)) return 0;
+  return g_hasLength ? -1 : 1;
+}
+#endif
 
+//////////////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////////
+void applyStats(const int32_t* values)  // take a complete set of numbers from the parser and show them
+{
+  state_s1 = values[DBW_S1];
+  state_s2 = values[DBW_S2];
+  state_cj = values[DBW_CJ];
+  state_dacu = values[DBW_DACU];
+  state_dacs = values[DBW_DACS];
+  state_acu = values[DBW_ACU];
+  state_acs = values[DBW_ACS];
+  g_nightmode = values[DBW_NIGHT];
 
 #ifdef SERIAL_DEBUG
 Serial.println("S1: ");
 Serial.println(state_s1);
 
 Serial.println("S2: ");
-Serial.println(state_s1);
+Serial.println(state_s2);
 
 Serial.println("ACU: ");
 Serial.println(state_acu);
@@ -561,6 +801,13 @@ Serial.println("DACS: ");
 Serial.println(state_dacs);
 #endif
 
+  showStatus();
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////////
+void showStatus()  // update the lights and displays from our state_* values
+{
 
 if(g_nightmode == 1 && state_s1 == 1 && state_s2 == 1) // we have gone into night mode (and both servers are okay)
 {
@@ -568,19 +815,17 @@ if(g_nightmode == 1 && state_s1 == 1 && state_s2 == 1) // we have gone into nigh
   setLEDIndicator(2, 0, 0, 0);  // off
   setLEDIndicator(3, 0, 0, 0);  // off
 
-  display.clearDisplay(0);
-  display.clearDisplay(3);
+  clearFb(0);
+  clearFb(3);
 
-  display.shutdown(1, false);
-  display.shutdown(2, false);
-  displayMatrix(1, 21);
-  displayMatrix(2, 20);
+  displayMatrix(1, 21, false);
+  displayMatrix(2, 20, false);
 
   for(int a = 4; a < 6; a++)
   {
     for(int b = 0; b < 8; b++)
     {
-      display.setChar(a,b,' ',false);
+      setFbChar(a,b,' ',false);
     }
   }
 
@@ -632,117 +877,20 @@ else // NORMAL DAY MODE
 
   
   
-  // ****** this next bit gets us from integer variables like 354, 1343, 23 etc.... to a series of characters that we can then display in their relevant locations
-  
-  // ***** Note: there are easier ways to do this - I chose this method as it shows clearly what we are doing and works well for a tutorial
-  
-  int disp = 4;
-
-  int number = state_dacs;
-  char res[8]; // 8 max
-  for(int a = 0; a < 8; a++)
-  {
-    res[a] = ' ';
-  }
-
-  int ths, hun, ten, dig;
-
-  ths = number / 1000;
-  res[0] = '0' + ths;
-  if(ths == 0) res[0] = ' ';
-  hun = (number- (ths * 1000)) / 100;
-  res[1] = '0' + hun;
-  if(ths == 0 && hun == 0) res[1] = ' ';
-  ten = (number - (ths * 1000) - (hun * 100)) / 10;
-  res[2] = '0' + ten;
-  if(ths == 0 && hun == 0 && ten == 0) res[2] = ' ';
-  dig = (number - (ths * 1000) - (hun * 100) - (ten * 10));
-  res[3] = '0' + dig;
-  res[4] = 0;  
-
-  display.setChar(disp,7,res[0],false);
-  display.setChar(disp,6,res[1],false);
-  display.setChar(disp,5,res[2],false);
-  display.setChar(disp,4,res[3],false);
-
-
-
-  number = state_dacu;
-  for(int a = 0; a < 8; a++)
+  // The numbers on the 7-segment displays
+  char cells[CELLS];
+  bool dps[CELLS];
+  for(int f = 0; f < FIELDS_LEN; f++)
   {
-    res[a] = ' ';
-  }
-
-  ths = number / 1000;
-  res[0] = '0' + ths;
-  if(ths == 0) res[0] = ' ';
-  hun = (number- (ths * 1000)) / 100;
-  res[1] = '0' + hun;
-  if(ths == 0 && hun == 0) res[1] = ' ';
-  ten = (number - (ths * 1000) - (hun * 100)) / 10;
-  res[2] = '0' + ten;
-  if(ths == 0 && hun == 0 && ten == 0) res[2] = ' ';
-  dig = (number - (ths * 1000) - (hun * 100) - (ten * 10));
-  res[3] = '0' + dig;
-  res[4] = 0;  
-
-  display.setChar(disp,3,res[0],false);
-  display.setChar(disp,2,res[1],false);
-  display.setChar(disp,1,res[2],false);
-  display.setChar(disp,0,res[3],false);
-
-
-disp = 5; // last one
-
-  number = state_acu;
-  for(int a = 0; a < 8; a++)
-  {
-    res[a] = ' ';
-  }
-
-  ths = number / 1000;
-  res[0] = '0' + ths;
-  if(ths == 0) res[0] = ' ';
-  hun = (number- (ths * 1000)) / 100;
-  res[1] = '0' + hun;
-  if(ths == 0 && hun == 0) res[1] = ' ';
-  ten = (number - (ths * 1000) - (hun * 100)) / 10;
-  res[2] = '0' + ten;
-  if(ths == 0 && hun == 0 && ten == 0) res[2] = ' ';
-  dig = (number - (ths * 1000) - (hun * 100) - (ten * 10));
-  res[3] = '0' + dig;
-  res[4] = 0;  
-
-  display.setChar(disp,7,res[0],false);
-  display.setChar(disp,6,res[1],false);
-  display.setChar(disp,5,res[2],false);
-  display.setChar(disp,4,res[3],false);
-
-
-  number = state_acs;
-  for(int a = 0; a < 8; a++)
-  {
-    res[a] = ' ';
+    formatValue(*FIELDS[f].value, cells, dps);
+    for(int c = 0; c < CELLS; c++)
+    {
+      setFbChar(FIELDS[f].device, FIELDS[f].firstDigit - c, cells[c], dps[c]);
+    }
   }
-
-  ths = number / 1000;
-  res[0] = '0' + ths;
-  if(ths == 0) res[0] = ' ';
-  hun = (number- (ths * 1000)) / 100;
-  res[1] = '0' + hun;
-  if(ths == 0 && hun == 0) res[1] = ' ';
-  ten = (number - (ths * 1000) - (hun * 100)) / 10;
-  res[2] = '0' + ten;
-  if(ths == 0 && hun == 0 && ten == 0) res[2] = ' ';
-  dig = (number - (ths * 1000) - (hun * 100) - (ten * 10));
-  res[3] = '0' + dig;
-  res[4] = 0;  
-
-  display.setChar(disp,3,res[0],false);
-  display.setChar(disp,2,res[1],false);
-  display.setChar(disp,1,res[2],false);
-  display.setChar(disp,0,res[3],false);
 }
 
-  return len;
+  flushDisplay();
+
+  return;
 }
\ No newline at end of file
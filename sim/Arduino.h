@@ -0,0 +1,54 @@
+#ifndef SCOREBOARD_SIM_ARDUINO_H
+#define SCOREBOARD_SIM_ARDUINO_H
+
+// Just enough of the Arduino core for scoreboard.cpp to build and run on
+// Linux (see sim.h). Pins go nowhere; time is simulated.
+
+#include <stdint.h>
+#include <string.h>
+
+#include "binary.h"
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+
+// Analog pins as numbered on the Mega
+#define A0 54
+#define A1 55
+#define A2 56
+#define A3 57
+#define A4 58
+#define A5 59
+
+#define F(s) (s)
+#define bitRead(value, bit) (((value) >> (bit)) & 0x01)
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+void analogWrite(uint8_t pin, int value);
+
+// The sketch's entry points
+void setup(void);
+void loop(void);
+
+// Serial monitor; output goes to stdout
+class HardwareSerial {
+ public:
+  void begin(unsigned long baud);
+  void print(const char* s);
+  void print(long n);
+  void println(const char* s);
+  void println(long n);
+};
+
+extern HardwareSerial Serial;
+
+#endif // SCOREBOARD_SIM_ARDUINO_H
@@ -0,0 +1,31 @@
+#ifndef SCOREBOARD_SIM_ESP8266_H
+#define SCOREBOARD_SIM_ESP8266_H
+
+#include "Arduino.h"
+#include "SoftwareSerial.h"
+
+// Size of the library's receive buffer
+#define MAX_BUFFER_SIZE 256
+
+// The calls scoreboard.cpp makes on the WeeESP8266 library, answered by a
+// scripted server (see simDeliver()). recv() returns one +IPD packet at a
+// time, cut to the buffer it is given. Bytes arrive at the 9600 baud the
+// sketch runs the module at, and waiting costs simulated time, so loop()
+// timings come out as they would on the board.
+class ESP8266 {
+ public:
+  explicit ESP8266(SoftwareSerial& uart) : uart_(uart) {}
+
+  bool init(const char* ssid, const char* pwd, uint32_t baud);
+  bool createTCP(const char* addr, uint32_t port);
+  bool releaseTCP();
+  bool sendSingle(const char* data);
+  uint32_t recv(uint8_t* buffer, uint32_t bufferSize, uint32_t timeout);
+
+  uint8_t m_responseBuffer[MAX_BUFFER_SIZE];
+
+ private:
+  SoftwareSerial& uart_;
+};
+
+#endif // SCOREBOARD_SIM_ESP8266_H
@@ -0,0 +1,30 @@
+#ifndef SCOREBOARD_SIM_LEDCONTROL_H
+#define SCOREBOARD_SIM_LEDCONTROL_H
+
+#include "Arduino.h"
+
+// LedControl's interface over a model of the MAX7219 chain. Every call that
+// would shift a register write down the chain counts as one SPI transfer
+// of 2 bytes per device, as the real library's spiTransfer() does.
+class LedControl {
+ public:
+  LedControl(int dataPin, int clkPin, int csPin, int numDevices = 1);
+
+  int getDeviceCount();
+  void shutdown(int addr, bool status);
+  void setScanLimit(int addr, int limit);
+  void setIntensity(int addr, int intensity);
+  void clearDisplay(int addr);
+  void setLed(int addr, int row, int col, boolean state);
+  void setRow(int addr, int row, byte value);
+  void setDigit(int addr, int digit, byte value, boolean dp);
+  void setChar(int addr, int digit, char value, boolean dp);
+
+ private:
+  void transfer(int addr, int row, byte value);
+
+  int devices_;
+  byte status_[64]; // 8 registers per device, at most 8 devices
+};
+
+#endif // SCOREBOARD_SIM_LEDCONTROL_H
@@ -0,0 +1,17 @@
+#ifndef SCOREBOARD_SIM_SOFTWARESERIAL_H
+#define SCOREBOARD_SIM_SOFTWARESERIAL_H
+
+#include "Arduino.h"
+
+// The serial link to the ESP8266. The fake ESP8266 never touches it; the
+// link's speed is modelled there instead.
+class SoftwareSerial {
+ public:
+  SoftwareSerial(uint8_t rxPin, uint8_t txPin) : rxPin_(rxPin), txPin_(txPin) {}
+
+ private:
+  uint8_t rxPin_;
+  uint8_t txPin_;
+};
+
+#endif // SCOREBOARD_SIM_SOFTWARESERIAL_H
@@ -0,0 +1,170 @@
+#include "sim.h"
+
+#include <cstdio>
+#include <cstring>
+#include <deque>
+
+#include "Arduino.h"
+#include "ESP8266.h"
+#include "LedControl.h"
+
+// Rough costs on the real board, so simulated loop() times are meaningful
+namespace {
+
+const std::uint64_t kSerialByteMicros = 1042;   // 10 bits at 9600 baud
+const std::uint64_t kShiftByteMicros = 90;      // shiftOut() of one byte on a 16 MHz AVR
+const std::uint64_t kInitMicros = 3000000;      // Resetting the module and joining the network
+const std::uint64_t kConnectMicros = 100000;    // AT+CIPSTART round trip
+const std::uint64_t kCommandMicros = 20000;     // Any other AT command round trip
+const std::size_t kMaxPacket = 1460;            // Largest +IPD packet the module hands over
+
+std::uint64_t g_micros = 0;
+std::deque<std::string> g_packets; // What the server has sent that the sketch hasn't read
+bool g_connected = false;
+bool g_serverDown = false;
+std::uint8_t g_rows[64];
+
+} // namespace
+
+SimCounters g_sim;
+HardwareSerial Serial;
+
+std::uint64_t simMicros() { return g_micros; }
+void simAdvance(std::uint64_t micros) { g_micros += micros; }
+void simDeliver(const std::string& bytes) {
+  for (std::size_t at = 0; at < bytes.size(); at += kMaxPacket) {
+    g_packets.push_back(bytes.substr(at, kMaxPacket));
+  }
+}
+void simSetServerDown(bool down) { g_serverDown = down; }
+bool simConnected() { return g_connected; }
+std::uint8_t simLedRow(int device, int row) { return g_rows[device * 8 + row]; }
+
+unsigned long millis() { return static_cast<unsigned long>(g_micros / 1000); }
+unsigned long micros() { return static_cast<unsigned long>(g_micros); }
+void delay(unsigned long ms) { g_micros += ms * 1000ull; }
+void pinMode(uint8_t, uint8_t) {}
+void digitalWrite(uint8_t, uint8_t) {}
+void analogWrite(uint8_t, int) {}
+
+void HardwareSerial::begin(unsigned long) {}
+void HardwareSerial::print(const char* s) { std::fputs(s, stdout); }
+void HardwareSerial::print(long n) { std::printf("%ld", n); }
+void HardwareSerial::println(const char* s) { std::printf("%s\n", s); }
+void HardwareSerial::println(long n) { std::printf("%ld\n", n); }
+
+LedControl::LedControl(int, int, int, int numDevices) : devices_(numDevices) {
+  if (devices_ < 1 || devices_ > 8) devices_ = 8;
+  std::memset(status_, 0, sizeof(status_));
+  std::memset(g_rows, 0, sizeof(g_rows));
+}
+
+int LedControl::getDeviceCount() { return devices_; }
+
+void LedControl::transfer(int addr, int row, byte value) {
+  g_sim.spiTransfers++;
+  g_sim.spiBytes += 2 * devices_;
+  g_micros += 2 * devices_ * kShiftByteMicros;
+  if (row < 0) return; // A control register, not one that is displayed
+  if (g_rows[addr * 8 + row] != value) g_sim.ledChanges++;
+  g_rows[addr * 8 + row] = value;
+}
+
+void LedControl::shutdown(int addr, bool) {
+  if (addr >= 0 && addr < devices_) transfer(addr, -1, 0);
+}
+
+void LedControl::setScanLimit(int addr, int) {
+  if (addr >= 0 && addr < devices_) transfer(addr, -1, 0);
+}
+
+void LedControl::setIntensity(int addr, int) {
+  if (addr >= 0 && addr < devices_) transfer(addr, -1, 0);
+}
+
+void LedControl::clearDisplay(int addr) {
+  if (addr < 0 || addr >= devices_) return;
+  for (int row = 0; row < 8; row++) {
+    status_[addr * 8 + row] = 0;
+    transfer(addr, row, 0);
+  }
+}
+
+void LedControl::setLed(int addr, int row, int col, boolean state) {
+  if (addr < 0 || addr >= devices_ || row < 0 || row > 7 || col < 0 || col > 7) return;
+  byte bit = B10000000 >> col;
+  byte& reg = status_[addr * 8 + row];
+  reg = state ? (reg | bit) : (reg & ~bit);
+  transfer(addr, row, reg);
+}
+
+void LedControl::setRow(int addr, int row, byte value) {
+  if (addr < 0 || addr >= devices_ || row < 0 || row > 7) return;
+  status_[addr * 8 + row] = value;
+  transfer(addr, row, value);
+}
+
+void LedControl::setDigit(int addr, int digit, byte value, boolean dp) {
+  static const byte kHex[16] = {B01111110, B00110000, B01101101, B01111001, B00110011, B01011011,
+                                B01011111, B01110000, B01111111, B01111011, B01110111, B00011111,
+                                B00001101, B00111101, B01001111, B01000111};
+  if (value > 15) return;
+  setRow(addr, digit, kHex[value] | (dp ? B10000000 : 0));
+}
+
+void LedControl::setChar(int addr, int digit, char value, boolean dp) {
+  byte segments = 0;
+  if (value >= '0' && value <= '9') {
+    setDigit(addr, digit, value - '0', dp);
+    return;
+  }
+  if (value == '-') segments = B00000001;
+  setRow(addr, digit, segments | (dp ? B10000000 : 0));
+}
+
+bool ESP8266::init(const char*, const char*, uint32_t) {
+  g_micros += kInitMicros;
+  return true;
+}
+
+bool ESP8266::createTCP(const char*, uint32_t) {
+  g_sim.connects++;
+  g_micros += kConnectMicros;
+  if (g_serverDown) return false;
+  g_connected = true;
+  return true;
+}
+
+bool ESP8266::releaseTCP() {
+  if (!g_connected) return false;
+  g_micros += kCommandMicros;
+  g_connected = false;
+  g_packets.clear(); // Whatever the server still had to say is lost with the connection
+  return true;
+}
+
+bool ESP8266::sendSingle(const char* data) {
+  g_sim.sends++;
+  if (!g_connected) return false;
+  g_micros += kCommandMicros + std::strlen(data) * kSerialByteMicros;
+  return true;
+}
+
+// Like the library, reads one whole +IPD packet off the serial link and
+// keeps only what fits in `buffer`
+uint32_t ESP8266::recv(uint8_t* buffer, uint32_t bufferSize, uint32_t timeout) {
+  g_sim.recvCalls++;
+  if (!g_connected || g_packets.empty()) {
+    g_micros += timeout * 1000ull;
+    g_sim.idleWaitMs += timeout;
+    return 0;
+  }
+  const std::string& packet = g_packets.front();
+  uint32_t n = packet.size() < bufferSize ? packet.size() : bufferSize;
+  std::memcpy(buffer, packet.data(), n);
+  g_micros += packet.size() * kSerialByteMicros;
+  g_sim.bytesReceived += n;
+  g_sim.bytesDropped += packet.size() - n;
+  g_packets.pop_front();
+  return n;
+}
@@ -0,0 +1,303 @@
+// Runs scoreboard.cpp on Linux against the fakes in this directory and
+// measures it: what a redraw costs on the LED chain, and what fetching and
+// parsing a server response costs in loop() passes, bytes and time.
+//
+// Times "on the board" come from the fakes' cost model (9600 baud to the
+// ESP8266, shiftOut() speed of a 16 MHz AVR); times "here" are host CPU
+// time, which only says whether a change made the sketch's own code
+// faster or slower.
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "../dashboard.h"
+#include "../dashboard_wire.h"
+#include "sim.h"
+
+// From scoreboard.cpp
+extern int g_fetchState;
+extern unsigned long g_fetchNextAt;
+extern bool g_pushFailed;
+extern int32_t state_acu, state_acs, state_dacu, state_dacs;
+unsigned long millis();
+void setup(void);
+void loop(void);
+void updateView(int whichView);
+void showStatus();
+std::uint8_t segmentsFor(char c);
+
+namespace {
+
+const int kViews = 4;       // Entries in VIEWS
+const int kFetchParse = 5;  // FETCH_PARSE: the parser has a complete set of stats (or a 304)
+const int kMaxPasses = 100000;
+
+struct Options {
+  int iterations = 100;
+  std::vector<std::string> files; // Recorded responses; made up ones if none
+};
+
+void usage(const char* argv0) {
+  std::cout << "Usage: " << argv0 << " [--iterations N] [FILE...]\n"
+            << "  FILE            A raw HTTP response to replay, e.g. saved with\n"
+            << "                  curl -si http://server:9999/gp/dbd.php > FILE\n"
+            << "                  (default: made up ones in both wire formats)\n"
+            << "  --iterations N  Times to replay each response, and values to draw\n"
+            << "                  per view (default 100)" << std::endl;
+}
+
+bool parseOptions(int argc, char** argv, Options& opts) {
+  for (int i = 1; i < argc; i++) {
+    if (i + 1 < argc && std::strcmp(argv[i], "--iterations") == 0) {
+      opts.iterations = std::atoi(argv[++i]);
+    } else if (argv[i][0] == '-') {
+      return false;
+    } else {
+      opts.files.push_back(argv[i]);
+    }
+  }
+  return opts.iterations > 0;
+}
+
+std::string httpResponse(const char* contentType, const std::string& body, unsigned etag) {
+  char head[192];
+  std::snprintf(head, sizeof(head),
+                "HTTP/1.1 200 OK\r\nContent-Type: %s\r\nContent-Length: %zu\r\n"
+                "ETag: \"%08x\"\r\nConnection: close\r\n\r\n",
+                contentType, body.size(), etag);
+  return head + body;
+}
+
+// Counts for the made up responses, covering the small, four digit and
+// abbreviated cases, and what the 7-segment displays should show for them.
+// The last ones don't fit the 16 bit int of the board.
+struct MadeUp {
+  int acu;
+  const char* shown; // acu then dacu (3 * acu), as read off the displays
+};
+
+const MadeUp kMadeUp[] = {
+    {7, "   7|  21"},
+    {354, " 354|1062"},
+    {1343, "1343|4029"},
+    {12345, "12.3k|37.0k"},
+    {1234567, "1.23M|3.70M"},
+};
+const std::size_t kMadeUpLen = sizeof(kMadeUp) / sizeof(kMadeUp[0]);
+
+// Responses as the server would send them, in both formats, then the 304 a
+// conditional poll gets when nothing changed. `shown` gets what each should
+// leave on the displays.
+std::vector<std::string> madeUpResponses(std::vector<std::string>& shown) {
+  std::vector<std::string> responses;
+  for (std::size_t i = 0; i < kMadeUpLen; i++) {
+    DashboardStats stats;
+    stats.s1 = 1;
+    stats.s2 = 1;
+    stats.cj = 0;
+    stats.acu = kMadeUp[i].acu;
+    stats.acs = kMadeUp[i].acu / 2;
+    stats.dacu = kMadeUp[i].acu * 3;
+    stats.dacs = kMadeUp[i].acu;
+
+    char text[128];
+    std::size_t n = formatDashboard(stats, text, sizeof(text));
+    responses.push_back(httpResponse("text/plain", std::string(text, n) + "\n", 2 * i + 1));
+
+    std::uint8_t frame[DBW_MAX_FRAME];
+    n = encodeDashboard(stats, frame);
+    responses.push_back(httpResponse(
+        DBW_CONTENT_TYPE, std::string(reinterpret_cast<char*>(frame), n), 2 * i + 2));
+    shown.push_back(kMadeUp[i].shown);
+    shown.push_back(kMadeUp[i].shown);
+  }
+  responses.push_back("HTTP/1.1 304 Not Modified\r\nETag: \"0000000a\"\r\n"
+                      "Connection: close\r\n\r\n");
+  shown.push_back(kMadeUp[kMadeUpLen - 1].shown); // Still the last ones
+  return responses;
+}
+
+// The characters a 7-segment field shows, read back off the fake LED chain,
+// e.g. "1.23M"
+std::string shownOn(int device, int firstDigit) {
+  const char kChars[] = "0123456789-kM ";
+  std::string text;
+  for (int c = 0; c < 4; c++) {
+    std::uint8_t row = simLedRow(device, firstDigit - c);
+    char shown = '?';
+    for (const char* k = kChars; *k; k++) {
+      if (segmentsFor(*k) == (row & 0x7f)) shown = *k;
+    }
+    text += shown;
+    if (row & 0x80) text += '.';
+  }
+  return text;
+}
+
+// What the acu and dacu fields (FIELDS in scoreboard.cpp) show
+std::string shownCounts() { return shownOn(5, 7) + "|" + shownOn(4, 3); }
+
+typedef std::chrono::steady_clock Clock;
+
+double nanosSince(Clock::time_point start) {
+  return std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+}
+
+// What one measured thing cost, summed over `calls`
+struct Cost {
+  std::uint64_t calls = 0;
+  std::uint64_t spiTransfers = 0;
+  std::uint64_t ledChanges = 0;
+  std::uint64_t boardMicros = 0;
+  double hostNanos = 0;
+
+  void print(const char* what) const {
+    double n = calls ? static_cast<double>(calls) : 1;
+    std::printf("  %-22s %7.1f SPI transfers %6.1f rows changed %9.2f ms on the board"
+                " %9.0f ns here\n",
+                what, spiTransfers / n, ledChanges / n, boardMicros / n / 1000, hostNanos / n);
+  }
+};
+
+// Runs `fn` once and adds what it cost to `cost`
+template <typename Fn>
+void measure(Cost& cost, Fn fn) {
+  SimCounters before = g_sim;
+  std::uint64_t micros = simMicros();
+  Clock::time_point start = Clock::now();
+  fn();
+  cost.hostNanos += nanosSince(start);
+  cost.calls++;
+  cost.spiTransfers += g_sim.spiTransfers - before.spiTransfers;
+  cost.ledChanges += g_sim.ledChanges - before.ledChanges;
+  cost.boardMicros += simMicros() - micros;
+}
+
+void benchRender(int iterations) {
+  Cost changed, same, status;
+  for (int i = 0; i < iterations; i++) {
+    // Values that walk through every digit and the abbreviated ranges
+    int value = (i * 7919) % 20000 + (i % 3 == 0 ? 0 : (i % 3) * 600000);
+    state_acu = value;
+    state_dacu = value * 2;
+    state_acs = value / 3;
+    state_dacs = value + 11;
+    for (int view = 0; view < kViews; view++) {
+      measure(changed, [view]() { updateView(view); });
+      measure(same, [view]() { updateView(view); });
+    }
+    measure(status, []() { showStatus(); });
+  }
+
+  std::printf("Render (%d values)\n", iterations);
+  changed.print("updateView, new view");
+  same.print("updateView, redrawn");
+  status.print("showStatus");
+}
+
+// Replays `response` into the sketch and runs loop() until it has been
+// parsed and shown. False if it never was.
+bool replay(const std::string& response, Cost& cost, std::uint64_t& passes,
+            std::uint64_t& bytes) {
+  std::uint64_t received = g_sim.bytesReceived;
+  simDeliver(response);
+  g_fetchNextAt = millis(); // A polling sketch needn't wait out REFRESH_TIME
+  // These are replies to polls; a subscription would refuse them (they have
+  // a Content-Length) and fall back to polling anyway
+  g_pushFailed = true;
+
+  bool parsed = false;
+  for (int pass = 0; pass < kMaxPasses; pass++) {
+    bool wasParse = g_fetchState == kFetchParse;
+    measure(cost, []() { loop(); });
+    passes++;
+    if (wasParse) {
+      parsed = true;
+      break;
+    }
+  }
+  bytes += g_sim.bytesReceived - received;
+  return parsed;
+}
+
+// Replays each response `iterations` times. If `shown` has an entry for it,
+// that is what the displays must show afterwards.
+int benchReplay(const std::vector<std::string>& responses, const std::vector<std::string>& names,
+                const std::vector<std::string>& shown, int iterations) {
+  std::printf("Replay (%d times each)\n", iterations);
+  for (std::size_t r = 0; r < responses.size(); r++) {
+    Cost cost;
+    std::uint64_t passes = 0;
+    std::uint64_t bytes = 0;
+    for (int i = 0; i < iterations; i++) {
+      if (!replay(responses[r], cost, passes, bytes)) {
+        std::printf("  %s: never parsed\n", names[r].c_str());
+        return 1;
+      }
+    }
+    if (r < shown.size() && shownCounts() != shown[r]) {
+      std::printf("  %s: shows %s instead of %s\n", names[r].c_str(), shownCounts().c_str(),
+                  shown[r].c_str());
+      return 1;
+    }
+    std::printf("  %-24s %5.0f bytes %5.1f loop passes %8.2f ms on the board %9.0f ns here\n",
+                names[r].c_str(), bytes / double(iterations), passes / double(iterations),
+                cost.boardMicros / double(iterations) / 1000, cost.hostNanos / iterations);
+  }
+  return 0;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  Options opts;
+  if (!parseOptions(argc, argv, opts)) {
+    usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  std::vector<std::string> responses;
+  std::vector<std::string> names;
+  std::vector<std::string> shown;
+  if (opts.files.empty()) {
+    responses = madeUpResponses(shown);
+    for (std::size_t i = 0; i + 1 < responses.size(); i++) {
+      names.push_back(std::string(i % 2 ? "binary " : "text ") + std::to_string(i / 2 + 1));
+    }
+    names.push_back("not modified");
+  }
+  for (std::size_t i = 0; i < opts.files.size(); i++) {
+    std::ifstream in(opts.files[i].c_str(), std::ios::binary);
+    if (!in) {
+      std::cout << "Failed to read " << opts.files[i] << std::endl;
+      return EXIT_FAILURE;
+    }
+    std::ostringstream body;
+    body << in.rdbuf();
+    responses.push_back(body.str());
+    names.push_back(opts.files[i]);
+  }
+
+  Cost boot;
+  measure(boot, []() { setup(); });
+  std::printf("Setup\n");
+  boot.print("setup");
+
+  benchRender(opts.iterations);
+  int rc = benchReplay(responses, names, shown, opts.iterations);
+
+  std::printf("Totals: %llu SPI transfers (%llu bytes), %llu connects, %llu bytes received "
+              "in %llu recv calls, %llu dropped\n",
+              (unsigned long long)g_sim.spiTransfers, (unsigned long long)g_sim.spiBytes,
+              (unsigned long long)g_sim.connects, (unsigned long long)g_sim.bytesReceived,
+              (unsigned long long)g_sim.recvCalls, (unsigned long long)g_sim.bytesDropped);
+  return rc;
+}
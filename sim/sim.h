@@ -0,0 +1,41 @@
+#ifndef SCOREBOARD_SIM_H
+#define SCOREBOARD_SIM_H
+
+#include <cstdint>
+#include <string>
+
+// What the fake hardware saw, for the benchmark driver (scoreboard_sim.cpp)
+// to report. Reset by zeroing.
+struct SimCounters {
+  std::uint64_t spiTransfers = 0;  // Register writes shifted down the LED chain
+  std::uint64_t spiBytes = 0;      // Bytes shifted for them (2 per device per transfer)
+  std::uint64_t ledChanges = 0;    // Register writes that changed what a device shows
+  std::uint64_t connects = 0;      // createTCP() calls
+  std::uint64_t sends = 0;         // sendSingle() calls
+  std::uint64_t recvCalls = 0;
+  std::uint64_t bytesReceived = 0;
+  std::uint64_t bytesDropped = 0;  // Ends of packets that didn't fit recv()'s buffer
+  std::uint64_t idleWaitMs = 0;    // Time recv() spent waiting for bytes that never came
+};
+
+extern SimCounters g_sim;
+
+// The sketch's clock. It only moves when the fakes say time passed (e.g.
+// bytes trickling in over the 9600 baud link) or when simAdvance() is called.
+std::uint64_t simMicros();
+void simAdvance(std::uint64_t micros);
+
+// Bytes the "server" sends down the next (or the open) connection. They
+// reach recv() as +IPD packets, one per call here (split at the module's
+// 1460 byte limit), and recv() drops whatever of a packet its buffer can't
+// hold, as the library does.
+void simDeliver(const std::string& bytes);
+// Makes createTCP() fail, as if the server were down
+void simSetServerDown(bool down);
+// True while the sketch holds a connection open
+bool simConnected();
+
+// The register a device shows for `row` (a matrix row or 7-segment digit)
+std::uint8_t simLedRow(int device, int row);
+
+#endif // SCOREBOARD_SIM_H
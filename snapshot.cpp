@@ -0,0 +1,87 @@
+#include "snapshot.h"
+
+#include <sys/eventfd.h> // For eventfd_write
+
+#include "dashboard_wire.h"
+#include "http_server.h"
+
+bool wantsBinary(const HttpRequest& req) {
+  StrView accept = req.header("Accept");
+  for (std::size_t i = 0; i + sizeof(DBW_CONTENT_TYPE) - 1 <= accept.size; i++) {
+    if (StrView(accept.data + i, sizeof(DBW_CONTENT_TYPE) - 1).equalsIgnoreCase(DBW_CONTENT_TYPE)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+SnapshotPublisher::SnapshotPublisher(const DashboardStats& initial)
+    : current_(render(initial, 1)), version_(1) {}
+
+bool SnapshotPublisher::publish(const DashboardStats& stats) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return publishLocked(stats);
+}
+
+bool SnapshotPublisher::publishChange(const std::function<void(DashboardStats&)>& change) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  DashboardStats stats = current_->stats;
+  change(stats);
+  return publishLocked(stats);
+}
+
+bool SnapshotPublisher::publishLocked(const DashboardStats& stats) {
+  if (current_->stats == stats) return false;
+
+  // Readers never wait on this; they keep sending the old snapshot until the
+  // version moves on
+  std::uint64_t next = current_->version + 1;
+  current_ = render(stats, next);
+  version_.store(next, std::memory_order_release);
+  for (std::size_t i = 0; i < wakeups_.size(); i++) eventfd_write(wakeups_[i], 1);
+  return true;
+}
+
+std::shared_ptr<const Snapshot> SnapshotPublisher::current() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return current_;
+}
+
+void SnapshotPublisher::addWakeup(int eventFd) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  wakeups_.push_back(eventFd);
+}
+
+void SnapshotPublisher::removeWakeup(int eventFd) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (std::size_t i = 0; i < wakeups_.size(); i++) {
+    if (wakeups_[i] == eventFd) {
+      wakeups_.erase(wakeups_.begin() + i);
+      return;
+    }
+  }
+}
+
+std::shared_ptr<const Snapshot> SnapshotPublisher::render(const DashboardStats& stats,
+                                                          std::uint64_t version) {
+  std::shared_ptr<Snapshot> snap = std::make_shared<Snapshot>();
+  snap->version = version;
+  snap->stats = stats;
+
+  char body[128];
+  StrView payload(body, formatDashboard(stats, body, sizeof(body)));
+  body[payload.size] = '\n'; // Pushed lines are newline terminated
+  renderFormat(snap->text, "text/plain", payload, StrView(body, payload.size + 1));
+
+  // Binary frames delimit themselves, so the pushed frame is the payload
+  std::uint8_t frame[DBW_MAX_FRAME];
+  StrView encoded(reinterpret_cast<const char*>(frame), encodeDashboard(stats, frame));
+  renderFormat(snap->binary, DBW_CONTENT_TYPE, encoded, encoded);
+  return snap;
+}
+
+void SnapshotPublisher::renderFormat(RenderedDashboard& out, const StrView& contentType,
+                                     const StrView& payload, const StrView& frame) {
+  out.render(contentType, payload);
+  out.frame.assign(frame.data, frame.size);
+}
@@ -0,0 +1,90 @@
+#ifndef SCOREBOARD_SNAPSHOT_H
+#define SCOREBOARD_SNAPSHOT_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "dashboard.h"
+#include "http_parser.h"
+#include "http_server.h"
+
+// True if the request's Accept header asks for dashboard_wire.h frames
+bool wantsBinary(const HttpRequest& req);
+
+// The dashboard rendered in one wire format
+struct RenderedDashboard : CachedResponse {
+  std::string frame; // Pushed to subscribers
+};
+
+// One version of the dashboard, rendered once into complete HTTP responses.
+// Snapshots are never modified after they are published, so any number of
+// connections can send straight out of them.
+struct Snapshot {
+  std::uint64_t version = 0;
+  DashboardStats stats;
+  RenderedDashboard text;   // "|$|...|" for scoreboards that ask for nothing else
+  RenderedDashboard binary; // dashboard_wire.h frames for ones that accept them
+
+  const RenderedDashboard& format(bool wantBinary) const { return wantBinary ? binary : text; }
+};
+
+// Publishes new snapshots RCU style: writers render a fresh snapshot and swap
+// the pointer, readers keep using whichever one they already hold until they
+// notice the version moved on. Old snapshots are freed when the last
+// connection sending from them lets go.
+class SnapshotPublisher {
+ public:
+  explicit SnapshotPublisher(const DashboardStats& initial = DashboardStats());
+
+  // Renders and publishes `stats`. Returns false (and does nothing) if they
+  // are identical to what is already published.
+  bool publish(const DashboardStats& stats);
+  // Publishes the current stats as modified by `change`. Writers that each
+  // own some of the fields use this so they never undo each other's updates.
+  bool publishChange(const std::function<void(DashboardStats&)>& change);
+
+  std::shared_ptr<const Snapshot> current() const;
+  std::uint64_t version() const { return version_.load(std::memory_order_acquire); }
+
+  // Registers an eventfd that is signalled after every publish, so event
+  // loops can push the new snapshot to their subscribers
+  void addWakeup(int eventFd);
+  void removeWakeup(int eventFd);
+
+ private:
+  static std::shared_ptr<const Snapshot> render(const DashboardStats& stats,
+                                                std::uint64_t version);
+  bool publishLocked(const DashboardStats& stats);
+  static void renderFormat(RenderedDashboard& out, const StrView& contentType,
+                           const StrView& payload, const StrView& frame);
+
+  mutable std::mutex mutex_; // Only taken when the version has changed
+  std::shared_ptr<const Snapshot> current_;
+  std::atomic<std::uint64_t> version_;
+  std::vector<int> wakeups_;
+};
+
+// Per event loop view of the publisher. get() costs one atomic load unless a
+// new snapshot has been published since the last call.
+class SnapshotReader {
+ public:
+  explicit SnapshotReader(const SnapshotPublisher& publisher)
+      : publisher_(publisher), cached_(publisher.current()) {}
+
+  const std::shared_ptr<const Snapshot>& get() {
+    if (publisher_.version() != cached_->version) cached_ = publisher_.current();
+    return cached_;
+  }
+
+ private:
+  const SnapshotPublisher& publisher_;
+  std::shared_ptr<const Snapshot> cached_;
+};
+
+#endif // SCOREBOARD_SNAPSHOT_H
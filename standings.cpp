@@ -0,0 +1,211 @@
+#include "standings.h"
+
+namespace {
+
+bool sameKey(const RankKey& a, const RankKey& b) {
+  return a.team == b.team && a.wins == b.wins && a.losses == b.losses &&
+         a.differential == b.differential;
+}
+
+} // namespace
+
+const std::uint32_t RankTree::kNil;
+
+bool RankKey::before(const RankKey& other) const {
+  if (wins != other.wins) return wins > other.wins;
+  if (losses != other.losses) return losses < other.losses;
+  if (differential != other.differential) return differential > other.differential;
+  return team < other.team;
+}
+
+void RankTree::split(std::uint32_t n, const RankKey& key, std::uint32_t& left, std::uint32_t& right) {
+  if (n == kNil) {
+    left = right = kNil;
+    return;
+  }
+  if (nodes_[n].key.before(key)) {
+    std::uint32_t rest;
+    split(nodes_[n].right, key, rest, right);
+    nodes_[n].right = rest;
+    left = n;
+  } else {
+    std::uint32_t rest;
+    split(nodes_[n].left, key, left, rest);
+    nodes_[n].left = rest;
+    right = n;
+  }
+  pull(n);
+}
+
+std::uint32_t RankTree::merge(std::uint32_t left, std::uint32_t right) {
+  if (left == kNil) return right;
+  if (right == kNil) return left;
+  if (nodes_[left].priority > nodes_[right].priority) {
+    nodes_[left].right = merge(nodes_[left].right, right);
+    pull(left);
+    return left;
+  }
+  nodes_[right].left = merge(left, nodes_[right].left);
+  pull(right);
+  return right;
+}
+
+void RankTree::insert(const RankKey& key) {
+  std::uint32_t n;
+  if (!free_.empty()) {
+    n = free_.back();
+    free_.pop_back();
+  } else {
+    n = static_cast<std::uint32_t>(nodes_.size());
+    nodes_.push_back(Node());
+  }
+  seed_ ^= seed_ << 13; // xorshift32
+  seed_ ^= seed_ >> 17;
+  seed_ ^= seed_ << 5;
+  Node& node = nodes_[n];
+  node.key = key;
+  node.priority = seed_;
+  node.size = 1;
+  node.left = node.right = kNil;
+
+  std::uint32_t left, right;
+  split(root_, key, left, right);
+  root_ = merge(merge(left, n), right);
+}
+
+bool RankTree::eraseFrom(std::uint32_t& n, const RankKey& key) {
+  if (n == kNil) return false;
+  if (sameKey(nodes_[n].key, key)) {
+    free_.push_back(n);
+    n = merge(nodes_[n].left, nodes_[n].right);
+    return true;
+  }
+  bool erased = key.before(nodes_[n].key) ? eraseFrom(nodes_[n].left, key)
+                                          : eraseFrom(nodes_[n].right, key);
+  if (erased) pull(n);
+  return erased;
+}
+
+void RankTree::erase(const RankKey& key) { eraseFrom(root_, key); }
+
+std::size_t RankTree::rank(const RankKey& key) const {
+  std::size_t ahead = 0;
+  std::uint32_t n = root_;
+  while (n != kNil) {
+    const Node& node = nodes_[n];
+    if (key.before(node.key)) {
+      n = node.left;
+    } else if (node.key.before(key)) {
+      ahead += sizeOf(node.left) + 1;
+      n = node.right;
+    } else {
+      return ahead + sizeOf(node.left) + 1;
+    }
+  }
+  return 0;
+}
+
+const RankKey& RankTree::at(std::size_t k) const {
+  std::uint32_t n = root_;
+  for (;;) {
+    std::size_t left = sizeOf(nodes_[n].left);
+    if (k < left) {
+      n = nodes_[n].left;
+    } else if (k == left) {
+      return nodes_[n].key;
+    } else {
+      k -= left + 1;
+      n = nodes_[n].right;
+    }
+  }
+}
+
+Standings::Team& Standings::team(std::uint16_t id) {
+  if (id >= teams_.size()) teams_.resize(id + 1);
+  return teams_[id];
+}
+
+RankKey Standings::keyFor(std::uint16_t id) const {
+  const TeamRecord& r = teams_[id].record;
+  RankKey key = {r.wins, r.losses, r.differential(), id};
+  return key;
+}
+
+void Standings::apply(std::uint16_t id, std::uint16_t conference, int scored, int allowed, int sign) {
+  Team& t = team(id);
+
+  // Take the team out under its old key and put it back under the new one
+  if (t.games > 0) {
+    RankKey old = keyFor(id);
+    overall_.erase(old);
+    if (t.conference != StringPool::kNone) conferences_[t.conference].erase(old);
+  }
+  if (conference != StringPool::kNone) t.conference = conference;
+
+  t.record.wins += scored > allowed ? sign : 0;
+  t.record.losses += scored < allowed ? sign : 0;
+  t.record.ties += scored == allowed ? sign : 0;
+  t.record.pointsFor += sign * scored;
+  t.record.pointsAgainst += sign * allowed;
+  t.games += sign;
+
+  if (t.games > 0) {
+    RankKey key = keyFor(id);
+    overall_.insert(key);
+    if (t.conference != StringPool::kNone) conferences_[t.conference].insert(key);
+  }
+}
+
+void Standings::update(std::int64_t gameId, std::uint16_t homeTeam, std::uint16_t homeConference,
+                       int homePoints, std::uint16_t awayTeam, std::uint16_t awayConference,
+                       int awayPoints) {
+  std::unordered_map<std::int64_t, Result>::iterator it = applied_.find(gameId);
+  if (it != applied_.end()) {
+    const Result& old = it->second;
+    apply(old.homeTeam, StringPool::kNone, old.homePoints, old.awayPoints, -1);
+    apply(old.awayTeam, StringPool::kNone, old.awayPoints, old.homePoints, -1);
+    applied_.erase(it);
+  }
+  if (homePoints < 0 || awayPoints < 0) return;
+
+  apply(homeTeam, homeConference, homePoints, awayPoints, 1);
+  apply(awayTeam, awayConference, awayPoints, homePoints, 1);
+  Result result = {homeTeam, awayTeam, homePoints, awayPoints};
+  applied_[gameId] = result;
+}
+
+void Standings::update(const GameStore& store, std::size_t row) {
+  GameRow game = store.row(row);
+  update(game.id, game.homeTeam, store.homeConference(row), game.homePoints, game.awayTeam,
+         store.awayConference(row), game.awayPoints);
+}
+
+const TeamRecord& Standings::record(std::uint16_t team) const {
+  static const TeamRecord kNoGames;
+  return team < teams_.size() ? teams_[team].record : kNoGames;
+}
+
+std::size_t Standings::rank(std::uint16_t team) const {
+  if (team >= teams_.size() || teams_[team].games <= 0) return 0;
+  return overall_.rank(keyFor(team));
+}
+
+std::size_t Standings::conferenceRank(std::uint16_t team) const {
+  if (team >= teams_.size() || teams_[team].games <= 0) return 0;
+  std::unordered_map<std::uint16_t, RankTree>::const_iterator it =
+      conferences_.find(teams_[team].conference);
+  return it == conferences_.end() ? 0 : it->second.rank(keyFor(team));
+}
+
+void Standings::top(std::size_t n, std::vector<std::uint16_t>& teams) const {
+  teams.clear();
+  for (std::size_t i = 0; i < n && i < overall_.size(); i++) teams.push_back(overall_.at(i).team);
+}
+
+void Standings::topInConference(std::uint16_t conference, std::size_t n,
+                                std::vector<std::uint16_t>& teams) const {
+  teams.clear();
+  std::unordered_map<std::uint16_t, RankTree>::const_iterator it = conferences_.find(conference);
+  if (it == conferences_.end()) return;
+  for (std::size_t i = 0; i < n && i < it->second.size(); i++) teams.push_back(it->second.at(i).team);
+}
@@ -0,0 +1,126 @@
+#ifndef SCOREBOARD_STANDINGS_H
+#define SCOREBOARD_STANDINGS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "game_store.h"
+
+struct TeamRecord {
+  int wins = 0;
+  int losses = 0;
+  int ties = 0;
+  int pointsFor = 0;
+  int pointsAgainst = 0;
+
+  int differential() const { return pointsFor - pointsAgainst; }
+};
+
+// Where a team sorts in a leaderboard: most wins, then fewest losses, then
+// best point differential. The team id breaks ties so every key is unique.
+struct RankKey {
+  int wins;
+  int losses;
+  int differential;
+  std::uint16_t team;
+
+  // True if this sorts ahead of `other`
+  bool before(const RankKey& other) const;
+};
+
+// Order statistics tree (a treap with subtree sizes): insert, erase, rank
+// and k-th in O(log n). Nodes live in one vector and are recycled.
+class RankTree {
+ public:
+  RankTree() : root_(kNil), seed_(0x9e3779b9u) {}
+
+  void insert(const RankKey& key);
+  void erase(const RankKey& key);
+  std::size_t size() const { return root_ == kNil ? 0 : nodes_[root_].size; }
+
+  // 1 for the leader; `key` must be in the tree
+  std::size_t rank(const RankKey& key) const;
+  // The key at 0-based position `k`
+  const RankKey& at(std::size_t k) const;
+
+ private:
+  static const std::uint32_t kNil = 0xffffffff;
+
+  struct Node {
+    RankKey key;
+    std::uint32_t priority;
+    std::uint32_t size;
+    std::uint32_t left;
+    std::uint32_t right;
+  };
+
+  std::uint32_t sizeOf(std::uint32_t n) const { return n == kNil ? 0 : nodes_[n].size; }
+  void pull(std::uint32_t n) { nodes_[n].size = 1 + sizeOf(nodes_[n].left) + sizeOf(nodes_[n].right); }
+  // Splits `n` into keys before `key` and the rest
+  void split(std::uint32_t n, const RankKey& key, std::uint32_t& left, std::uint32_t& right);
+  std::uint32_t merge(std::uint32_t left, std::uint32_t right);
+  bool eraseFrom(std::uint32_t& n, const RankKey& key);
+
+  std::vector<Node> nodes_;
+  std::vector<std::uint32_t> free_;
+  std::uint32_t root_;
+  std::uint32_t seed_;
+};
+
+// Season standings kept up to date one game at a time.
+//
+// update() takes a game's latest result; if an earlier result for the same
+// game was applied it is backed out first, so live scores and corrections
+// only touch the two teams involved. Each touched team is moved in the
+// overall and conference leaderboards in O(log n); nothing is recomputed.
+class Standings {
+ public:
+  // Applies (or re-applies) one game. Unplayed games (negative points) only
+  // remove what an earlier update added.
+  void update(std::int64_t gameId, std::uint16_t homeTeam, std::uint16_t homeConference,
+              int homePoints, std::uint16_t awayTeam, std::uint16_t awayConference, int awayPoints);
+  // Convenience for a row of a GameStore
+  void update(const GameStore& store, std::size_t row);
+
+  const TeamRecord& record(std::uint16_t team) const;
+  // Conference of the team's latest game, StringPool::kNone if unknown
+  std::uint16_t conference(std::uint16_t team) const {
+    return team < teams_.size() ? teams_[team].conference : StringPool::kNone;
+  }
+  // 1-based places; 0 for a team that has not played
+  std::size_t rank(std::uint16_t team) const;
+  std::size_t conferenceRank(std::uint16_t team) const;
+
+  // The first `n` teams overall, or of one conference
+  void top(std::size_t n, std::vector<std::uint16_t>& teams) const;
+  void topInConference(std::uint16_t conference, std::size_t n, std::vector<std::uint16_t>& teams) const;
+
+ private:
+  struct Team {
+    TeamRecord record;
+    std::uint16_t conference = StringPool::kNone;
+    int games = 0; // Played games counted; ranked while > 0
+  };
+
+  // The result of a game as last applied
+  struct Result {
+    std::uint16_t homeTeam;
+    std::uint16_t awayTeam;
+    int homePoints;
+    int awayPoints;
+  };
+
+  Team& team(std::uint16_t id);
+  RankKey keyFor(std::uint16_t id) const;
+  // Moves one team's contribution in or out (sign +1 / -1)
+  void apply(std::uint16_t id, std::uint16_t conference, int scored, int allowed, int sign);
+
+  std::vector<Team> teams_; // Indexed by team id
+  std::unordered_map<std::int64_t, Result> applied_;
+  RankTree overall_;
+  std::unordered_map<std::uint16_t, RankTree> conferences_;
+};
+
+#endif // SCOREBOARD_STANDINGS_H
@@ -0,0 +1,64 @@
+#!/bin/sh
+# Runs bench_server against server on one event loop and fails unless every
+# request got its answer.
+#
+# Usage: tests/backends.sh BUILD_DIR epoll|io_uring [PORT]
+# ctest runs it as "backends_epoll" and "backends_io_uring". The backend is
+# driven with a connection per request, with keep-alive connections, with
+# the text dashboard and with conditional polls, which must get 304s. Where io_uring is not available the server falls back
+# to epoll, which was tested already, so the script exits 77 for ctest to
+# report the test as skipped.
+
+BUILD=${1:?usage: $0 BUILD_DIR epoll|io_uring [PORT]}
+BACKEND=${2:?usage: $0 BUILD_DIR epoll|io_uring [PORT]}
+PORT=${3:-19470}
+STATE=$(mktemp -d)
+SERVER=
+trap 'test -n "$SERVER" && kill $SERVER 2>/dev/null; rm -rf "$STATE"' EXIT
+
+status=0
+
+# bench ARGS...: one bench_server run, which must answer everything
+bench() {
+  out=$("$BUILD/bench_server" --port "$PORT" --seconds 2 "$@") || {
+    echo "$out"
+    echo "FAILED: bench_server $*"
+    status=1
+    return
+  }
+  echo "$out"
+  if ! echo "$out" | grep -q "Requests: [1-9][0-9]* ok, 0 failed, 0 timed out"; then
+    echo "FAILED: bench_server $* lost requests"
+    status=1
+  fi
+}
+
+case $BACKEND in
+  epoll) flag= ;;
+  io_uring) flag=--io-uring ;;
+  *) echo "Unknown backend $BACKEND"; exit 1 ;;
+esac
+"$BUILD/server" --port "$PORT" --threads 2 --state-dir "$STATE" $flag > "$STATE/server.log" 2>&1 &
+SERVER=$!
+# Up once it has restored the counters
+for i in 1 2 3 4 5 6 7 8 9 10; do
+  grep -q "Restored" "$STATE/server.log" && break
+  sleep 0.2
+done
+sleep 0.2
+
+if grep -q "not available" "$STATE/server.log"; then
+  echo "io_uring is not available here; skipped"
+  exit 77
+fi
+bench --devices 50
+bench --devices 500 --keep-alive
+bench --devices 50 --text
+bench --devices 50 --keep-alive --conditional
+if ! echo "$out" | grep -q "Conditional: [1-9][0-9]* of the ok answers were 304"; then
+  echo "FAILED: no 304s for conditional polls"
+  status=1
+fi
+
+test $status = 0 && echo "$BACKEND answered every request"
+exit $status
@@ -0,0 +1,85 @@
+#!/bin/sh
+# Runs two server nodes that sync with each other, posts heartbeats to each
+# and stats to one, and fails unless both end up serving the same dashboard
+# and the same heartbeat counts.
+#
+# Usage: tests/cluster.sh BUILD_DIR [PORT]
+# Uses PORT and PORT+1 for node 1 (HTTP, sync) and PORT+2 and PORT+3 for
+# node 2. ctest runs it as "cluster". Needs curl.
+
+BUILD=${1:?usage: $0 BUILD_DIR [PORT]}
+PORT=${2:-19490}
+STATE=$(mktemp -d)
+NODES=
+trap 'kill $NODES 2>/dev/null; rm -rf "$STATE"' EXIT
+
+status=0
+
+fail() {
+  echo "FAILED: $*"
+  status=1
+}
+
+# node ID: starts node ID (1 or 2), syncing with the other one
+node() {
+  http=$((PORT + 2 * ($1 - 1)))
+  peer=$((PORT + 2 * (2 - $1) + 1))
+  "$BUILD/server" --port $http --node-id $1 --sync-port $((http + 1)) \
+      --peer 127.0.0.1:$peer --state-dir "$STATE/node$1" > "$STATE/node$1.log" 2>&1 &
+  NODES="$NODES $!"
+}
+
+url() {
+  echo "http://127.0.0.1:$((PORT + 2 * ($1 - 1)))$2"
+}
+
+# heartbeats FROM TO: "user system" lines for users FROM..TO, 10 systems
+heartbeats() {
+  awk -v from=$1 -v to=$2 'BEGIN { for (i = from; i <= to; i++) print i, i % 10 }'
+}
+
+node 1
+node 2
+for i in 1 2 3 4 5 6 7 8 9 10; do
+  grep -q "Restored" "$STATE/node1.log" && grep -q "Restored" "$STATE/node2.log" && break
+  sleep 0.2
+done
+
+# 300 users on node 1, 200 on node 2 (100 of them the same), and the status
+# posted to node 2 only
+heartbeats 1 300 | curl -s -o /dev/null --data-binary @- "$(url 1 /gp/heartbeat)" ||
+  fail "posting heartbeats to node 1"
+heartbeats 201 400 | curl -s -o /dev/null --data-binary @- "$(url 2 /gp/heartbeat)" ||
+  fail "posting heartbeats to node 2"
+CODE=$(printf '|$|1|0|4|0|0|0|0|1|' |
+  curl -s -o /dev/null -w "%{http_code}" --data-binary @- "$(url 2 /gp/stats)")
+test "$CODE" = 200 || fail "posting stats to node 2 got $CODE"
+
+# Deltas go out once a second
+for i in 1 2 3 4 5 6 7 8 9 10; do
+  sleep 0.5
+  DBD1=$(curl -s "$(url 1 /gp/dbd.php)")
+  DBD2=$(curl -s "$(url 2 /gp/dbd.php)")
+  CLUSTER1=$(curl -s "$(url 1 /gp/cluster)" | sed 1d)
+  CLUSTER2=$(curl -s "$(url 2 /gp/cluster)" | sed 1d)
+  test "$DBD1" = "$DBD2" && test "$CLUSTER1" = "$CLUSTER2" &&
+    echo "$CLUSTER1" | grep -q "^heartbeats 500$" && break
+done
+echo "Node 1: $DBD1"
+echo "Node 2: $DBD2"
+test "$DBD1" = "$DBD2" || fail "the nodes serve different dashboards"
+test "$CLUSTER1" = "$CLUSTER2" || fail "the nodes count different heartbeats: $CLUSTER1 / $CLUSTER2"
+echo "$CLUSTER1" | grep -q "^heartbeats/1 300$" || fail "node 1's heartbeats: $CLUSTER1"
+echo "$CLUSTER1" | grep -q "^heartbeats/2 200$" || fail "node 2's heartbeats: $CLUSTER1"
+echo "$CLUSTER1" | grep -q "^heartbeats 500$" || fail "total heartbeats: $CLUSTER1"
+
+# |$|s1|s2|cj|dacu|dacs|acu|acs|night|: node 2's status on both, and about
+# 400 users of 10 systems today and in the last minute
+echo "$DBD1" | awk -F'|' '{
+  users = 400 * 0.05
+  exit !($3 == 1 && $4 == 0 && $5 == 4 && $10 == 1 && $7 == 10 && $9 == 10 &&
+         $6 > 400 - users && $6 < 400 + users && $8 > 400 - users && $8 < 400 + users)
+}' || fail "dashboard $DBD1 is not the merged status and activity"
+
+test $status = 0 && echo "Both nodes converged"
+exit $status
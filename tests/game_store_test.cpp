@@ -0,0 +1,151 @@
+// Fills GameStore and its StringPool with made-up games and checks what comes
+// back out: rows, overwrites, the column queries, the pool's ids running out
+// and the memory it reports.
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "../game_store.h"
+
+namespace {
+
+int g_failures = 0;
+
+#define CHECK(cond, ...)                                  \
+  do {                                                    \
+    if (!(cond)) {                                        \
+      std::printf("FAILED %s:%d: ", __FILE__, __LINE__);  \
+      std::printf(__VA_ARGS__);                           \
+      std::printf("\n");                                  \
+      g_failures++;                                       \
+    }                                                     \
+  } while (0)
+
+GameRecord game(std::int64_t id, int season, int week, const char* home, const char* away,
+                int homePoints, int awayPoints) {
+  GameRecord g;
+  g.id = id;
+  g.season = season;
+  g.week = week;
+  g.seasonType = week > 15 ? "postseason" : "regular";
+  g.homeTeam = home;
+  g.homeConference = "SEC";
+  g.homePoints = homePoints;
+  g.awayTeam = away;
+  g.awayConference = "Big Ten";
+  g.awayPoints = awayPoints;
+  g.venueId = static_cast<int>(id % 100);
+  g.venue = std::string(home) + " Stadium";
+  return g;
+}
+
+void testStringPool() {
+  StringPool pool;
+  std::uint16_t a = pool.intern("Alabama");
+  std::uint16_t b = pool.intern("Auburn");
+  CHECK(a == 0 && b == 1, "ids not dense: %u %u", a, b);
+  CHECK(pool.intern("Alabama") == a && pool.find("Alabama") == a, "same name, another id");
+  CHECK(pool.find("Alabam") == StringPool::kNone && pool.find("Alabama ") == StringPool::kNone,
+        "found a name never interned");
+  CHECK(std::strcmp(pool.name(b), "Auburn") == 0, "name(%u) is %s", b, pool.name(b));
+  std::uint16_t empty = pool.intern("");
+  CHECK(pool.find("") == empty && pool.name(empty)[0] == '\0', "empty name");
+
+  // A name bigger than a block gets one of its own, and counts in full
+  std::size_t before = pool.bytes();
+  std::string huge(100000, 'x');
+  std::uint16_t big = pool.intern(huge);
+  CHECK(pool.name(big) == huge, "oversized name changed");
+  CHECK(pool.bytes() >= before + huge.size(), "oversized name counted as %zu bytes",
+        pool.bytes() - before);
+
+  // Every id in use: new names get kNone, old ones are still there
+  const char* first = pool.name(a);
+  for (std::size_t i = pool.size(); i < StringPool::kNone; i++) {
+    pool.intern("name " + std::to_string(i));
+  }
+  CHECK(pool.size() == StringPool::kNone, "%zu names", pool.size());
+  CHECK(pool.intern("one too many") == StringPool::kNone, "a name past the last id was interned");
+  CHECK(pool.find("one too many") == StringPool::kNone, "a refused name was found");
+  CHECK(pool.intern("Auburn") == b && pool.find("name 60000") == 60000, "old names lost");
+  CHECK(pool.name(a) == first, "names moved");
+}
+
+void testGameStore() {
+  GameStore store;
+  CHECK(store.add(game(1, 2018, 1, "Alabama", "Louisville", 51, 14)) == 0, "first row");
+  CHECK(store.add(game(2, 2018, 1, "Auburn", "Washington", 21, 16)) == 1, "second row");
+  CHECK(store.add(game(3, 2018, 2, "Alabama", "Arkansas State", -1, -1)) == 2, "third row");
+  CHECK(store.add(game(4, 2018, 16, "Clemson", "Alabama", 44, 16)) == 3, "fourth row");
+
+  // A corrected score overwrites the row with the same id
+  CHECK(store.add(game(3, 2018, 2, "Alabama", "Arkansas State", 57, 7)) == 2, "overwrite");
+  CHECK(store.size() == 4, "%zu rows", store.size());
+  GameRow r = store.row(2);
+  CHECK(r.id == 3 && r.season == 2018 && r.week == 2 && !r.postseason && r.homePoints == 57 &&
+            r.awayPoints == 7,
+        "row 2 is game %lld, %d-%d", (long long)r.id, r.homePoints, r.awayPoints);
+  CHECK(std::strcmp(store.names().name(r.homeTeam), "Alabama") == 0 &&
+            std::strcmp(store.names().name(r.awayTeam), "Arkansas State") == 0,
+        "row 2's teams");
+  CHECK(std::strcmp(store.names().name(store.homeConference(2)), "SEC") == 0 &&
+            std::strcmp(store.names().name(store.awayConference(2)), "Big Ten") == 0 &&
+            store.venueId(2) == 3,
+        "row 2's conferences and venue");
+
+  std::vector<std::uint32_t> rows;
+  store.gamesForTeam(store.teamId("Alabama"), rows);
+  CHECK(rows.size() == 3 && rows[0] == 0 && rows[1] == 2 && rows[2] == 3, "Alabama: %zu games",
+        rows.size());
+  store.gamesForTeam(store.teamId("Nobody"), rows);
+  CHECK(rows.empty(), "a team never seen has %zu games", rows.size());
+  store.gamesInWeek(2018, 1, false, rows);
+  CHECK(rows.size() == 2 && rows[0] == 0 && rows[1] == 1, "week 1: %zu games", rows.size());
+  store.gamesInWeek(2018, 16, true, rows);
+  CHECK(rows.size() == 1 && rows[0] == 3, "postseason: %zu games", rows.size());
+  store.gamesInWeek(2018, 16, false, rows);
+  CHECK(rows.empty(), "regular season week 16: %zu games", rows.size());
+
+  // Games whose names run the pool out of ids are refused whole
+  std::size_t added = 0;
+  std::int64_t id = 100;
+  while (store.names().size() + 5 <= StringPool::kNone) {
+    std::string n = std::to_string(id);
+    GameRecord g = game(id++, 2019, 1, ("Home " + n).c_str(), ("Away " + n).c_str(), 1, 0);
+    g.homeConference = "Conference " + n;
+    g.awayConference = "Other conference " + n;
+    if (store.add(g) != GameStore::kNoRow) added++;
+  }
+  CHECK(added > 10000, "only %zu games fit", added);
+  std::size_t size = store.size();
+  GameRecord last = game(id, 2019, 1, "Home last", "Away last", 1, 0);
+  last.homeConference = "Conference last";
+  last.awayConference = "Other conference last";
+  CHECK(store.add(last) == GameStore::kNoRow, "a game past the last id was added");
+  CHECK(store.size() == size, "a refused game took a row");
+  GameRecord overwrite = game(1, 2018, 1, "Alabama", "Someone new", 0, 0);
+  CHECK(store.add(overwrite) == GameStore::kNoRow, "an overwrite past the last id was taken");
+  r = store.row(0);
+  CHECK(std::strcmp(store.names().name(r.awayTeam), "Louisville") == 0 && r.homePoints == 51,
+        "a refused overwrite changed the row");
+  // Names already in the pool still fit
+  CHECK(store.add(game(2, 2018, 1, "Auburn", "Washington", 24, 16)) == 1,
+        "an overwrite with known names was refused");
+}
+
+} // namespace
+
+int main() {
+  testStringPool();
+  testGameStore();
+  if (g_failures > 0) {
+    std::printf("%d checks failed\n", g_failures);
+    return EXIT_FAILURE;
+  }
+  std::printf("All passed\n");
+  return 0;
+}
@@ -0,0 +1,84 @@
+#!/bin/sh
+# Drives server --upstream against fake_upstream and checks the games proxy:
+#  - concurrent requests for a cold query make one upstream request
+#  - a client's If-None-Match gets a 304, and refreshes revalidate upstream
+#  - with the upstream down, a cold query gets a 502 and a warm one is
+#    still served from the last good copy
+#
+# Usage: tests/games_proxy.sh BUILD_DIR [PORT]
+# Uses PORT for the server and PORT+1 for the upstream. ctest runs it as
+# "games_proxy" when the server is built with libcurl. Needs curl.
+
+BUILD=${1:?usage: $0 BUILD_DIR [PORT]}
+PORT=${2:-19480}
+UPSTREAM_PORT=$((PORT + 1))
+STATE=$(mktemp -d)
+SERVER=
+UPSTREAM=
+trap 'kill $SERVER $UPSTREAM 2>/dev/null; rm -rf "$STATE"' EXIT
+
+URL="http://127.0.0.1:$PORT/games"
+status=0
+
+fail() {
+  echo "FAILED: $*"
+  status=1
+}
+
+# upstreamHits QUERY STATUS: how often the upstream answered QUERY with STATUS
+upstreamHits() {
+  grep -c "^GET /games?$1 $2\$" "$STATE/upstream.log"
+}
+
+"$BUILD/fake_upstream" --port "$UPSTREAM_PORT" --delay 300 --log > "$STATE/upstream.log" 2>&1 &
+UPSTREAM=$!
+"$BUILD/server" --port "$PORT" --state-dir "$STATE/state" --games-cache "$STATE/cache" \
+    --upstream "http://127.0.0.1:$UPSTREAM_PORT" --refresh 2 > "$STATE/server.log" 2>&1 &
+SERVER=$!
+for i in 1 2 3 4 5 6 7 8 9 10; do
+  grep -q "Restored" "$STATE/server.log" && grep -q "Serving" "$STATE/upstream.log" && break
+  sleep 0.2
+done
+
+# A cold query asked for 20 times at once is fetched once
+KEY="year=2018&seasonType=regular&week=3"
+pids=
+for i in 1 2 3 4 5 6 7 8 9 10 11 12 13 14 15 16 17 18 19 20; do
+  curl -s -o "$STATE/cold.$i" -w "%{http_code}\n" "$URL?year=2018&week=3" >> "$STATE/codes" &
+  pids="$pids $!"
+done
+wait $pids
+test "$(grep -c '^200$' "$STATE/codes")" = 20 || fail "cold requests: $(sort "$STATE/codes" | uniq -c)"
+for i in 2 3 4 5 6 7 8 9 10 11 12 13 14 15 16 17 18 19 20; do
+  cmp -s "$STATE/cold.1" "$STATE/cold.$i" || fail "cold request $i got a different body"
+done
+test "$(upstreamHits "$KEY" 200)" = 1 || fail "$(upstreamHits "$KEY" 200) upstream fetches for 20 requests"
+echo "20 concurrent cold requests: $(upstreamHits "$KEY" 200) upstream fetch"
+
+# The client's copy is current
+ETAG=$(curl -s -D - -o /dev/null "$URL?year=2018&week=3" | tr -d '\r' | sed -n 's/^ETag: //p')
+CODE=$(curl -s -o /dev/null -w "%{http_code}" -H "If-None-Match: $ETAG" "$URL?year=2018&week=3")
+test "$CODE" = 304 || fail "If-None-Match $ETAG got $CODE"
+echo "If-None-Match: $CODE"
+
+# A refresh round revalidates against the cached copy
+sleep 3
+test "$(upstreamHits "$KEY" 304)" -ge 1 || fail "no refresh was revalidated upstream"
+echo "Refreshes revalidated upstream: $(upstreamHits "$KEY" 304)"
+
+# Upstream down: let a refresh round fail, then ask for a cold and a warm query
+kill $UPSTREAM
+wait $UPSTREAM 2>/dev/null
+UPSTREAM=
+sleep 3
+grep -q "Failed to fetch .*week=3" "$STATE/server.log" || fail "no refresh failed"
+CODE=$(curl -s -o /dev/null -w "%{http_code}" "$URL?year=2018&week=9")
+test "$CODE" = 502 || fail "cold query with the upstream down got $CODE"
+echo "Cold query, upstream down: $CODE"
+CODE=$(curl -s -o "$STATE/stale" -w "%{http_code}" "$URL?year=2018&week=3")
+test "$CODE" = 200 || fail "warm query with the upstream down got $CODE"
+cmp -s "$STATE/cold.1" "$STATE/stale" || fail "warm query with the upstream down changed"
+echo "Warm query, upstream down: $CODE, last good copy"
+
+test $status = 0 && echo "Games proxy checks passed"
+exit $status
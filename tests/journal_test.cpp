@@ -0,0 +1,215 @@
+// Crashes ActivityJournal at the points restore() has to cope with, by
+// leaving its files the way a crash would, and checks the counters come
+// back: a log whose last entry was torn, a log a checkpoint had rotated out
+// but whose snapshot was never written, and a damaged snapshot.
+
+#include <sys/stat.h> // For stat
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <string>
+#include <unistd.h> // For truncate, access, unlink, rmdir
+
+#include "../activity.h"
+#include "../journal.h"
+
+namespace {
+
+int g_failures = 0;
+
+#define CHECK(cond, ...)                                  \
+  do {                                                    \
+    if (!(cond)) {                                        \
+      std::printf("FAILED %s:%d: ", __FILE__, __LINE__);  \
+      std::printf(__VA_ARGS__);                           \
+      std::printf("\n");                                  \
+      g_failures++;                                       \
+    }                                                     \
+  } while (0)
+
+std::string g_dir;
+
+std::string path(const char* name) { return g_dir + "/" + name; }
+
+long fileSize(const std::string& file) {
+  struct stat st;
+  return stat(file.c_str(), &st) == 0 ? static_cast<long>(st.st_size) : -1;
+}
+
+bool exists(const std::string& file) { return access(file.c_str(), F_OK) == 0; }
+
+void removeAll() {
+  const char* names[] = {"activity.snap", "activity.snap.tmp", "activity.log", "activity.log.old"};
+  for (int i = 0; i < 4; i++) unlink(path(names[i]).c_str());
+}
+
+// Counts `n` heartbeats from users `first`.. on 4 systems, all of them
+// journaled the way the server does: a batch to an entry
+void post(ActivityCounters& activity, ActivityJournal& journal, std::uint64_t first, int n,
+          std::time_t now) {
+  Heartbeat changed[64];
+  std::size_t changes = 0;
+  for (int i = 0; i < n; i++) {
+    Heartbeat hb = {first + i, (first + i) % 4};
+    if (activity.record(hb.user, hb.system, now)) changed[changes++] = hb;
+  }
+  journal.append(now, changed, changes, activity.recorded());
+}
+
+// What a restart finds: the heartbeats recorded and users seen today
+struct Restored {
+  std::uint64_t recorded;
+  int usersToday;
+  std::size_t replayed;
+};
+
+Restored restart(std::time_t now) {
+  ActivityCounters activity(now);
+  ActivityJournal journal(g_dir);
+  Restored r = {0, 0, 0};
+  if (!journal.restore(activity, now)) return r;
+  r.recorded = activity.recorded();
+  r.usersToday = activity.tick(now).usersToday;
+  r.replayed = journal.replayed();
+  return r;
+}
+
+// The server died in the middle of an append: the torn entry is dropped,
+// and entries appended after the restart follow straight on
+void testTornEntry(std::time_t now) {
+  removeAll();
+  long first = 0;
+  {
+    ActivityCounters activity(now);
+    ActivityJournal journal(g_dir);
+    CHECK(journal.restore(activity, now), "restore of an empty directory failed");
+    post(activity, journal, 1, 10, now);
+    first = fileSize(path("activity.log"));
+    post(activity, journal, 11, 10, now);
+  }
+  long whole = fileSize(path("activity.log"));
+  CHECK(first > 0 && whole > first, "nothing was journaled");
+  CHECK(truncate(path("activity.log").c_str(), whole - 5) == 0, "truncate failed");
+
+  {
+    ActivityCounters activity(now);
+    ActivityJournal journal(g_dir);
+    CHECK(journal.restore(activity, now), "restore after a torn entry failed");
+    CHECK(activity.recorded() == 10, "torn log: %llu heartbeats recorded, not 10",
+          (unsigned long long)activity.recorded());
+    CHECK(fileSize(path("activity.log")) == first, "torn tail not truncated: %ld bytes, not %ld",
+          fileSize(path("activity.log")), first);
+    post(activity, journal, 21, 10, now);
+  }
+
+  Restored r = restart(now);
+  CHECK(r.recorded == 20 && r.replayed == 20, "after appending past the tear: %llu recorded",
+        (unsigned long long)r.recorded);
+  CHECK(r.usersToday >= 19 && r.usersToday <= 21, "after appending past the tear: %d users",
+        r.usersToday);
+}
+
+// A checkpoint rotated the log to activity.log.old, then the server died
+// before the snapshot was written: the old log is replayed before the new
+// one, and only goes once a snapshot covering it is written
+void testOldLog(std::time_t now) {
+  removeAll();
+  {
+    ActivityCounters activity(now);
+    ActivityJournal journal(g_dir);
+    journal.restore(activity, now);
+    post(activity, journal, 1, 30, now);
+  }
+  CHECK(std::rename(path("activity.log").c_str(), path("activity.log.old").c_str()) == 0,
+        "rename failed");
+  {
+    ActivityCounters activity(now);
+    ActivityJournal journal(g_dir);
+    CHECK(journal.restore(activity, now), "restore with an old log failed");
+    CHECK(activity.recorded() == 30, "old log: %llu recorded, not 30",
+          (unsigned long long)activity.recorded());
+    post(activity, journal, 31, 20, now);
+  }
+  CHECK(exists(path("activity.log.old")), "the old log went without a snapshot");
+
+  {
+    ActivityCounters activity(now);
+    ActivityJournal journal(g_dir);
+    journal.restore(activity, now);
+    CHECK(activity.recorded() == 50, "old and new log: %llu recorded, not 50",
+          (unsigned long long)activity.recorded());
+    CHECK(journal.checkpoint(activity), "checkpoint failed");
+  } // Waits for the snapshot
+  CHECK(!exists(path("activity.log.old")), "the old log outlived its snapshot");
+
+  // The log the snapshot was taken beside is replayed on top of it; that
+  // must not count anything twice
+  Restored r = restart(now);
+  CHECK(r.recorded == 50, "from the snapshot: %llu recorded, not 50",
+        (unsigned long long)r.recorded);
+  CHECK(r.usersToday >= 48 && r.usersToday <= 52, "from the snapshot: %d users", r.usersToday);
+}
+
+// A snapshot that doesn't match its checksum is ignored, and the log since
+// is still replayed. The log's entries carry the heartbeat count, so only
+// the sketches lose what the snapshot had.
+void testBadSnapshot(std::time_t now) {
+  removeAll();
+  {
+    ActivityCounters activity(now);
+    ActivityJournal journal(g_dir);
+    journal.restore(activity, now);
+    post(activity, journal, 1, 40, now);
+    CHECK(journal.checkpoint(activity), "checkpoint failed");
+  }
+  {
+    ActivityCounters activity(now);
+    ActivityJournal journal(g_dir);
+    journal.restore(activity, now);
+    CHECK(activity.recorded() == 40, "good snapshot: %llu recorded, not 40",
+          (unsigned long long)activity.recorded());
+    post(activity, journal, 41, 5, now);
+  }
+
+  // Flip one bit of the state, well past the header
+  std::fstream snap(path("activity.snap").c_str(),
+                    std::ios::in | std::ios::out | std::ios::binary);
+  snap.seekg(100);
+  char byte = 0;
+  snap.get(byte);
+  snap.seekp(100);
+  snap.put(static_cast<char>(byte ^ 1));
+  snap.close();
+
+  Restored r = restart(now);
+  CHECK(r.recorded == 45 && r.replayed == 5, "bad snapshot: %llu recorded, %zu replayed",
+        (unsigned long long)r.recorded, r.replayed);
+  CHECK(r.usersToday == 5, "bad snapshot: %d users, not the log's 5", r.usersToday);
+}
+
+} // namespace
+
+int main() {
+  char dir[] = "/tmp/journal_test.XXXXXX";
+  if (!mkdtemp(dir)) {
+    std::printf("Failed to create a directory\n");
+    return EXIT_FAILURE;
+  }
+  g_dir = dir;
+
+  std::time_t now = std::time(nullptr);
+  testTornEntry(now);
+  testOldLog(now);
+  testBadSnapshot(now);
+
+  removeAll();
+  rmdir(dir);
+  if (g_failures > 0) {
+    std::printf("%d checks failed\n", g_failures);
+    return EXIT_FAILURE;
+  }
+  std::printf("All passed\n");
+  return 0;
+}
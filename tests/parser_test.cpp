@@ -0,0 +1,779 @@
+// Feeds the incremental parsers (dashboard_parser.h on the scoreboards,
+// HttpParser on the server) canned input split at every possible point, and
+// randomly damaged input, and checks they come out where parsing it in one
+// go does. Both only ever see data as it happens to arrive, so resuming at any
+// byte boundary is what matters.
+//
+// Also checks the other decoders of outside input the same way: the game
+// feed's JSON parser (json_sax.h), and cluster delta frames (cluster.h),
+// cut short, padded and tampered with. Those frames carry the activity
+// sketches, so their error bounds, the 60 second window and the day are
+// checked here too, on a made-up clock.
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <cstring>
+#include <ctime>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../activity.h"
+#include "../cluster.h"
+#include "../dashboard.h"
+#include "../dashboard_parser.h"
+#include "../http_parser.h"
+#include "../json_sax.h"
+
+namespace {
+
+int g_failures = 0;
+
+#define CHECK(cond, ...)                                  \
+  do {                                                    \
+    if (!(cond)) {                                        \
+      std::printf("FAILED %s:%d: ", __FILE__, __LINE__);  \
+      std::printf(__VA_ARGS__);                           \
+      std::printf("\n");                                  \
+      g_failures++;                                       \
+    }                                                     \
+  } while (0)
+
+//////////////////////////////////////////////////////////////////////////////
+// Dashboard responses
+
+// What the parser reported, in order: one entry per DBP_DONE (the values and
+// the ETag seen so far) or DBP_NOT_MODIFIED
+struct Event {
+  int result;
+  std::vector<std::int32_t> values;
+  std::uint32_t etag;
+
+  bool operator==(const Event& o) const {
+    return result == o.result && values == o.values && etag == o.etag;
+  }
+};
+
+// Feeds `bytes` in chunks that end at each of `splits`, the way the sketch
+// hands over whatever recv() returned
+std::vector<Event> feedDashboard(DashboardParser& parser, const std::string& bytes,
+                                 const std::vector<std::size_t>& splits) {
+  dbpBegin(&parser);
+  std::vector<Event> events;
+  std::size_t from = 0;
+  for (std::size_t s = 0; s <= splits.size(); s++) {
+    std::size_t to = s < splits.size() ? splits[s] : bytes.size();
+    for (std::size_t i = from; i < to; i++) {
+      int8_t result = dbpFeed(&parser, static_cast<std::uint8_t>(bytes[i]));
+      if (result != DBP_DONE && result != DBP_NOT_MODIFIED) continue;
+      Event e;
+      e.result = result;
+      if (result == DBP_DONE) e.values.assign(parser.values, parser.values + DBW_FIELDS);
+      e.etag = parser.etag;
+      events.push_back(e);
+    }
+    from = to;
+  }
+  return events;
+}
+
+std::vector<Event> feedDashboard(const std::string& bytes, const std::vector<std::size_t>& splits) {
+  DashboardParser parser;
+  return feedDashboard(parser, bytes, splits);
+}
+
+std::string httpReply(const char* status, const char* contentType, const std::string& body,
+                      const char* etag) {
+  std::string head = std::string("HTTP/1.1 ") + status + "\r\n";
+  if (contentType) head += std::string("Content-Type: ") + contentType + "\r\n";
+  if (etag) head += std::string("ETag: \"") + etag + "\"\r\n";
+  if (contentType) head += "Content-Length: " + std::to_string(body.size()) + "\r\n";
+  return head + "Connection: close\r\n\r\n" + body;
+}
+
+DashboardStats sampleStats(int i) {
+  DashboardStats stats;
+  stats.s1 = 1;
+  stats.s2 = i % 2;
+  stats.cj = 0;
+  stats.dacu = 1234567 * i;
+  stats.dacs = 33000 + i;
+  stats.acu = i * 7;
+  stats.acs = i == 2 ? -1 : i; // No data
+  stats.nightMode = i % 2;
+  return stats;
+}
+
+std::vector<std::int32_t> valuesOf(const DashboardStats& s) {
+  std::int32_t v[DBW_FIELDS];
+  v[DBW_S1] = s.s1;
+  v[DBW_S2] = s.s2;
+  v[DBW_CJ] = s.cj;
+  v[DBW_DACU] = s.dacu;
+  v[DBW_DACS] = s.dacs;
+  v[DBW_ACU] = s.acu;
+  v[DBW_ACS] = s.acs;
+  v[DBW_NIGHT] = s.nightMode;
+  return std::vector<std::int32_t>(v, v + DBW_FIELDS);
+}
+
+struct DashboardCase {
+  const char* name;
+  std::string bytes;
+  std::vector<Event> expected;
+};
+
+std::vector<DashboardCase> dashboardCases() {
+  std::vector<DashboardCase> cases;
+  for (int i = 1; i <= 3; i++) {
+    DashboardStats stats = sampleStats(i);
+    char text[128];
+    std::string body(text, formatDashboard(stats, text, sizeof(text)));
+    std::uint8_t frame[DBW_MAX_FRAME];
+    std::string binary(reinterpret_cast<char*>(frame), encodeDashboard(stats, frame));
+    Event done = {DBP_DONE, valuesOf(stats), 0x1a2b3c4du};
+
+    DashboardCase text1 = {"text reply", httpReply("200 OK", "text/plain", body + "\n", "1a2b3c4d"),
+                           std::vector<Event>(1, done)};
+    DashboardCase binary1 = {"binary reply",
+                             httpReply("200 OK", DBW_CONTENT_TYPE, binary, "1A2B3C4D"),
+                             std::vector<Event>(1, done)};
+    cases.push_back(text1);
+    cases.push_back(binary1);
+  }
+
+  Event notModified = {DBP_NOT_MODIFIED, std::vector<std::int32_t>(), 0xdeadbeefu};
+  DashboardCase unchanged = {"304", httpReply("304 Not Modified", nullptr, "", "deadbeef"),
+                             std::vector<Event>(1, notModified)};
+  cases.push_back(unchanged);
+
+  // A push stream: headers without a tag, then frames and heartbeats
+  DashboardCase push = {"push stream",
+                        "HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\nConnection: close\r\n\r\n",
+                        std::vector<Event>()};
+  for (int i = 1; i <= 3; i++) {
+    char text[128];
+    push.bytes += std::string(text, formatDashboard(sampleStats(i), text, sizeof(text))) + "\n\n";
+    Event e = {DBP_DONE, valuesOf(sampleStats(i)), 0};
+    push.expected.push_back(e);
+  }
+  cases.push_back(push);
+  return cases;
+}
+
+void testDashboardParser() {
+  std::vector<DashboardCase> cases = dashboardCases();
+  std::size_t runs = 0;
+  for (std::size_t c = 0; c < cases.size(); c++) {
+    const DashboardCase& tc = cases[c];
+    std::vector<std::size_t> none;
+    CHECK(feedDashboard(tc.bytes, none) == tc.expected, "%s: whole", tc.name);
+
+    // Every single split, then every pair of splits
+    for (std::size_t a = 0; a <= tc.bytes.size(); a++) {
+      std::vector<std::size_t> one(1, a);
+      CHECK(feedDashboard(tc.bytes, one) == tc.expected, "%s: split at %zu", tc.name, a);
+      for (std::size_t b = a; b <= tc.bytes.size(); b++) {
+        std::vector<std::size_t> two;
+        two.push_back(a);
+        two.push_back(b);
+        CHECK(feedDashboard(tc.bytes, two) == tc.expected, "%s: split at %zu, %zu", tc.name, a, b);
+        runs++;
+      }
+    }
+  }
+
+  // Damaged replies may parse to anything or nothing, but a good reply after
+  // one must still come out right: the parser always finds its way back
+  std::minstd_rand rng(7);
+  for (int round = 0; round < 20000; round++) {
+    const DashboardCase& damaged = cases[rng() % cases.size()];
+    const DashboardCase& good = cases[rng() % cases.size()];
+    std::string bytes = damaged.bytes;
+    int edits = 1 + rng() % 4;
+    for (int e = 0; e < edits && !bytes.empty(); e++) {
+      std::size_t at = rng() % bytes.size();
+      switch (rng() % 3) {
+        case 0: bytes[at] = static_cast<char>(rng()); break;
+        case 1: bytes.erase(at, 1 + rng() % 8); break;
+        default: bytes.resize(at); break; // Cut off
+      }
+    }
+    DashboardParser parser;
+    dbpBegin(&parser);
+    for (std::size_t i = 0; i < bytes.size(); i++) {
+      dbpFeed(&parser, static_cast<std::uint8_t>(bytes[i]));
+    }
+    // The connection is gone; the sketch begins the next response with the
+    // same parser
+    std::vector<std::size_t> split(1, rng() % (good.bytes.size() + 1));
+    CHECK(feedDashboard(parser, good.bytes, split) == good.expected, "%s after damaged %s", good.name,
+          damaged.name);
+    runs++;
+  }
+  std::printf("dashboard parser: %zu runs over %zu responses\n", runs, cases.size());
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// HTTP requests
+
+struct Expected {
+  const char* method;
+  const char* path;
+  const char* query;
+  const char* header;      // A header to look up...
+  const char* headerValue; // ...and what it should be
+  const char* body;
+  bool keepAlive;
+};
+
+struct RequestCase {
+  const char* name;
+  std::string bytes;
+  std::vector<Expected> requests; // Pipelined ones in order
+};
+
+bool sameAs(const HttpRequest& req, const Expected& e) {
+  return req.method == e.method && req.path == e.path && req.query == e.query &&
+         req.header(e.header) == e.headerValue && req.body == e.body &&
+         req.keepAlive == e.keepAlive;
+}
+
+std::vector<RequestCase> requestCases() {
+  std::vector<RequestCase> cases;
+  Expected poll = {"GET", "/gp/dbd.php", "", "Host", "192.168.1.112", "", false};
+  RequestCase sketch = {"sketch poll",
+                        "GET /gp/dbd.php HTTP/1.1\r\nHost: 192.168.1.112\r\n"
+                        "Accept: application/x-dashboard\r\nIf-None-Match: \"0badf00d\"\r\n"
+                        "Connection: close\r\n\r\n",
+                        std::vector<Expected>(1, poll)};
+  cases.push_back(sketch);
+
+  Expected heartbeat = {"POST", "/gp/heartbeat", "", "content-length", "8", "1 2\n3 4\n", true};
+  RequestCase post = {"heartbeat post",
+                      "POST /gp/heartbeat HTTP/1.1\r\nHost: x\r\nContent-Length: 8\r\n\r\n"
+                      "1 2\n3 4\n",
+                      std::vector<Expected>(1, heartbeat)};
+  cases.push_back(post);
+
+  Expected games = {"GET", "/games", "year=2018&week=3", "X-Spaced", "a b", "", true};
+  Expected old = {"HEAD", "/", "", "Connection", "keep-alive", "", true};
+  Expected last = {"GET", "/metrics", "", "Connection", "close", "", false};
+  RequestCase pipelined = {"pipelined",
+                           "GET /games?year=2018&week=3 HTTP/1.1\r\nX-Spaced:   a b  \r\n\r\n"
+                           "HEAD / HTTP/1.0\r\nConnection: keep-alive\r\n\r\n"
+                           "GET /metrics HTTP/1.1\r\nConnection: close\r\n\r\n",
+                           std::vector<Expected>()};
+  pipelined.requests.push_back(games);
+  pipelined.requests.push_back(old);
+  pipelined.requests.push_back(last);
+  cases.push_back(pipelined);
+  return cases;
+}
+
+// Delivers `bytes` to the parser the way a connection buffers them: the
+// first `split` bytes, then the rest, parsing after each arrival and
+// trimming what was consumed
+bool parseSplit(const RequestCase& tc, std::size_t split) {
+  HttpParser parser;
+  std::string in;
+  std::size_t next = 0;
+  for (int arrival = 0; arrival < 2; arrival++) {
+    in += arrival == 0 ? tc.bytes.substr(0, split) : tc.bytes.substr(split);
+    std::size_t offset = 0;
+    while (offset < in.size()) {
+      HttpRequest req;
+      std::size_t consumed = 0;
+      HttpParser::Status status = parser.parse(in.data() + offset, in.size() - offset, req, consumed);
+      if (status == HttpParser::kIncomplete) break;
+      if (status == HttpParser::kError) return false;
+      if (next == tc.requests.size() || !sameAs(req, tc.requests[next])) return false;
+      next++;
+      offset += consumed;
+    }
+    in.erase(0, offset);
+  }
+  return next == tc.requests.size() && in.empty();
+}
+
+// The same, one byte at a time
+bool parseBytewise(const RequestCase& tc) {
+  HttpParser parser;
+  std::string in;
+  std::size_t next = 0;
+  for (std::size_t i = 0; i < tc.bytes.size(); i++) {
+    in += tc.bytes[i];
+    HttpRequest req;
+    std::size_t consumed = 0;
+    HttpParser::Status status = parser.parse(in.data(), in.size(), req, consumed);
+    if (status == HttpParser::kError) return false;
+    if (status == HttpParser::kIncomplete) continue;
+    if (next == tc.requests.size() || !sameAs(req, tc.requests[next])) return false;
+    next++;
+    in.erase(0, consumed);
+  }
+  return next == tc.requests.size() && in.empty();
+}
+
+void testHttpParser() {
+  std::vector<RequestCase> cases = requestCases();
+  std::size_t runs = 0;
+  for (std::size_t c = 0; c < cases.size(); c++) {
+    const RequestCase& tc = cases[c];
+    for (std::size_t split = 0; split <= tc.bytes.size(); split++) {
+      CHECK(parseSplit(tc, split), "%s: split at %zu", tc.name, split);
+      runs++;
+    }
+    CHECK(parseBytewise(tc), "%s: byte at a time", tc.name);
+    runs++;
+  }
+
+  // Random damage must only ever end in an error or a request that lies
+  // within what was parsed
+  std::minstd_rand rng(11);
+  for (int round = 0; round < 20000; round++) {
+    std::string bytes = cases[rng() % cases.size()].bytes;
+    int edits = 1 + rng() % 4;
+    for (int e = 0; e < edits && !bytes.empty(); e++) {
+      std::size_t at = rng() % bytes.size();
+      if (rng() % 2) bytes[at] = static_cast<char>(rng());
+      else bytes.erase(at, 1 + rng() % 8);
+    }
+    HttpParser parser;
+    std::size_t offset = 0;
+    for (std::size_t size = 1; size <= bytes.size(); size++) {
+      if (size <= offset) continue;
+      HttpRequest req;
+      std::size_t consumed = 0;
+      HttpParser::Status status = parser.parse(bytes.data() + offset, size - offset, req, consumed);
+      if (status == HttpParser::kError) break;
+      if (status == HttpParser::kIncomplete) continue;
+      CHECK(consumed > 0 && consumed <= size - offset, "damaged request consumed %zu of %zu",
+            consumed, size - offset);
+      CHECK(req.body.data + req.body.size <= bytes.data() + size, "body past the buffer");
+      offset += consumed;
+    }
+    runs++;
+  }
+  std::printf("http parser: %zu runs over %zu requests\n", runs, cases.size());
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// JSON
+
+// Writes the events down as one line: "{ k:a n:1 s:x ] t f null"
+class JsonRecorder : public JsonHandler {
+ public:
+  std::string events;
+
+  void startObject() override { add("{"); }
+  void endObject() override { add("}"); }
+  void startArray() override { add("["); }
+  void endArray() override { add("]"); }
+  void key(const std::string& name) override { add("k:" + name); }
+  void string(const std::string& value) override { add("s:" + value); }
+  void number(const std::string& text) override { add("n:" + text); }
+  void boolean(bool value) override { add(value ? "t" : "f"); }
+  void null() override { add("null"); }
+
+ private:
+  void add(const std::string& event) {
+    if (!events.empty()) events += ' ';
+    events += event;
+  }
+};
+
+// Parses `json` fed in two pieces split at `split`. Returns the events, or
+// "error" if it was refused.
+std::string parseJson(const std::string& json, std::size_t split) {
+  JsonRecorder recorder;
+  JsonStreamParser parser(recorder);
+  bool ok = parser.feed(json.data(), split) &&
+            parser.feed(json.data() + split, json.size() - split) && parser.finish();
+  return ok ? recorder.events : "error";
+}
+
+struct JsonCase {
+  const char* json;
+  const char* events; // "error" if it must be refused
+};
+
+void testJsonParser() {
+  const JsonCase cases[] = {
+      // Numbers: -?(0|[1-9][0-9]*)(.[0-9]+)?([eE][+-]?[0-9]+)?
+      {"[0,-0,12,-12.5,0.25,1e5,1E+5,1.5e-3,-0e0]",
+       "[ n:0 n:-0 n:12 n:-12.5 n:0.25 n:1e5 n:1E+5 n:1.5e-3 n:-0e0 ]"},
+      {"42", "n:42"},
+      {"{\"week\":3}", "{ k:week n:3 }"},
+      {"[1-2]", "error"},
+      {"[01]", "error"},
+      {"[-01]", "error"},
+      {"[00]", "error"},
+      {"[1e5e5]", "error"},
+      {"[--1]", "error"},
+      {"[1.2.3]", "error"},
+      {"[1.]", "error"},
+      {"[1.e5]", "error"},
+      {"[.5]", "error"},
+      {"[+1]", "error"},
+      {"[1e]", "error"},
+      {"[1e+]", "error"},
+      {"[1E-+2]", "error"},
+      {"[-]", "error"},
+      {"-", "error"},
+      {"1.", "error"},
+      // Strings and escapes
+      {"[\"a\\\"b\\\\c\\/d\"]", "[ s:a\"b\\c/d ]"},
+      {"[\"\\b\\f\\n\\r\\t\"]", "[ s:\b\f\n\r\t ]"},
+      {"[\"caf\\u00e9 \\u20AC\"]", "[ s:caf\xc3\xa9 \xe2\x82\xac ]"},
+      {"[\"\\ud83d\\ude00!\"]", "[ s:\xf0\x9f\x98\x80! ]"}, // A surrogate pair
+      {"[\"\\ud83d\"]", "error"},        // High half alone
+      {"[\"\\ud83dx\"]", "error"},       // High half, then not an escape
+      {"[\"\\ud83d\\n\"]", "error"},    // High half, then another escape
+      {"[\"\\ud83d\\u0041\"]", "error"}, // High half, then not a low half
+      {"[\"\\ude00\"]", "error"},        // Low half alone
+      {"[\"\\x\"]", "error"},
+      {"[\"\\u12g4\"]", "error"},
+      {"[\"a\tb\"]", "error"}, // Raw control character
+      // Structure
+      {"{\"a\":[true,false,null],\"b\":{}}", "{ k:a [ t f null ] k:b { } }"},
+      {"[1,]", "error"},
+      {"{\"a\" 1}", "error"},
+      {"[1] 2", "error"},
+      {"[1", "error"},
+      {"[tru]", "error"},
+  };
+  std::size_t runs = 0;
+  for (std::size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+    std::string json = cases[c].json;
+    for (std::size_t split = 0; split <= json.size(); split++) {
+      std::string events = parseJson(json, split);
+      CHECK(events == cases[c].events, "%s split at %zu: %s", cases[c].json, split,
+            events.c_str());
+      runs++;
+    }
+  }
+  std::printf("json parser: %zu runs over %zu documents\n", runs,
+              sizeof(cases) / sizeof(cases[0]));
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Activity counters
+
+// Adds ids [from, to) to `hll`
+void addRange(HyperLogLog& hll, std::uint64_t from, std::uint64_t to) {
+  for (std::uint64_t id = from; id < to; id++) hll.add(mixId(id));
+}
+
+void testHyperLogLog() {
+  const int precisions[] = {ActivityCounters::kWindowPrecision, ActivityCounters::kDailyPrecision};
+  const std::uint64_t counts[] = {0, 1, 10, 100, 1000, 10000, 100000, 1000000};
+  for (int p = 0; p < 2; p++) {
+    // Within three standard errors; the hashes are fixed, so this either
+    // always passes or never does
+    double bound = 3 * 1.04 / std::sqrt(static_cast<double>(std::size_t(1) << precisions[p]));
+    for (int c = 0; c < 8; c++) {
+      HyperLogLog hll(precisions[p]);
+      addRange(hll, 0, counts[c]);
+      double estimate = hll.estimate();
+      CHECK(std::fabs(estimate - counts[c]) <= bound * counts[c] + 0.5,
+            "precision %d: %llu distinct ids estimated as %.1f", precisions[p],
+            (unsigned long long)counts[c], estimate);
+      // Seen again, nothing changes
+      bool changed = false;
+      for (std::uint64_t id = 0; id < counts[c] && id < 1000; id++) changed |= hll.add(mixId(id));
+      CHECK(!changed && hll.estimate() == estimate, "precision %d: repeats changed the sketch",
+            precisions[p]);
+    }
+
+    // Two overlapping sets merge to exactly the sketch of their union
+    HyperLogLog a(precisions[p]);
+    HyperLogLog b(precisions[p]);
+    HyperLogLog both(precisions[p]);
+    addRange(a, 0, 60000);
+    addRange(b, 30000, 90000);
+    addRange(both, 0, 90000);
+    a.merge(b);
+    bool same = true;
+    for (std::size_t i = 0; i < a.size(); i++) same &= a.get(i) == both.get(i);
+    CHECK(same, "precision %d: merge differs from the union", precisions[p]);
+    CHECK(std::fabs(a.estimate() - 90000) <= bound * 90000, "precision %d: union of 90000 is %.0f",
+          precisions[p], a.estimate());
+  }
+}
+
+// Whether a count from the window's sketches is within three standard
+// errors of `expected`; the daily ones are finer still
+bool near(int count, int expected) {
+  double bound = 3 * 1.04 / std::sqrt(double(std::size_t(1) << ActivityCounters::kWindowPrecision));
+  return std::fabs(count - expected) <= bound * expected + 1;
+}
+
+// Records users [from, to) on systems id % 10, all in second `now`
+void recordRange(ActivityCounters& activity, std::uint64_t from, std::uint64_t to,
+                 std::time_t now) {
+  for (std::uint64_t id = from; id < to; id++) activity.record(id, id % 10, now);
+}
+
+// Ticks every second after `from` up to `to`, as the server does, and
+// returns the counts of the last
+ActivityCounts tickTo(ActivityCounters& activity, std::time_t from, std::time_t to) {
+  ActivityCounts counts;
+  for (std::time_t second = from + 1; second <= to; second++) counts = activity.tick(second);
+  return counts;
+}
+
+void testActivityWindow() {
+  // Midday, so the day doesn't change under the window
+  struct tm local = {};
+  local.tm_year = 2018 - 1900;
+  local.tm_mon = 9;
+  local.tm_mday = 6;
+  local.tm_hour = 12;
+  local.tm_isdst = -1;
+  const std::time_t start = std::mktime(&local);
+
+  ActivityCounters activity(start);
+  recordRange(activity, 0, 100, start);
+  ActivityCounts counts = activity.tick(start);
+  CHECK(near(counts.users, 100) && counts.systems == 10 && near(counts.usersToday, 100),
+        "start: %d users, %d systems, %d today", counts.users, counts.systems, counts.usersToday);
+
+  // Half a minute later another 50, 20 of them seen before
+  tickTo(activity, start, start + 29);
+  recordRange(activity, 80, 130, start + 30);
+  counts = activity.tick(start + 30);
+  CHECK(near(counts.users, 130) && near(counts.usersToday, 130), "+30s: %d users, %d today",
+        counts.users, counts.usersToday);
+
+  // The first second is still in the window at +59 and gone at +60
+  int before = counts.users;
+  counts = tickTo(activity, start + 30, start + 59);
+  CHECK(counts.users == before, "+59s: %d users, not %d", counts.users, before);
+  counts = activity.tick(start + 60);
+  CHECK(near(counts.users, 50) && counts.systems == 10 && near(counts.usersToday, 130),
+        "+60s: %d users, %d systems, %d today", counts.users, counts.systems, counts.usersToday);
+  counts = tickTo(activity, start + 60, start + 90);
+  CHECK(counts.users == 0 && counts.systems == 0 && near(counts.usersToday, 130),
+        "+90s: %d users, %d today", counts.users, counts.usersToday);
+
+  // The ring wraps: what the first seconds' buckets held doesn't come back
+  // when they are reused
+  std::time_t reuse = start + 2 * ActivityCounters::kBuckets;
+  tickTo(activity, start + 90, reuse - 1);
+  recordRange(activity, 1000, 1005, reuse);
+  counts = activity.tick(reuse);
+  CHECK(counts.users == 5 && near(counts.usersToday, 135), "reused bucket: %d users, %d today",
+        counts.users, counts.usersToday);
+  counts = tickTo(activity, reuse, reuse + ActivityCounters::kBuckets);
+  CHECK(counts.users == 0, "a ring later: %d users", counts.users);
+}
+
+void testActivityDay() {
+  struct tm local = {};
+  local.tm_year = 2018 - 1900;
+  local.tm_mon = 9;
+  local.tm_mday = 7;
+  local.tm_isdst = -1;
+  const std::time_t midnight = std::mktime(&local);
+  const std::time_t start = midnight - 20;
+
+  ActivityCounters activity(start);
+  recordRange(activity, 0, 100, start);
+  ActivityCounts counts = tickTo(activity, start - 1, midnight - 1);
+  CHECK(near(counts.users, 100) && near(counts.usersToday, 100), "23:59:59: %d users, %d today",
+        counts.users, counts.usersToday);
+
+  // At midnight the day starts over, but the last minute is still the last
+  // minute
+  int before = counts.users;
+  counts = activity.tick(midnight);
+  CHECK(counts.users == before && counts.usersToday == 0 && counts.systemsToday == 0,
+        "00:00:00: %d users, %d today, %d systems today", counts.users, counts.usersToday,
+        counts.systemsToday);
+  recordRange(activity, 50, 80, midnight + 1);
+  counts = tickTo(activity, midnight, midnight + 1);
+  CHECK(counts.users == before && near(counts.usersToday, 30) && counts.systemsToday == 10,
+        "00:00:01: %d users, %d today, %d systems today", counts.users, counts.usersToday,
+        counts.systemsToday);
+
+  // A peer's registers for yesterday are dropped, today's taken
+  activity.mergeToday(activity.day() - 1, false, 0, 40);
+  CHECK(activity.today(false).get(0) < 40, "yesterday's register merged into today");
+  activity.mergeToday(activity.day(), false, 0, 40);
+  CHECK(activity.today(false).get(0) == 40, "today's register not merged");
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Cluster deltas
+
+LwwRegister lww(int value, std::int64_t stamp, std::uint32_t node) {
+  LwwRegister r;
+  r.value = value;
+  r.stamp = stamp;
+  r.node = node;
+  return r;
+}
+
+void testLwwRegister() {
+  LwwRegister r = lww(1, 1000, 2);
+  CHECK(!r.merge(lww(2, 999, 9)) && r.value == 1, "an earlier write won");
+  CHECK(r.merge(lww(3, 1001, 1)) && r.value == 3, "a later write lost");
+  // Same stamp: the higher node wins, on every node alike
+  CHECK(!r.merge(lww(4, 1001, 0)) && r.value == 3, "a lower node won a tie");
+  CHECK(!r.merge(lww(5, 1001, 1)) && r.value == 3, "the same write won again");
+  CHECK(r.merge(lww(6, 1001, 2)) && r.value == 6 && r.node == 2, "a higher node lost a tie");
+
+  LwwRegister a = lww(7, 5, 1);
+  LwwRegister b = lww(8, 5, 3);
+  LwwRegister ab = a;
+  LwwRegister ba = b;
+  ab.merge(b);
+  ba.merge(a);
+  CHECK(ab.value == ba.value && ab.value == 8, "merges disagree: %d, %d", ab.value, ba.value);
+}
+
+// One delta frame from a node with some status and activity, without its
+// length prefix
+std::string sampleDelta(std::time_t now) {
+  ActivityCounters activity(now);
+  for (int i = 0; i < 500; i++) activity.record(i, i % 7, now - i % 30);
+  activity.tick(now);
+  ClusterState state(1, activity);
+  DashboardStats stats;
+  stats.s1 = 1;
+  stats.s2 = 0;
+  stats.cj = 3;
+  stats.nightMode = 1;
+  state.setStatus(stats, static_cast<std::int64_t>(now) * 1000);
+  ClusterState::PeerShadow shadow;
+  std::string frame;
+  state.encodeDelta(shadow, now, frame);
+  return frame.substr(4);
+}
+
+// Applies `frame` to a fresh node 2. Returns what applyDelta() said, and
+// what the node shows afterwards in `stats` and `describe`.
+bool applyTo(const std::string& frame, std::time_t now, DashboardStats& stats,
+             std::string* describe = nullptr) {
+  ActivityCounters activity(now);
+  ClusterState state(2, activity);
+  bool ok = state.applyDelta(reinterpret_cast<const unsigned char*>(frame.data()), frame.size(),
+                             now);
+  state.status(stats);
+  ActivityCounts counts = activity.tick(now);
+  stats.acu = counts.users;
+  stats.acs = counts.systems;
+  stats.dacu = counts.usersToday;
+  stats.dacs = counts.systemsToday;
+  if (describe) *describe = state.describe();
+  return ok;
+}
+
+// Only whether `node` takes `frame`. Whether a frame is well formed doesn't
+// depend on what the node already has, so one node does for many frames.
+bool accepts(ClusterState& node, const std::string& frame, std::time_t now) {
+  return node.applyDelta(reinterpret_cast<const unsigned char*>(frame.data()), frame.size(), now);
+}
+
+void putLe(std::string& frame, std::size_t at, std::uint64_t v, int bytes) {
+  for (int i = 0; i < bytes; i++) frame[at + i] = static_cast<char>(v >> (8 * i));
+}
+
+std::uint32_t getLe32(const std::string& frame, std::size_t at) {
+  std::uint32_t v = 0;
+  for (int i = 3; i >= 0; i--) v = v << 8 | static_cast<std::uint8_t>(frame[at + i]);
+  return v;
+}
+
+void testApplyDelta() {
+  const std::time_t now = 1700000000;
+  std::string frame = sampleDelta(now);
+  DashboardStats whole;
+  std::string described;
+  CHECK(applyTo(frame, now, whole, &described), "a whole frame was refused");
+  CHECK(whole.s1 == 1 && whole.s2 == 0 && whole.cj == 3 && whole.nightMode == 1,
+        "status not merged: %d %d %d %d", whole.s1, whole.s2, whole.cj, whole.nightMode);
+  CHECK(whole.acu > 450 && whole.acu < 550 && whole.acs == 7, "window not merged: %d %d", whole.acu,
+        whole.acs);
+  CHECK(described == "node 2\nheartbeats 500\nheartbeats/1 500\nheartbeats/2 0\n",
+        "counts not merged: %s", described.c_str());
+
+  // Cut short anywhere: refused, and never read past the end
+  ActivityCounters scratch(now);
+  ClusterState node(2, scratch);
+  for (std::size_t size = 0; size < frame.size(); size++) {
+    CHECK(!accepts(node, frame.substr(0, size), now), "a frame cut to %zu of %zu bytes was taken",
+          size, frame.size());
+  }
+  // Anything after the last section is refused
+  CHECK(!accepts(node, frame + std::string(1, '\0'), now), "a padded frame was taken");
+
+  // Where the sections start (see the layout in cluster.cpp)
+  const std::size_t nodesAt = 8 + 4 * 16;
+  const std::size_t dailyAt = nodesAt + 4 + 12 * getLe32(frame, nodesAt) + 4;
+  const std::size_t systemsAt = dailyAt + 4 + 3 * getLe32(frame, dailyAt);
+  const std::size_t bucketsAt = systemsAt + 4 + 3 * getLe32(frame, systemsAt);
+  CHECK(getLe32(frame, nodesAt) == 1 && getLe32(frame, dailyAt) > 0 &&
+            getLe32(frame, bucketsAt) > 0,
+        "unexpected sample frame");
+
+  // Counts far larger than the frame run out of bytes instead of memory
+  const std::size_t counts[] = {nodesAt, dailyAt, systemsAt, bucketsAt};
+  for (int i = 0; i < 4; i++) {
+    std::string huge = frame;
+    putLe(huge, counts[i], 0xffffffffu, 4);
+    CHECK(!accepts(node, huge, now), "a frame claiming 4G entries at %zu was taken", counts[i]);
+  }
+
+  // A status write from far in the future would win over every later one
+  DashboardStats stats;
+  std::string future = frame;
+  for (int i = 0; i < 4; i++) {
+    putLe(future, 8 + 16 * i + 4, (static_cast<std::uint64_t>(now) + 3600) * 1000, 8);
+  }
+  CHECK(applyTo(future, now, stats) && stats.s1 == -1 && stats.cj == -1,
+        "a write stamped an hour ahead was taken");
+
+  // Registers no hash could produce are capped, so the counts can't overflow
+  std::string big = frame.substr(0, dailyAt);
+  const std::uint32_t registers = 1u << ActivityCounters::kDailyPrecision;
+  big.append(4, '\0');
+  putLe(big, dailyAt, registers, 4);
+  for (std::uint32_t j = 0; j < registers; j++) {
+    big.push_back(static_cast<char>(j));
+    big.push_back(static_cast<char>(j >> 8));
+    big.push_back(static_cast<char>(255));
+  }
+  big.append(8, '\0'); // No systems, no buckets
+  CHECK(applyTo(big, now, stats) && stats.dacu > 0, "oversized registers: dacu %d", stats.dacu);
+  ActivityCounters activity(now);
+  activity.mergeToday(activity.day(), false, 0, 255);
+  activity.mergeBucket(now, false, 0, 255, now);
+  CHECK(activity.today(false).get(0) == 64 - ActivityCounters::kDailyPrecision + 1 &&
+            activity.bucket(now % ActivityCounters::kBuckets, false).get(0) ==
+                64 - ActivityCounters::kWindowPrecision + 1,
+        "merged registers not capped: %d", activity.today(false).get(0));
+  std::printf("cluster deltas: %zu cuts of a %zu byte frame\n", frame.size(), frame.size());
+}
+
+} // namespace
+
+int main() {
+  testDashboardParser();
+  testHttpParser();
+  testJsonParser();
+  testHyperLogLog();
+  testActivityWindow();
+  testActivityDay();
+  testLwwRegister();
+  testApplyDelta();
+  if (g_failures > 0) {
+    std::printf("%d checks failed\n", g_failures);
+    return EXIT_FAILURE;
+  }
+  std::printf("All passed\n");
+  return 0;
+}
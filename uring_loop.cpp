@@ -0,0 +1,493 @@
+#include "uring_loop.h"
+
+#include <sys/mman.h>    // For mmap, munmap
+#include <sys/socket.h>  // For shutdown
+#include <sys/syscall.h> // For __NR_io_uring_*
+#include <netinet/in.h>  // For sockaddr_in
+#include <poll.h>        // For POLLIN
+#include <cerrno>        // For errno
+#include <cstdlib>       // For calloc, free
+#include <cstring>       // For memset
+#include <fcntl.h>       // For fcntl
+#include <iostream>      // For cout
+#include <unistd.h>      // For close, syscall
+
+namespace {
+
+const unsigned kEntries = 1024;        // Submission queue; the completion queue is 4x
+const unsigned kBufferCount = 512;     // Receive buffers shared by every connection
+const std::size_t kBufferSize = 4096;
+const std::uint16_t kBufferGroup = 0;
+
+// What a request was, in the low byte of its user_data; the fd and the
+// connection's generation fill the rest
+enum Op { kOpAccept = 1, kOpRecv, kOpSend, kOpWatch, kOpTimeout, kOpCancel, kOpClose };
+
+std::uint64_t userData(std::uint8_t op, int fd, std::uint32_t generation) {
+  return std::uint64_t(generation) << 32 | std::uint64_t(std::uint32_t(fd) & 0xffffff) << 8 | op;
+}
+
+int setUpRing(unsigned entries, io_uring_params& params, unsigned flags) {
+  std::memset(&params, 0, sizeof(params));
+  params.flags = flags | IORING_SETUP_CQSIZE;
+  params.cq_entries = entries * 4;
+  return static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+}
+
+} // namespace
+
+UringLoop::UringLoop(int listenFd, Handler handler, LoopLimits limits)
+    : EventLoop(listenFd, handler, limits),
+      ringFd_(-1),
+      sqRing_(MAP_FAILED),
+      cqRing_(MAP_FAILED),
+      sqRingSize_(0),
+      cqRingSize_(0),
+      sqes_(nullptr),
+      queued_(0),
+      localTail_(0),
+      bufRing_(nullptr),
+      bufTail_(0),
+      nextGeneration_(0),
+      acceptArmed_(false),
+      timeoutArmed_(false) {
+  tick_.tv_sec = 1;
+  tick_.tv_nsec = 0;
+}
+
+UringLoop::~UringLoop() {
+  // Closing the ring cancels whatever it still had in flight
+  if (ringFd_ >= 0) close(ringFd_);
+  if (sqes_) munmap(sqes_, sqEntries_ * sizeof(io_uring_sqe));
+  if (cqRing_ != MAP_FAILED && cqRing_ != sqRing_) munmap(cqRing_, cqRingSize_);
+  if (sqRing_ != MAP_FAILED) munmap(sqRing_, sqRingSize_);
+  if (bufRing_) munmap(bufRing_, kBufferCount * sizeof(io_uring_buf));
+}
+
+bool UringLoop::available() {
+  io_uring_params params;
+  int fd = setUpRing(4, params, 0);
+  if (fd < 0) return false;
+
+  // Multishot recv arrived in the same release as IORING_OP_SEND_ZC, which
+  // the probe can see
+  std::size_t size = sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op);
+  io_uring_probe* probe = static_cast<io_uring_probe*>(std::calloc(1, size));
+  bool ok = probe && syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, probe, 256) == 0 &&
+            probe->last_op >= IORING_OP_SEND_ZC &&
+            (probe->ops[IORING_OP_SEND_ZC].flags & IO_URING_OP_SUPPORTED);
+  std::free(probe);
+  close(fd);
+  return ok;
+}
+
+bool UringLoop::setUp() {
+  // Only this thread submits, so completions can wait until it asks for them
+  io_uring_params params;
+  ringFd_ = setUpRing(kEntries, params, IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN);
+  if (ringFd_ < 0 && errno == EINVAL) ringFd_ = setUpRing(kEntries, params, 0);
+  if (ringFd_ < 0) {
+    std::cout << "Failed to create io_uring. errno: " << errno << std::endl;
+    return false;
+  }
+
+  sqRingSize_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  cqRingSize_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+  bool single = params.features & IORING_FEAT_SINGLE_MMAP;
+  if (single && cqRingSize_ > sqRingSize_) sqRingSize_ = cqRingSize_;
+  sqRing_ = mmap(nullptr, sqRingSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd_,
+                 IORING_OFF_SQ_RING);
+  cqRing_ = single ? sqRing_
+                   : mmap(nullptr, cqRingSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                          ringFd_, IORING_OFF_CQ_RING);
+  sqEntries_ = params.sq_entries;
+  void* sqes = mmap(nullptr, sqEntries_ * sizeof(io_uring_sqe), PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, ringFd_, IORING_OFF_SQES);
+  if (sqRing_ == MAP_FAILED || cqRing_ == MAP_FAILED || sqes == MAP_FAILED) {
+    std::cout << "Failed to map io_uring. errno: " << errno << std::endl;
+    return false;
+  }
+  sqes_ = static_cast<io_uring_sqe*>(sqes);
+
+  char* sq = static_cast<char*>(sqRing_);
+  sqHead_ = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+  sqTail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+  sqArray_ = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+  sqMask_ = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+  localTail_ = *sqTail_;
+  char* cq = static_cast<char*>(cqRing_);
+  cqHead_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+  cqTail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+  cqMask_ = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+  cqes_ = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+  // The receive buffers: the kernel picks a free one for each recv
+  void* ring = mmap(nullptr, kBufferCount * sizeof(io_uring_buf), PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (ring == MAP_FAILED) {
+    std::cout << "Failed to allocate the buffer ring. errno: " << errno << std::endl;
+    return false;
+  }
+  bufRing_ = static_cast<io_uring_buf_ring*>(ring);
+  io_uring_buf_reg reg;
+  std::memset(&reg, 0, sizeof(reg));
+  reg.ring_addr = reinterpret_cast<std::uintptr_t>(bufRing_);
+  reg.ring_entries = kBufferCount;
+  reg.bgid = kBufferGroup;
+  if (syscall(__NR_io_uring_register, ringFd_, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+    std::cout << "Failed to register the buffer ring. errno: " << errno << std::endl;
+    return false;
+  }
+  buffers_.resize(kBufferCount * kBufferSize);
+  for (unsigned i = 0; i < kBufferCount; i++) recycleBuffer(i);
+
+  // io_uring waits for accepts itself; a non-blocking listener would only
+  // make it report EAGAIN
+  int flags = fcntl(listenFd_, F_GETFL);
+  if (flags >= 0) fcntl(listenFd_, F_SETFL, flags & ~O_NONBLOCK);
+  return true;
+}
+
+int UringLoop::run() {
+  if (!setUp()) return -1;
+
+  running_ = true;
+  watchArmed_.assign(watches_.size(), false);
+  armAccept();
+  std::time_t lastSweep = std::time(nullptr);
+
+  while (running_) {
+    rearm();
+    // Submit everything the last batch queued and wait for the next one
+    if (enter(queued_, 1) < 0 && errno != EINTR && errno != EBUSY && errno != EAGAIN) {
+      std::cout << "io_uring_enter failed. errno: " << errno << std::endl;
+      return -1;
+    }
+
+    unsigned head = *cqHead_;
+    unsigned tail = __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE);
+    while (head != tail) {
+      io_uring_cqe cqe = cqes_[head & cqMask_];
+      // Handing the slot back first leaves room for what handling it queues
+      __atomic_store_n(cqHead_, ++head, __ATOMIC_RELEASE);
+      handle(cqe);
+      tail = __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE);
+    }
+
+    std::time_t now = std::time(nullptr);
+    if (now != lastSweep) {
+      lastSweep = now;
+      // An accept that stopped for lack of fds gets another go
+      if (!acceptArmed_) armAccept();
+      for (std::size_t i = 0; i < ticks_.size(); i++) ticks_[i](now);
+      sweepIdle(now);
+    }
+  }
+
+  return 0;
+}
+
+io_uring_sqe* UringLoop::nextSqe(std::uint8_t op, int fd, std::uint32_t generation) {
+  // Full: hand the kernel what is there so far. A slot is only free once the
+  // kernel has read it, so if it takes none there is nothing to give out.
+  while (localTail_ - __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE) >= sqEntries_) {
+    int n = enter(queued_, 0);
+    if (n > 0 || (n < 0 && errno == EINTR)) continue;
+    std::cout << "Failed to submit to io_uring. errno: " << (n < 0 ? errno : 0) << std::endl;
+    return nullptr;
+  }
+
+  unsigned index = localTail_ & sqMask_;
+  io_uring_sqe* sqe = &sqes_[index];
+  std::memset(sqe, 0, sizeof(*sqe));
+  sqe->fd = fd;
+  sqe->user_data = userData(op, fd, generation);
+  sqArray_[index] = index;
+  localTail_++;
+  queued_++;
+  return sqe;
+}
+
+int UringLoop::enter(unsigned submit, unsigned wait) {
+  __atomic_store_n(sqTail_, localTail_, __ATOMIC_RELEASE);
+  int n = static_cast<int>(syscall(__NR_io_uring_enter, ringFd_, submit, wait,
+                                   wait ? IORING_ENTER_GETEVENTS : 0, nullptr, 0));
+  if (n > 0) queued_ -= n;
+  return n;
+}
+
+void UringLoop::recycleBuffer(std::uint16_t id) {
+  // The ring is an array of io_uring_buf. (Not through `bufs`, which C++
+  // lays out 8 bytes late.) Field by field: the first entry's last bytes
+  // are the ring's tail.
+  io_uring_buf& buf = reinterpret_cast<io_uring_buf*>(bufRing_)[bufTail_ & (kBufferCount - 1)];
+  buf.addr = reinterpret_cast<std::uintptr_t>(&buffers_[id * kBufferSize]);
+  buf.len = kBufferSize;
+  buf.bid = id;
+  __atomic_store_n(&bufRing_->tail, ++bufTail_, __ATOMIC_RELEASE);
+}
+
+void UringLoop::armAccept() {
+  io_uring_sqe* sqe = nextSqe(kOpAccept, listenFd_, 0);
+  if (!sqe) return; // The next tick tries again
+  sqe->opcode = IORING_OP_ACCEPT;
+  sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+  sqe->accept_flags = SOCK_CLOEXEC;
+  acceptArmed_ = true;
+}
+
+bool UringLoop::armRecv(Connection& conn) {
+  Pending& p = *pending_[conn.fd];
+  io_uring_sqe* sqe = nextSqe(kOpRecv, conn.fd, p.generation);
+  if (!sqe) return false;
+  sqe->opcode = IORING_OP_RECV;
+  sqe->ioprio = IORING_RECV_MULTISHOT;
+  sqe->flags = IOSQE_BUFFER_SELECT;
+  sqe->buf_group = kBufferGroup;
+  p.receiving = true;
+  p.recvCancelled = false;
+  p.inFlight++;
+  return true;
+}
+
+void UringLoop::armWatch(std::size_t i) {
+  io_uring_sqe* sqe = nextSqe(kOpWatch, watches_[i].fd, 0);
+  if (!sqe) return;
+  sqe->opcode = IORING_OP_POLL_ADD;
+  sqe->len = IORING_POLL_ADD_MULTI;
+  sqe->poll32_events = POLLIN;
+  watchArmed_[i] = true;
+}
+
+void UringLoop::armTimeout() {
+  // Wakes the loop at least once a second for the ticks and idle sweep
+  io_uring_sqe* sqe = nextSqe(kOpTimeout, -1, 0);
+  if (!sqe) return;
+  sqe->opcode = IORING_OP_TIMEOUT;
+  sqe->addr = reinterpret_cast<std::uintptr_t>(&tick_);
+  sqe->len = 1;
+  timeoutArmed_ = true;
+}
+
+// The loop's own requests are armed once and again as each completes; one
+// that could not be queued then is retried before the loop waits
+void UringLoop::rearm() {
+  if (!timeoutArmed_) armTimeout();
+  for (std::size_t i = 0; i < watches_.size(); i++) {
+    if (!watchArmed_[i]) armWatch(i);
+  }
+}
+
+void UringLoop::handle(const io_uring_cqe& cqe) {
+  std::uint8_t op = cqe.user_data & 0xff;
+  int fd = static_cast<int>((cqe.user_data >> 8) & 0xffffff);
+  std::uint32_t generation = static_cast<std::uint32_t>(cqe.user_data >> 32);
+  bool more = cqe.flags & IORING_CQE_F_MORE;
+
+  switch (op) {
+    case kOpAccept:
+      onAccept(cqe.res, cqe.flags);
+      return;
+    case kOpTimeout:
+      timeoutArmed_ = false;
+      armTimeout();
+      return;
+    case kOpWatch:
+      for (std::size_t i = 0; i < watches_.size(); i++) {
+        if (watches_[i].fd != fd) continue;
+        if (cqe.res >= 0) watches_[i].callback();
+        if (!more) {
+          watchArmed_[i] = false;
+          armWatch(i);
+        }
+      }
+      return;
+    case kOpRecv:
+    case kOpSend:
+      break;
+    default:
+      return; // Cancels and closes need nothing more
+  }
+
+  bool known = fd < static_cast<int>(conns_.size()) && conns_[fd] &&
+               pending_[fd]->generation == generation;
+  if (!known) {
+    // Can't happen while connections wait for their requests, but a buffer
+    // must go back to the ring whatever it was read for
+    if (cqe.flags & IORING_CQE_F_BUFFER) recycleBuffer(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+    return;
+  }
+
+  Connection& conn = *conns_[fd];
+  if (op == kOpRecv) onRecv(conn, cqe.res, cqe.flags);
+  else onSend(conn, cqe.res);
+
+  // Either may have closed it, or let go of its last request
+  if (conns_[fd] && pending_[fd]->closing && pending_[fd]->inFlight == 0) finishClose(*conns_[fd]);
+}
+
+void UringLoop::onAccept(int res, std::uint32_t flags) {
+  if (!(flags & IORING_CQE_F_MORE)) acceptArmed_ = false;
+  if (res < 0) {
+    if (res == -EMFILE || res == -ENFILE || res == -ENOBUFS || res == -ENOMEM) {
+      // Leave the rest in the backlog; run() rearms on the next tick
+      std::cout << "Failed to grab connection. errno: " << -res << std::endl;
+      return;
+    }
+    if (!acceptArmed_) armAccept();
+    return;
+  }
+
+  int fd = res;
+  if (static_cast<std::size_t>(fd) >= conns_.size()) {
+    conns_.resize(fd + 1);
+    pending_.resize(fd + 1);
+  }
+  conns_[fd].reset(new Connection());
+  Connection& conn = *conns_[fd];
+  conn.fd = fd;
+  sockaddr_in peer = {};
+  socklen_t peerLen = sizeof(peer);
+  if (getpeername(fd, (struct sockaddr*)&peer, &peerLen) == 0) {
+    conn.peerAddr = ntohl(peer.sin_addr.s_addr);
+  }
+  conn.lastActive = std::time(nullptr);
+
+  // Reused with the fd; the generation tells late completions apart
+  if (!pending_[fd]) pending_[fd].reset(new Pending());
+  Pending& p = *pending_[fd];
+  p.generation = ++nextGeneration_;
+  p.inFlight = 0;
+  p.receiving = false;
+  p.sending = false;
+  p.closing = false;
+
+  open_++;
+  if (metrics_) metrics_->add(kAccepted, 1);
+  if (!armRecv(conn)) closeConnection(conn);
+  if (!acceptArmed_) armAccept();
+}
+
+void UringLoop::onRecv(Connection& conn, int res, std::uint32_t flags) {
+  Pending& p = *pending_[conn.fd];
+  if (!(flags & IORING_CQE_F_MORE)) {
+    p.receiving = false;
+    p.inFlight--;
+  }
+
+  if (res > 0) {
+    std::uint16_t id = flags >> IORING_CQE_BUFFER_SHIFT;
+    if (!p.closing) conn.in.append(&buffers_[id * kBufferSize], res);
+    recycleBuffer(id);
+    if (p.closing) return;
+    if (metrics_) metrics_->add(kBytesIn, res);
+    conn.lastActive = std::time(nullptr);
+
+    if (!conn.in.empty() && !handler_(conn)) {
+      closeConnection(conn);
+      return;
+    }
+    // A paused handler is holding on to its input on purpose
+    if (conn.in.size() > limits_.maxInput && !conn.readPaused) {
+      closeConnection(conn);
+      return;
+    }
+  } else if (res == 0) {
+    if (p.closing) return;
+    // Nothing more will arrive; finish sending, then close
+    conn.readClosed = true;
+    if (!conn.readPaused) conn.closeAfterWrite = true;
+  } else if (res != -ENOBUFS && res != -ECANCELED) {
+    // Out of buffers just needs rearming, and a cancel was ours (readPaused)
+    if (!p.closing) closeConnection(conn);
+    return;
+  }
+
+  if (!p.closing && !flush(conn)) closeConnection(conn);
+}
+
+void UringLoop::onSend(Connection& conn, int res) {
+  Pending& p = *pending_[conn.fd];
+  p.sending = false;
+  p.inFlight--;
+  if (p.closing) return;
+  if (res < 0) {
+    closeConnection(conn);
+    return;
+  }
+
+  if (metrics_) {
+    metrics_->recordSince(kStageSend, p.sendStarted);
+    metrics_->add(kBytesOut, res);
+  }
+  conn.out.consume(res);
+  conn.lastActive = std::time(nullptr);
+  if (!flush(conn)) closeConnection(conn);
+}
+
+// Starts the next send, if there is something to send and none in flight,
+// and keeps a recv armed as long as the connection wants input
+bool UringLoop::flush(Connection& conn) {
+  Pending& p = *pending_[conn.fd];
+  if (p.closing) return true;
+
+  if (!p.receiving && !conn.readClosed && !conn.readPaused) {
+    if (!armRecv(conn)) return false;
+  } else if (p.receiving && conn.readPaused && !p.recvCancelled) {
+    // If it can't be queued now, the next flush asks again
+    io_uring_sqe* sqe = nextSqe(kOpCancel, conn.fd, 0);
+    if (sqe) {
+      sqe->opcode = IORING_OP_ASYNC_CANCEL;
+      sqe->addr = userData(kOpRecv, conn.fd, p.generation);
+      p.recvCancelled = true;
+    }
+  }
+
+  if (conn.out.empty()) return !conn.closeAfterWrite;
+  if (conn.out.pending() > limits_.maxOutput) return false;
+  if (p.sending) return true;
+
+  std::memset(&p.msg, 0, sizeof(p.msg));
+  p.msg.msg_iov = p.iov;
+  p.msg.msg_iovlen = conn.out.gatherStable(p.iov, kMaxIov, p.copy);
+  io_uring_sqe* sqe = nextSqe(kOpSend, conn.fd, p.generation);
+  if (!sqe) return false;
+  sqe->opcode = IORING_OP_SENDMSG;
+  sqe->addr = reinterpret_cast<std::uintptr_t>(&p.msg);
+  sqe->len = 1;
+  sqe->msg_flags = MSG_NOSIGNAL;
+  p.sending = true;
+  p.inFlight++;
+  if (metrics_) p.sendStarted = metricsClock();
+  return true;
+}
+
+// The kernel may still be reading into or sending out of the connection, so
+// it is only freed once every request on it has completed
+void UringLoop::closeConnection(Connection& conn) {
+  Pending& p = *pending_[conn.fd];
+  if (p.closing) return;
+  p.closing = true;
+  if (p.inFlight == 0) {
+    finishClose(conn);
+    return;
+  }
+  io_uring_sqe* sqe = nextSqe(kOpCancel, conn.fd, 0);
+  if (!sqe) {
+    // Shutting the socket down ends its requests just the same
+    shutdown(conn.fd, SHUT_RDWR);
+    return;
+  }
+  sqe->opcode = IORING_OP_ASYNC_CANCEL;
+  sqe->cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+}
+
+void UringLoop::finishClose(Connection& conn) {
+  int fd = conn.fd;
+  io_uring_sqe* sqe = nextSqe(kOpClose, fd, 0);
+  if (sqe) sqe->opcode = IORING_OP_CLOSE;
+  else close(fd);
+  conns_[fd].reset();
+  open_--;
+  if (metrics_) metrics_->add(kClosed, 1);
+}
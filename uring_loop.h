@@ -0,0 +1,105 @@
+#ifndef SCOREBOARD_URING_LOOP_H
+#define SCOREBOARD_URING_LOOP_H
+
+#include <linux/io_uring.h>
+#include <linux/time_types.h> // For __kernel_timespec
+#include <sys/socket.h>       // For msghdr
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "event_loop.h"
+
+// EventLoop on io_uring, for the connection churn of every scoreboard
+// reconnecting each poll. One multishot accept takes every connection, each
+// connection has one multishot recv into a ring of buffers registered with
+// the kernel, replies go out as sendmsg requests, and everything queued
+// while handling a batch of completions is submitted with the one
+// io_uring_enter() that waits for the next batch. Talks to the kernel
+// directly (no liburing).
+//
+// With metrics, sends are timed from submission to completion; accepts and
+// reads make no syscalls of their own here, so they are only counted.
+class UringLoop : public EventLoop {
+ public:
+  UringLoop(int listenFd, Handler handler, LoopLimits limits = LoopLimits());
+  ~UringLoop();
+
+  // True if this kernel has everything run() needs (multishot accept and
+  // recv, provided buffer rings: Linux 6.0 or later) and io_uring isn't
+  // disabled or filtered out
+  static bool available();
+
+  int run() override;
+
+ protected:
+  bool flush(Connection& conn) override;
+  void closeConnection(Connection& conn) override;
+
+ private:
+  static const int kMaxIov = 64;
+
+  // io_uring state for one connection, kept apart from Connection so the
+  // epoll loop doesn't carry it
+  struct Pending {
+    std::uint32_t generation = 0; // Tells this connection from an earlier one on the fd
+    int inFlight = 0;             // Requests the kernel still owns
+    bool receiving = false;
+    bool recvCancelled = false;   // Asked the kernel to stop receiving (readPaused)
+    bool sending = false;
+    bool closing = false;         // Closed once inFlight drops to 0
+    std::uint64_t sendStarted = 0;
+    msghdr msg;
+    iovec iov[kMaxIov];
+    std::string copy;             // Owned reply bytes, while they are being sent
+  };
+
+  bool setUp();
+  // A free SQE, or null if the queue is full and the kernel won't take any
+  // of it, in which case the request fails
+  io_uring_sqe* nextSqe(std::uint8_t op, int fd, std::uint32_t generation);
+  int enter(unsigned submit, unsigned wait);
+  void handle(const io_uring_cqe& cqe);
+  void armAccept();
+  bool armRecv(Connection& conn);
+  void armWatch(std::size_t i);
+  void armTimeout();
+  void rearm();
+  void onAccept(int res, std::uint32_t flags);
+  void onRecv(Connection& conn, int res, std::uint32_t flags);
+  void onSend(Connection& conn, int res);
+  void finishClose(Connection& conn);
+  void recycleBuffer(std::uint16_t id);
+
+  int ringFd_;
+  void* sqRing_;
+  void* cqRing_;
+  std::size_t sqRingSize_;
+  std::size_t cqRingSize_;
+  io_uring_sqe* sqes_;
+  unsigned* sqHead_;
+  unsigned* sqTail_;
+  unsigned* sqArray_;
+  unsigned sqMask_;
+  unsigned sqEntries_;
+  unsigned* cqHead_;
+  unsigned* cqTail_;
+  unsigned cqMask_;
+  io_uring_cqe* cqes_;
+  unsigned queued_;    // SQEs filled in since the last io_uring_enter()
+  unsigned localTail_; // Our copy of *sqTail_, published on enter()
+
+  io_uring_buf_ring* bufRing_;
+  std::vector<char> buffers_;
+  std::uint16_t bufTail_;
+
+  __kernel_timespec tick_;
+  std::uint32_t nextGeneration_;
+  bool acceptArmed_;
+  bool timeoutArmed_;
+  std::vector<bool> watchArmed_; // Indexed like watches_
+  std::vector<std::unique_ptr<Pending> > pending_; // Indexed by fd, like conns_
+};
+
+#endif // SCOREBOARD_URING_LOOP_H